@@ -11,13 +11,24 @@
   regions of virtual address space to make prefetching decisions, but this 
   version works only on smaller 4 KB physical pages.
 
+  Whether prefetches are issued into the L2 or LLC is adjusted at run time
+  by the feedback throttle in inc/throttle.h.  The prefetch degree stays
+  fixed: this prefetcher's coverage is limited by the patterns it can match,
+  so the throttle's extra degree only cost it bandwidth.
+
  */
 
 #include <stdio.h>
+#include <stdint.h>
 #include "../inc/prefetcher.h"
+#include "../inc/throttle.h"
 
 #define AMPM_PAGE_COUNT 64
+// slots in the page number hash index, must be a power of two and larger than AMPM_PAGE_COUNT
+#define AMPM_PAGE_HASH_SIZE (2*AMPM_PAGE_COUNT)
 #define PREFETCH_DEGREE 2
+// bits 1 through 16 of a candidate vector, one bit per stride we check
+#define AMPM_STRIDE_MASK 0x1fffeULL
 
 typedef struct ampm_page
 {
@@ -25,39 +36,185 @@ typedef struct ampm_page
   unsigned long long int page;
 
   // The access map itself.
-  // Each element is set when the corresponding cache line is accessed.
-  // The whole structure is analyzed to make prefetching decisions.
-  // While this is coded as an integer array, it is used conceptually as a single 64-bit vector.
-  int access_map[64];
+  // Bit N is set when cache line N of the page is accessed.
+  // The whole vector is analyzed at once to make prefetching decisions.
+  uint64_t access_map;
 
   // This map represents cache lines in this page that have already been prefetched.
   // We will only prefetch lines that haven't already been either demand accessed or prefetched.
-  int pf_map[64];
+  uint64_t pf_map;
+
+  // set once this entry has been allocated to a page
+  int valid;
 
   // used for page replacement
-  unsigned long long int lru;
+  // neighbours of this page in the LRU list, -1 at either end
+  int lru_newer;
+  int lru_older;
 } ampm_page_t;
 
 ampm_page_t ampm_pages[AMPM_PAGE_COUNT];
 
+// Open-addressing hash index from page number to ampm_pages index, using linear probing.
+// Empty slots hold -1.  Removal shifts later entries back, so no tombstones are needed.
+int ampm_page_hash[AMPM_PAGE_HASH_SIZE];
+
+// the most and least recently used ampm_pages indices
+int ampm_lru_head;
+int ampm_lru_tail;
+
+// returns the home slot of a page in the hash index
+int ampm_page_hash_slot(unsigned long long int page)
+{
+  unsigned long long int hash = page * 0x9e3779b97f4a7c15ULL;
+
+  return (int)((hash ^ (hash>>32)) & (AMPM_PAGE_HASH_SIZE-1));
+}
+
+// returns the ampm_pages index tracking this page, or -1 if the page is not tracked
+int ampm_page_find(unsigned long long int page)
+{
+  int slot = ampm_page_hash_slot(page);
+  while(ampm_page_hash[slot] != -1)
+    {
+      if(ampm_pages[ampm_page_hash[slot]].page == page)
+	{
+	  return ampm_page_hash[slot];
+	}
+      slot = (slot+1) & (AMPM_PAGE_HASH_SIZE-1);
+    }
+
+  return -1;
+}
+
+void ampm_page_hash_insert(int page_index)
+{
+  int slot = ampm_page_hash_slot(ampm_pages[page_index].page);
+  while(ampm_page_hash[slot] != -1)
+    {
+      slot = (slot+1) & (AMPM_PAGE_HASH_SIZE-1);
+    }
+
+  ampm_page_hash[slot] = page_index;
+}
+
+void ampm_page_hash_remove(int page_index)
+{
+  int slot = ampm_page_hash_slot(ampm_pages[page_index].page);
+  while(ampm_page_hash[slot] != page_index)
+    {
+      slot = (slot+1) & (AMPM_PAGE_HASH_SIZE-1);
+    }
+  ampm_page_hash[slot] = -1;
+
+  // close the gap, moving back any later entry of the probe run whose home slot allows it
+  int next = (slot+1) & (AMPM_PAGE_HASH_SIZE-1);
+  while(ampm_page_hash[next] != -1)
+    {
+      int home = ampm_page_hash_slot(ampm_pages[ampm_page_hash[next]].page);
+      if(((next-home) & (AMPM_PAGE_HASH_SIZE-1)) >= ((next-slot) & (AMPM_PAGE_HASH_SIZE-1)))
+	{
+	  ampm_page_hash[slot] = ampm_page_hash[next];
+	  ampm_page_hash[next] = -1;
+	  slot = next;
+	}
+      next = (next+1) & (AMPM_PAGE_HASH_SIZE-1);
+    }
+}
+
+// moves a page to the most recently used end of the LRU list
+void ampm_page_touch(int page_index)
+{
+  if(ampm_lru_head == page_index)
+    {
+      return;
+    }
+
+  // unlink it
+  int newer = ampm_pages[page_index].lru_newer;
+  int older = ampm_pages[page_index].lru_older;
+  ampm_pages[newer].lru_older = older;
+  if(older == -1)
+    {
+      ampm_lru_tail = newer;
+    }
+  else
+    {
+      ampm_pages[older].lru_newer = newer;
+    }
+
+  // and put it back at the head
+  ampm_pages[page_index].lru_newer = -1;
+  ampm_pages[page_index].lru_older = ampm_lru_head;
+  ampm_pages[ampm_lru_head].lru_newer = page_index;
+  ampm_lru_head = page_index;
+}
+
+// replaces the least recently used page with this page, and returns its index
+int ampm_page_allocate(unsigned long long int page)
+{
+  int page_index = ampm_lru_tail;
+
+  if(ampm_pages[page_index].valid)
+    {
+      ampm_page_hash_remove(page_index);
+    }
+
+  ampm_pages[page_index].page = page;
+  ampm_pages[page_index].valid = 1;
+  ampm_pages[page_index].access_map = 0;
+  ampm_pages[page_index].pf_map = 0;
+  ampm_page_hash_insert(page_index);
+
+  return page_index;
+}
+
+// returns map with its bit order reversed, so bit 0 becomes bit 63
+uint64_t ampm_reverse_map(uint64_t map)
+{
+  map = ((map>>1)&0x5555555555555555ULL) | ((map&0x5555555555555555ULL)<<1);
+  map = ((map>>2)&0x3333333333333333ULL) | ((map&0x3333333333333333ULL)<<2);
+  map = ((map>>4)&0x0f0f0f0f0f0f0f0fULL) | ((map&0x0f0f0f0f0f0f0f0fULL)<<4);
+  return __builtin_bswap64(map);
+}
+
+// packs the even bits of map into the low 32 bits, so bit 2N becomes bit N
+uint64_t ampm_even_bits(uint64_t map)
+{
+  map &= 0x5555555555555555ULL;
+  map = (map | (map>>1)) & 0x3333333333333333ULL;
+  map = (map | (map>>2)) & 0x0f0f0f0f0f0f0f0fULL;
+  map = (map | (map>>4)) & 0x00ff00ff00ff00ffULL;
+  map = (map | (map>>8)) & 0x0000ffff0000ffffULL;
+  map = (map | (map>>16)) & 0x00000000ffffffffULL;
+  return map;
+}
+
 void l2_prefetcher_initialize(int cpu_num)
 {
   printf("AMPM Lite Prefetcher\n");
   // you can inspect these knob values from your code to see which configuration you're runnig in
   printf("Knobs visible from prefetcher: %d %d %d\n", knob_scramble_loads, knob_small_llc, knob_low_bandwidth);
 
+  throttle_initialize();
+
+  // the LRU list starts out in index order, with page 0 as the first to be replaced
   int i;
   for(i=0; i<AMPM_PAGE_COUNT; i++)
     {
       ampm_pages[i].page = 0;
-      ampm_pages[i].lru = 0;
+      ampm_pages[i].valid = 0;
+      ampm_pages[i].access_map = 0;
+      ampm_pages[i].pf_map = 0;
+      ampm_pages[i].lru_newer = (i == AMPM_PAGE_COUNT-1) ? -1 : i+1;
+      ampm_pages[i].lru_older = i-1;
+    }
+  ampm_lru_head = AMPM_PAGE_COUNT-1;
+  ampm_lru_tail = 0;
 
-      int j;
-      for(j=0; j<64; j++)
-	{
-	  ampm_pages[i].access_map[j] = 0;
-	  ampm_pages[i].pf_map[j] = 0;
-	}
+  for(i=0; i<AMPM_PAGE_HASH_SIZE; i++)
+    {
+      ampm_page_hash[i] = -1;
     }
 }
 
@@ -66,167 +223,76 @@ void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned lo
   // uncomment this line to see all the information available to make prefetch decisions
   //printf("(0x%llx 0x%llx %d %d %d) ", addr, ip, cache_hit, get_l2_read_queue_occupancy(0), get_l2_mshr_occupancy(0));
 
+  throttle_operate(addr, cache_hit);
+
   unsigned long long int cl_address = addr>>6;
   unsigned long long int page = cl_address>>6;
   unsigned long long int page_offset = cl_address&63;
 
   // check to see if we have a page hit
-  int page_index = -1;
-  int i;
-  for(i=0; i<AMPM_PAGE_COUNT; i++)
-    {
-      if(ampm_pages[i].page == page)
-	{
-	  page_index = i;
-	  break;
-	}
-    }
+  int page_index = ampm_page_find(page);
 
   if(page_index == -1)
     {
-      // the page was not found, so we must replace an old page with this new page
-
-      // find the oldest page
-      int lru_index = 0;
-      unsigned long long int lru_cycle = ampm_pages[lru_index].lru;
-      int i;
-      for(i=0; i<AMPM_PAGE_COUNT; i++)
-	{
-	  if(ampm_pages[i].lru < lru_cycle)
-	    {
-	      lru_index = i;
-	      lru_cycle = ampm_pages[lru_index].lru;
-	    }
-	}
-      page_index = lru_index;
-
-      // reset the oldest page
-      ampm_pages[page_index].page = page;
-      for(i=0; i<64; i++)
-	{
-	  ampm_pages[page_index].access_map[i] = 0;
-	  ampm_pages[page_index].pf_map[i] = 0;
-	}
+      // the page was not found, so we must replace the oldest page with this new page
+      page_index = ampm_page_allocate(page);
     }
 
   // update LRU
-  ampm_pages[page_index].lru = get_current_cycle(0);
+  ampm_page_touch(page_index);
 
   // mark the access map
-  ampm_pages[page_index].access_map[page_offset] = 1;
+  ampm_pages[page_index].access_map |= 1ULL<<page_offset;
+
+  // Bit i of each vector below describes the line i away from page_offset,
+  // so all 16 strides are matched at once.  Lines off the edge of the page
+  // shift in as zeros and can never become candidates.
+  uint64_t access_map = ampm_pages[page_index].access_map;
+  uint64_t free_map = ~(access_map | ampm_pages[page_index].pf_map);
 
   // positive prefetching
+  // we need lines page_offset-i and page_offset-2*i accessed, and line page_offset+i
+  // neither demand accessed nor already prefetched
+  uint64_t behind = ampm_reverse_map(access_map) >> (63-page_offset);
+  uint64_t candidates = behind & ampm_even_bits(behind) & (free_map >> page_offset) & AMPM_STRIDE_MASK;
+
+  // issue the smallest strides first, up to the prefetch degree
   int count_prefetches = 0;
-  for(i=1; i<=16; i++)
+  while((candidates != 0) && (count_prefetches < PREFETCH_DEGREE))
     {
-      int check_index1 = page_offset - i;
-      int check_index2 = page_offset - 2*i;
-      int pf_index = page_offset + i;
-
-      if(check_index2 < 0)
-	{
-	  break;
-	}
-
-      if(pf_index > 63)
-	{
-	  break;
-	}
-
-      if(count_prefetches >= PREFETCH_DEGREE)
-	{
-	  break;
-	}
+      int pf_index = page_offset + __builtin_ctzll(candidates);
+      candidates &= candidates-1;
 
-      if(ampm_pages[page_index].access_map[pf_index] == 1)
-	{
-	  // don't prefetch something that's already been demand accessed
-	  continue;
-	}
+      // we found the stride repeated twice, so issue a prefetch
+      unsigned long long int pf_address = (page<<12)+(pf_index<<6);
 
-      if(ampm_pages[page_index].pf_map[pf_index] == 1)
-	{
-	  // don't prefetch something that's alrady been prefetched
-	  continue;
-	}
+      throttle_prefetch_line(addr, pf_address, throttle_fill_level(8));
 
-      if((ampm_pages[page_index].access_map[check_index1]==1) && (ampm_pages[page_index].access_map[check_index2]==1))
-	{
-	  // we found the stride repeated twice, so issue a prefetch
-
-	  unsigned long long int pf_address = (page<<12)+(pf_index<<6);
-
-	  // check the MSHR occupancy to decide if we're going to prefetch to the L2 or LLC
-	  if(get_l2_mshr_occupancy(0) < 8)
-	    {
-	      l2_prefetch_line(0, addr, pf_address, FILL_L2);
-	    }
-	  else
-	    {
-	      l2_prefetch_line(0, addr, pf_address, FILL_LLC);	      
-	    }
-
-	  // mark the prefetched line so we don't prefetch it again
-	  ampm_pages[page_index].pf_map[pf_index] = 1;
-	  count_prefetches++;
-	}
+      // mark the prefetched line so we don't prefetch it again
+      ampm_pages[page_index].pf_map |= 1ULL<<pf_index;
+      count_prefetches++;
     }
 
   // negative prefetching
+  // the mirror image: lines page_offset+i and page_offset+2*i accessed, line page_offset-i free
+  free_map = ~(access_map | ampm_pages[page_index].pf_map);
+  uint64_t ahead = access_map >> page_offset;
+  candidates = ahead & ampm_even_bits(ahead) & (ampm_reverse_map(free_map) >> (63-page_offset)) & AMPM_STRIDE_MASK;
+
   count_prefetches = 0;
-  for(i=1; i<=16; i++)
+  while((candidates != 0) && (count_prefetches < PREFETCH_DEGREE))
     {
-      int check_index1 = page_offset + i;
-      int check_index2 = page_offset + 2*i;
-      int pf_index = page_offset - i;
-
-      if(check_index2 > 63)
-	{
-	  break;
-	}
-
-      if(pf_index < 0)
-	{
-	  break;
-	}
+      int pf_index = page_offset - __builtin_ctzll(candidates);
+      candidates &= candidates-1;
 
-      if(count_prefetches >= PREFETCH_DEGREE)
-	{
-	  break;
-	}
+      // we found the stride repeated twice, so issue a prefetch
+      unsigned long long int pf_address = (page<<12)+(pf_index<<6);
 
-      if(ampm_pages[page_index].access_map[pf_index] == 1)
-	{
-	  // don't prefetch something that's already been demand accessed
-	  continue;
-	}
-
-      if(ampm_pages[page_index].pf_map[pf_index] == 1)
-	{
-	  // don't prefetch something that's alrady been prefetched
-	  continue;
-	}
+      throttle_prefetch_line(addr, pf_address, throttle_fill_level(12));
 
-      if((ampm_pages[page_index].access_map[check_index1]==1) && (ampm_pages[page_index].access_map[check_index2]==1))
-	{
-	  // we found the stride repeated twice, so issue a prefetch
-
-	  unsigned long long int pf_address = (page<<12)+(pf_index<<6);
-
-	  // check the MSHR occupancy to decide if we're going to prefetch to the L2 or LLC
-	  if(get_l2_mshr_occupancy(0) < 12)
-	    {
-	      l2_prefetch_line(0, addr, pf_address, FILL_L2);
-	    }
-	  else
-	    {
-	      l2_prefetch_line(0, addr, pf_address, FILL_LLC);	      
-	    }
-
-	  // mark the prefetched line so we don't prefetch it again
-	  ampm_pages[page_index].pf_map[pf_index] = 1;
-	  count_prefetches++;
-	}
+      // mark the prefetched line so we don't prefetch it again
+      ampm_pages[page_index].pf_map |= 1ULL<<pf_index;
+      count_prefetches++;
     }
 }
 
@@ -234,4 +300,16 @@ void l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, i
 {
   // uncomment this line to see the information available to you when there is a cache fill event
   //printf("0x%llx %d %d %d 0x%llx\n", addr, set, way, prefetch, evicted_addr);
+
+  throttle_cache_fill(addr, set, way, prefetch, evicted_addr);
+}
+
+void l2_prefetcher_checkpoint(int cpu_num, void (*region)(void *data, unsigned long long int size))
+{
+  region(ampm_pages, sizeof(ampm_pages));
+  region(ampm_page_hash, sizeof(ampm_page_hash));
+  region(&ampm_lru_head, sizeof(ampm_lru_head));
+  region(&ampm_lru_tail, sizeof(ampm_lru_tail));
+
+  throttle_checkpoint(region);
 }
@@ -0,0 +1,236 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  This file describes a Best-Offset (BO) prefetcher.  It prefetches one line
+  at a fixed offset D from each L2 miss or prefetched hit, and it learns D at
+  run time.
+
+  Learning is done in rounds.  The recent requests (RR) table holds the base
+  addresses of recently completed prefetches: when a prefetched line Y arrives
+  in the L2, Y-D is recorded.  On every L2 miss or prefetched hit X, one
+  candidate offset d from the offset list is tested, and its score goes up if
+  X-d is in the RR table, meaning a prefetch at offset d from an earlier access
+  would have been filled by now.  Because entries are only recorded when fills
+  arrive, offsets that are too small for the current memory latency do not
+  score, so the prefetcher adapts its timeliness to the latency it observes.
+  Prefetches sent to the LLC when the L2's MSHRs are busy never fill the
+  L2, so their base addresses are recorded as they are issued instead.
+
+  A round ends when some offset reaches SCORE_MAX, or after every offset has
+  been tested ROUND_MAX times.  The best offset then becomes D.  If no offset
+  scored above BAD_SCORE, prefetching is turned off, and demand fills train the
+  RR table instead until a later round finds a good offset again.
+
+  Only positive offsets below 64 lines are used, since prefetches must stay in
+  the same 4 KB page as the triggering access.
+
+ */
+
+#include <stdio.h>
+#include "../inc/prefetcher.h"
+
+#define RR_COUNT 256
+#define SCORE_MAX 31
+#define ROUND_MAX 100
+#define BAD_SCORE 1
+
+// offsets up to 63 whose only prime factors are 2, 3 and 5
+int offset_list[] = {1, 2, 3, 4, 5, 6, 8, 9, 10, 12, 15, 16, 18, 20, 24, 25, 27, 30, 32, 36, 40, 45, 48, 50, 54, 60};
+#define OFFSET_COUNT ((int)(sizeof(offset_list)/sizeof(offset_list[0])))
+
+// recent requests table, direct-mapped by line address
+unsigned long long int rr_table[RR_COUNT];
+
+// learning state for the current round
+int offset_scores[OFFSET_COUNT];
+int test_index;
+int round_count;
+
+// the offset in use, in cache lines, and whether prefetching is on
+int best_offset;
+int prefetch_on;
+
+// shadow of the L2 tags, to tell which hits are on prefetched lines
+unsigned long long int l2_tags[L2_SET_COUNT][L2_ASSOCIATIVITY];
+int l2_prefetched[L2_SET_COUNT][L2_ASSOCIATIVITY];
+
+int rr_index(unsigned long long int cl_address)
+{
+  return (cl_address ^ (cl_address>>8) ^ (cl_address>>16)) & (RR_COUNT-1);
+}
+
+void rr_insert(unsigned long long int cl_address)
+{
+  rr_table[rr_index(cl_address)] = cl_address;
+}
+
+int rr_hit(unsigned long long int cl_address)
+{
+  return rr_table[rr_index(cl_address)] == cl_address;
+}
+
+// starts a new learning round
+void reset_scores()
+{
+  int i;
+  for(i=0; i<OFFSET_COUNT; i++)
+    {
+      offset_scores[i] = 0;
+    }
+  test_index = 0;
+  round_count = 0;
+}
+
+// picks the best offset of the round that just ended
+void end_round()
+{
+  int best_index = 0;
+  int i;
+  for(i=1; i<OFFSET_COUNT; i++)
+    {
+      if(offset_scores[i] > offset_scores[best_index])
+	{
+	  best_index = i;
+	}
+    }
+
+  best_offset = offset_list[best_index];
+  prefetch_on = (offset_scores[best_index] > BAD_SCORE);
+
+  reset_scores();
+}
+
+void l2_prefetcher_initialize(int cpu_num)
+{
+  printf("Best-Offset Prefetcher\n");
+  // you can inspect these knob values from your code to see which configuration you're runnig in
+  printf("Knobs visible from prefetcher: %d %d %d\n", knob_scramble_loads, knob_small_llc, knob_low_bandwidth);
+
+  int i, j;
+  for(i=0; i<RR_COUNT; i++)
+    {
+      rr_table[i] = 0;
+    }
+
+  for(i=0; i<L2_SET_COUNT; i++)
+    {
+      for(j=0; j<L2_ASSOCIATIVITY; j++)
+	{
+	  l2_tags[i][j] = 0;
+	  l2_prefetched[i][j] = 0;
+	}
+    }
+
+  reset_scores();
+
+  // start out as a next-line prefetcher until the first round is over
+  best_offset = 1;
+  prefetch_on = 1;
+}
+
+void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned long long int ip, int cache_hit)
+{
+  // uncomment this line to see all the information available to make prefetch decisions
+  //printf("(%lld 0x%llx 0x%llx %d %d %d) ", get_current_cycle(0), addr, ip, cache_hit, get_l2_read_queue_occupancy(0), get_l2_mshr_occupancy(0));
+
+  unsigned long long int cl_address = addr>>6;
+
+  if(cache_hit)
+    {
+      // only the first hit on a prefetched line counts, other hits are ignored
+      int set = l2_get_set(addr);
+      int prefetched_hit = 0;
+      int way;
+      for(way=0; way<L2_ASSOCIATIVITY; way++)
+	{
+	  if((l2_tags[set][way] == cl_address) && l2_prefetched[set][way])
+	    {
+	      l2_prefetched[set][way] = 0;
+	      prefetched_hit = 1;
+	      break;
+	    }
+	}
+
+      if(!prefetched_hit)
+	{
+	  return;
+	}
+    }
+
+  // test one offset per access
+  if(rr_hit(cl_address - offset_list[test_index]))
+    {
+      offset_scores[test_index]++;
+    }
+
+  int round_over = (offset_scores[test_index] >= SCORE_MAX);
+
+  test_index++;
+  if(test_index == OFFSET_COUNT)
+    {
+      test_index = 0;
+      round_count++;
+      if(round_count == ROUND_MAX)
+	{
+	  round_over = 1;
+	}
+    }
+
+  if(round_over)
+    {
+      end_round();
+    }
+
+  if(!prefetch_on)
+    {
+      return;
+    }
+
+  unsigned long long int pf_address = (cl_address + best_offset)<<6;
+
+  // only issue a prefetch if the prefetch address is in the same 4 KB page
+  // as the current demand access address
+  if((pf_address>>12) != (addr>>12))
+    {
+      return;
+    }
+
+  // check the MSHR occupancy to decide if we're going to prefetch to the L2 or LLC
+  if(get_l2_mshr_occupancy(0) < 8)
+    {
+      l2_prefetch_line(0, addr, pf_address, FILL_L2);
+    }
+  else
+    {
+      // an LLC prefetch never fills the L2, so its base address is recorded when it is issued
+      if(l2_prefetch_line(0, addr, pf_address, FILL_LLC))
+	{
+	  rr_insert(cl_address);
+	}
+    }
+}
+
+void l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, int prefetch, unsigned long long int evicted_addr)
+{
+  // uncomment this line to see the information available to you when there is a cache fill event
+  //printf("0x%llx %d %d %d 0x%llx\n", addr, set, way, prefetch, evicted_addr);
+
+  unsigned long long int cl_address = addr>>6;
+
+  l2_tags[set][way] = cl_address;
+  l2_prefetched[set][way] = prefetch;
+
+  if(prefetch)
+    {
+      // a prefetch issued at offset best_offset has completed, record its base address
+      rr_insert(cl_address - best_offset);
+    }
+  else if(!prefetch_on)
+    {
+      // with prefetching off, demand fills train the RR table directly
+      rr_insert(cl_address);
+    }
+}
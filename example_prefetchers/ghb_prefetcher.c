@@ -0,0 +1,194 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  This file describes a Global History Buffer (GHB) prefetcher using PC/DC,
+  per-PC delta correlation.
+
+  Every L2 access is appended to the global history buffer, a fixed-size ring
+  of cache line addresses.  Each entry links back to the previous entry made
+  by the same IP, and an index table keyed by IP points at the newest entry of
+  each IP.  Following the links gives the recent cache line deltas of one IP.
+
+  The two newest deltas of an IP are looked up further back in that IP's own
+  delta history.  If the same pair is found, the deltas that followed it last
+  time are replayed from the current address to predict the next few
+  addresses.  This catches repeating delta sequences that are not a single
+  constant stride, such as alternating strides when walking fields of
+  linked structures.
+
+  Nothing is allocated per access.  Links are global sequence numbers, so an
+  entry that the ring has already overwritten is recognised as stale rather
+  than followed.
+
+  Prefetches are issued into the L2 or LLC depending on L2 MSHR occupancy.
+
+ */
+
+#include <stdio.h>
+#include "../inc/prefetcher.h"
+
+// must be powers of two
+#define GHB_COUNT 256
+#define INDEX_COUNT 256
+
+// how many deltas of one IP are examined per access
+#define MAX_HISTORY 16
+#define PREFETCH_DEGREE 4
+
+typedef struct ghb_entry
+{
+  // cache line address of the access
+  unsigned long long int cl_address;
+
+  // sequence number of the previous entry made by the same IP, 0 if none
+  unsigned long long int prev;
+} ghb_entry_t;
+
+typedef struct index_entry
+{
+  // the IP this entry belongs to
+  unsigned long long int ip;
+
+  // sequence number of the newest GHB entry made by this IP, 0 if none
+  unsigned long long int head;
+} index_entry_t;
+
+ghb_entry_t ghb[GHB_COUNT];
+index_entry_t index_table[INDEX_COUNT];
+
+// sequence number the next GHB entry will get, starting at 1 so 0 can mean none
+unsigned long long int ghb_next;
+
+// returns 1 if the GHB entry with this sequence number has not been overwritten yet
+int ghb_valid(unsigned long long int seq)
+{
+  return (seq != 0) && (seq + GHB_COUNT >= ghb_next);
+}
+
+void l2_prefetcher_initialize(int cpu_num)
+{
+  printf("GHB PC/DC Prefetcher\n");
+  // you can inspect these knob values from your code to see which configuration you're runnig in
+  printf("Knobs visible from prefetcher: %d %d %d\n", knob_scramble_loads, knob_small_llc, knob_low_bandwidth);
+
+  int i;
+  for(i=0; i<GHB_COUNT; i++)
+    {
+      ghb[i].cl_address = 0;
+      ghb[i].prev = 0;
+    }
+
+  for(i=0; i<INDEX_COUNT; i++)
+    {
+      index_table[i].ip = 0;
+      index_table[i].head = 0;
+    }
+
+  ghb_next = 1;
+}
+
+void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned long long int ip, int cache_hit)
+{
+  // uncomment this line to see all the information available to make prefetch decisions
+  //printf("(%lld 0x%llx 0x%llx %d %d %d) ", get_current_cycle(0), addr, ip, cache_hit, get_l2_read_queue_occupancy(0), get_l2_mshr_occupancy(0));
+
+  unsigned long long int cl_address = addr>>6;
+
+  index_entry_t *index = &index_table[(ip ^ (ip>>8) ^ (ip>>16)) & (INDEX_COUNT-1)];
+  if(index->ip != ip)
+    {
+      // a new IP takes over this index entry, its old history is forgotten
+      index->ip = ip;
+      index->head = 0;
+    }
+
+  if(ghb_valid(index->head) && (ghb[index->head & (GHB_COUNT-1)].cl_address == cl_address))
+    {
+      // the same line again from the same IP adds no delta
+      return;
+    }
+
+  // append this access to the history
+  unsigned long long int seq = ghb_next++;
+  ghb[seq & (GHB_COUNT-1)].cl_address = cl_address;
+  ghb[seq & (GHB_COUNT-1)].prev = ghb_valid(index->head) ? index->head : 0;
+  index->head = seq;
+
+  // walk back through this IP's history, collecting deltas newest first
+  long long int deltas[MAX_HISTORY];
+  int delta_count = 0;
+  unsigned long long int newer = cl_address;
+  unsigned long long int link = ghb[seq & (GHB_COUNT-1)].prev;
+  while((delta_count < MAX_HISTORY) && ghb_valid(link))
+    {
+      unsigned long long int older = ghb[link & (GHB_COUNT-1)].cl_address;
+      deltas[delta_count] = (long long int)(newer - older);
+      delta_count++;
+
+      newer = older;
+      link = ghb[link & (GHB_COUNT-1)].prev;
+    }
+
+  if(delta_count < 3)
+    {
+      return;
+    }
+
+  // look for the newest delta pair earlier in the history
+  int match = -1;
+  int i;
+  for(i=1; i<delta_count-1; i++)
+    {
+      if((deltas[i] == deltas[0]) && (deltas[i+1] == deltas[1]))
+	{
+	  match = i;
+	  break;
+	}
+    }
+
+  if(match == -1)
+    {
+      return;
+    }
+
+  // replay the deltas that followed the match, oldest first, repeating them if needed
+  unsigned long long int pf_line = cl_address;
+  int replay = match-1;
+  for(i=0; i<PREFETCH_DEGREE; i++)
+    {
+      pf_line += deltas[replay];
+      replay--;
+      if(replay < 0)
+	{
+	  replay = match-1;
+	}
+
+      unsigned long long int pf_address = pf_line<<6;
+
+      // only issue a prefetch if the prefetch address is in the same 4 KB page
+      // as the current demand access address
+      if((pf_address>>12) != (addr>>12))
+	{
+	  break;
+	}
+
+      // check the MSHR occupancy to decide if we're going to prefetch to the L2 or LLC
+      if(get_l2_mshr_occupancy(0) < 8)
+	{
+	  l2_prefetch_line(0, addr, pf_address, FILL_L2);
+	}
+      else
+	{
+	  l2_prefetch_line(0, addr, pf_address, FILL_LLC);
+	}
+    }
+}
+
+void l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, int prefetch, unsigned long long int evicted_addr)
+{
+  // uncomment this line to see the information available to you when there is a cache fill event
+  //printf("0x%llx %d %d %d 0x%llx\n", addr, set, way, prefetch, evicted_addr);
+}
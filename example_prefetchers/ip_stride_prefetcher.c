@@ -9,31 +9,50 @@
   The prefetcher detects stride patterns coming from the same IP, and then 
   prefetches additional cache lines.
 
-  Prefetches are issued into the L2 or LLC depending on L2 MSHR occupancy.
+  The prefetch degree, and whether prefetches are issued into the L2 or LLC,
+  are adjusted at run time by the feedback throttle in inc/throttle.h.
 
  */
 
 #include <stdio.h>
 #include "../inc/prefetcher.h"
+#include "../inc/throttle.h"
 
 #define IP_TRACKER_COUNT 1024
+// trackers are grouped into sets indexed by a hash of the IP, and LRU is kept within each set
+// IP_TRACKER_COUNT/IP_TRACKER_WAYS must be a power of two
+// setting IP_TRACKER_WAYS to IP_TRACKER_COUNT gives back a single fully-associative set
+#define IP_TRACKER_WAYS 16
+#define IP_TRACKER_SETS (IP_TRACKER_COUNT/IP_TRACKER_WAYS)
 #define PREFETCH_DEGREE 3
 
-typedef struct ip_tracker
+// The tracker table is laid out as a structure of arrays, so a set lookup
+// only walks the IP tags of that set.  Tracker i of set s lives at index
+// s*IP_TRACKER_WAYS+i in every array.
+typedef struct ip_tracker_table
 {
   // the IP we're tracking
-  unsigned long long int ip;
+  unsigned long long int ip[IP_TRACKER_COUNT];
 
   // the last address accessed by this IP
-  unsigned long long int last_addr;
+  unsigned long long int last_addr[IP_TRACKER_COUNT];
   // the stride between the last two addresses accessed by this IP
-  long long int last_stride;
+  long long int last_stride[IP_TRACKER_COUNT];
 
   // use LRU to evict old IP trackers
-  unsigned long long int lru_cycle;
-} ip_tracker_t;
+  unsigned long long int lru_cycle[IP_TRACKER_COUNT];
+} ip_tracker_table_t;
 
-ip_tracker_t trackers[IP_TRACKER_COUNT];
+ip_tracker_table_t trackers;
+
+// returns the first tracker index of the set this IP maps to
+int ip_tracker_set_base(unsigned long long int ip)
+{
+  // fold the upper IP bits in, since the low bits of nearby instructions vary the most
+  unsigned long long int hash = ip ^ (ip>>13) ^ (ip>>27);
+
+  return (int)(hash & (IP_TRACKER_SETS-1)) * IP_TRACKER_WAYS;
+}
 
 void l2_prefetcher_initialize(int cpu_num)
 {
@@ -41,13 +60,15 @@ void l2_prefetcher_initialize(int cpu_num)
   // you can inspect these knob values from your code to see which configuration you're runnig in
   printf("Knobs visible from prefetcher: %d %d %d\n", knob_scramble_loads, knob_small_llc, knob_low_bandwidth);
 
+  throttle_initialize();
+
   int i;
   for(i=0; i<IP_TRACKER_COUNT; i++)
     {
-      trackers[i].ip = 0;
-      trackers[i].last_addr = 0;
-      trackers[i].last_stride = 0;
-      trackers[i].lru_cycle = 0;
+      trackers.ip[i] = 0;
+      trackers.last_addr[i] = 0;
+      trackers.last_stride[i] = 0;
+      trackers.lru_cycle[i] = 0;
     }
 }
 
@@ -56,15 +77,20 @@ void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned lo
   // uncomment this line to see all the information available to make prefetch decisions
   //printf("(%lld 0x%llx 0x%llx %d %d %d) ", get_current_cycle(0), addr, ip, cache_hit, get_l2_read_queue_occupancy(0), get_l2_mshr_occupancy(0));
 
+  throttle_operate(addr, cache_hit);
+
+  // only the set this IP hashes to needs to be searched
+  int set_base = ip_tracker_set_base(ip);
+
   // check for a tracker hit
   int tracker_index = -1;
 
   int i;
-  for(i=0; i<IP_TRACKER_COUNT; i++)
+  for(i=set_base; i<set_base+IP_TRACKER_WAYS; i++)
     {
-      if(trackers[i].ip == ip)
+      if(trackers.ip[i] == ip)
 	{
-	  trackers[i].lru_cycle = get_current_cycle(0);
+	  trackers.lru_cycle[i] = get_current_cycle(0);
 	  tracker_index = i;
 	  break;
 	}
@@ -73,25 +99,25 @@ void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned lo
   if(tracker_index == -1)
     {
       // this is a new IP that doesn't have a tracker yet, so allocate one
-      int lru_index=0;
-      unsigned long long int lru_cycle = trackers[lru_index].lru_cycle;
+      int lru_index=set_base;
+      unsigned long long int lru_cycle = trackers.lru_cycle[lru_index];
       int i;
-      for(i=0; i<IP_TRACKER_COUNT; i++)
+      for(i=set_base; i<set_base+IP_TRACKER_WAYS; i++)
 	{
-	  if(trackers[i].lru_cycle < lru_cycle)
+	  if(trackers.lru_cycle[i] < lru_cycle)
 	    {
 	      lru_index = i;
-	      lru_cycle = trackers[lru_index].lru_cycle;
+	      lru_cycle = trackers.lru_cycle[lru_index];
 	    }
 	}
 
       tracker_index = lru_index;
 
       // reset the old tracker
-      trackers[tracker_index].ip = ip;
-      trackers[tracker_index].last_addr = addr;
-      trackers[tracker_index].last_stride = 0;
-      trackers[tracker_index].lru_cycle = get_current_cycle(0);
+      trackers.ip[tracker_index] = ip;
+      trackers.last_addr[tracker_index] = addr;
+      trackers.last_stride[tracker_index] = 0;
+      trackers.lru_cycle[tracker_index] = get_current_cycle(0);
 
       return;
     }
@@ -100,13 +126,13 @@ void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned lo
   // this bit appears overly complicated because we're calculating
   // differences between unsigned address variables
   long long int stride = 0;
-  if(addr > trackers[tracker_index].last_addr)
+  if(addr > trackers.last_addr[tracker_index])
     {
-      stride = addr - trackers[tracker_index].last_addr;
+      stride = addr - trackers.last_addr[tracker_index];
     }
   else
     {
-      stride = trackers[tracker_index].last_addr - addr;
+      stride = trackers.last_addr[tracker_index] - addr;
       stride *= -1;
     }
 
@@ -118,11 +144,12 @@ void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned lo
 
   // only do any prefetching if there's a pattern of seeing the same
   // stride more than once
-  if(stride == trackers[tracker_index].last_stride)
+  if(stride == trackers.last_stride[tracker_index])
     {
       // do some prefetching
+      int degree = throttle_degree(PREFETCH_DEGREE);
       int i;
-      for(i=0; i<PREFETCH_DEGREE; i++)
+      for(i=0; i<degree; i++)
 	{
 	  unsigned long long int pf_address = addr + (stride*(i+1));
 
@@ -133,25 +160,25 @@ void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned lo
 	      break;
 	    }
 
-	  // check the MSHR occupancy to decide if we're going to prefetch to the L2 or LLC
-	  if(get_l2_mshr_occupancy(0) < 8)
-	    {
-	      l2_prefetch_line(0, addr, pf_address, FILL_L2);
-	    }
-	  else
-	    {
-	      l2_prefetch_line(0, addr, pf_address, FILL_LLC);
-	    }
-	  
+	  throttle_prefetch_line(addr, pf_address, throttle_fill_level(8));
 	}
     }
 
-  trackers[tracker_index].last_addr = addr;
-  trackers[tracker_index].last_stride = stride;
+  trackers.last_addr[tracker_index] = addr;
+  trackers.last_stride[tracker_index] = stride;
 }
 
 void l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, int prefetch, unsigned long long int evicted_addr)
 {
   // uncomment this line to see the information available to you when there is a cache fill event
   //printf("0x%llx %d %d %d 0x%llx\n", addr, set, way, prefetch, evicted_addr);
+
+  throttle_cache_fill(addr, set, way, prefetch, evicted_addr);
+}
+
+void l2_prefetcher_checkpoint(int cpu_num, void (*region)(void *data, unsigned long long int size))
+{
+  region(&trackers, sizeof(trackers));
+
+  throttle_checkpoint(region);
 }
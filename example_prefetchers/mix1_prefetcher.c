@@ -13,7 +13,9 @@
 
   All prefetchers will insert their prefetchs in their own private sandbox.
   On an access, each sandbox will be checked and if there was a hit the score
-  of that particular prefetcher will be increamented. For the next evaluation
+  of that particular prefetcher will be increamented. A sandbox is a Bloom
+  filter, so inserting and testing cost the same no matter how many
+  prefetches it holds, at the price of a small false positive rate. For the next evaluation
   period we will choose the current best score prefetcher to perform and 
   evaluation continues.
 
@@ -27,6 +29,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include "../inc/prefetcher.h"
 
 //**********************************************************************
@@ -34,9 +37,10 @@
 //**********************************************************************
 // Sandbox
 #define TOTAL_SANDBOX	4
-#define FALSE_POSITIVE 10 			// from 1000-11==1.1%
 #define SANDBOX_PERIOD 256			// Period in L2 Accesses
 #define SANDBOX_SIZE_EACH 256
+#define SANDBOX_BLOOM_BITS 16384		// power of two, about 0.25% false positives at 1025 entries
+#define SANDBOX_BLOOM_HASHES 4
 
 // Next Line
 #define NEXT_PREFETCH_DEGREE 1
@@ -52,7 +56,9 @@
 
 // AMPM
 #define AMPM_PAGE_COUNT 64
+#define AMPM_PAGE_HASH_SIZE (2*AMPM_PAGE_COUNT)	// power of two, larger than AMPM_PAGE_COUNT
 #define AMPM_PREFETCH_DEGREE 2
+#define AMPM_STRIDE_MASK 0x1fffeULL		// bits 1-16, one per stride checked
 
 
 //**********************************************************************
@@ -63,21 +69,39 @@
 typedef struct sandbox
 {
 	// Data
-	// Max prefetch degree to work: 10
-	unsigned long long int data[SANDBOX_SIZE_EACH*10];
+	// Bloom filter over the prefetched addresses
+	unsigned long long int bloom[SANDBOX_BLOOM_BITS/64];
 
 	// Size
+	// number of inserted addresses and bits set in the filter
 	int size;
 	int max_size;
-
-	// False Positive of sandbox
-	int false_positive;
+	int bits_set;
 
 } sandbox_t;
 
+// Bit positions of an address in the Bloom filter, by double hashing
+// of two halves of a 64-bit mix of the cache line address
+unsigned int sandbox_hash (unsigned long long int addr, int i) {
+	unsigned long long int hash = (addr>>6) * 0x9e3779b97f4a7c15ULL;
+	hash ^= hash >> 29;
+	unsigned int h1 = (unsigned int)hash;
+	unsigned int h2 = (unsigned int)(hash >> 32) | 1;
+
+	return (h1 + i*h2) & (SANDBOX_BLOOM_BITS-1);
+}
+
 // Insert a data to sandbox | return 1:success, 0:failure
 int sandbox_insert (sandbox_t *sandbox, unsigned long long int addr) {
-	(*sandbox).data[(*sandbox).size] = addr;
+	int i;
+	for (i=0; i<SANDBOX_BLOOM_HASHES; i++) {
+		unsigned int bit = sandbox_hash(addr, i);
+		unsigned long long int mask = 1ULL << (bit&63);
+		if (!((*sandbox).bloom[bit>>6] & mask)) {
+			(*sandbox).bloom[bit>>6] |= mask;
+			(*sandbox).bits_set++;
+		}
+	}
 
 	int size = ++((*sandbox).size);
 	if (size == (*sandbox).max_size)
@@ -87,31 +111,39 @@ int sandbox_insert (sandbox_t *sandbox, unsigned long long int addr) {
 }
 
 // Test if a data is in sandbox or not | return 1:found, 0:not found
-// Flase positive is also implemented
+// Addresses never inserted are found with probability sandbox_false_positive()
 int sandbox_test (sandbox_t* sandbox, unsigned long long int addr) {
-	int size = (*sandbox).size;
-	int index_data = -1;
-
 	int i;
-	for (i=0; i<size; i++) {
-		if ((*sandbox).data[i] == addr) {
-			index_data = i;
-			break;
-		}
+	for (i=0; i<SANDBOX_BLOOM_HASHES; i++) {
+		unsigned int bit = sandbox_hash(addr, i);
+		if (!((*sandbox).bloom[bit>>6] & (1ULL << (bit&63))))
+			return 0;
 	}
 
-	if (index_data == -1)
-		return 0;
+	return 1;
+}
 
-	if (rand() % 1000 > (*sandbox).false_positive)
-		return 1;
-	else
-		return 0;
+// False positive rate of sandbox_test at the current fill level:
+// the chance that all probed bits are already set
+double sandbox_false_positive (sandbox_t* sandbox) {
+	double fill = (double)(*sandbox).bits_set / SANDBOX_BLOOM_BITS;
+	double rate = 1.0;
+
+	int i;
+	for (i=0; i<SANDBOX_BLOOM_HASHES; i++)
+		rate *= fill;
+
+	return rate;
 }
 
 // Resets a sandbox
 void sandbox_reset (sandbox_t* sandbox) {
+	int i;
+	for (i=0; i<SANDBOX_BLOOM_BITS/64; i++)
+		(*sandbox).bloom[i] = 0;
+
 	(*sandbox).size = 0;
+	(*sandbox).bits_set = 0;
 }
 
 // ---------------------------------------------------------------------
@@ -155,17 +187,21 @@ typedef struct ampm_page
   unsigned long long int page;
 
   // The access map itself.
-  // Each element is set when the corresponding cache line is accessed.
-  // The whole structure is analyzed to make prefetching decisions.
-  // While this is coded as an integer array, it is used conceptually as a single 64-bit vector.
-  int access_map[64];
+  // Bit N is set when cache line N of the page is accessed.
+  // The whole vector is analyzed at once to make prefetching decisions.
+  uint64_t access_map;
 
   // This map represents cache lines in this page that have already been prefetched.
   // We will only prefetch lines that haven't already been either demand accessed or prefetched.
-  int pf_map[64];
+  uint64_t pf_map;
+
+  // set once this entry has been allocated to a page
+  int valid;
 
   // used for page replacement
-  unsigned long long int lru;
+  // neighbours of this page in the LRU list, -1 at either end
+  int lru_newer;
+  int lru_older;
 } ampm_page_t;
 
 //**********************************************************************
@@ -179,6 +215,11 @@ int sandbox_scores[TOTAL_SANDBOX];
 int sandbox_period_count;
 int active_pref_num;
 
+// estimated false positive rates of the sandboxes tested in each period, summed
+double sandbox_false_positive_sum[TOTAL_SANDBOX];
+int sandbox_false_positive_periods;
+const char *sandbox_names[TOTAL_SANDBOX] = { "next_line", "ip_stride", "stream", "ampm" };
+
 int index_max = 0;
 int max_score = 0;
 
@@ -192,6 +233,14 @@ int stream_replacement_index;
 //AMPM
 ampm_page_t ampm_pages[AMPM_PAGE_COUNT];
 
+// Open-addressing hash index from page number to ampm_pages index, using linear probing.
+// Empty slots hold -1. Removal shifts later entries back, so no tombstones are needed.
+int ampm_page_hash[AMPM_PAGE_HASH_SIZE];
+
+// the most and least recently used ampm_pages indices
+int ampm_lru_head;
+int ampm_lru_tail;
+
 //**********************************************************************
 // Instantiates
 //**********************************************************************
@@ -207,6 +256,17 @@ void l2_prefetcher_ampm(unsigned long long int addr, sandbox_t *sandbox, int eva
 // Main Functions
 //**********************************************************************
 
+// The simulator exits without telling the prefetcher, so the average false positive rates are printed on exit
+void sandbox_print_false_positives()
+{
+  int i;
+  printf("Sandbox false positive rates:");
+  for (i=0; i<TOTAL_SANDBOX; i++)
+    printf(" %s %f", sandbox_names[i],
+	   sandbox_false_positive_periods ? sandbox_false_positive_sum[i] / sandbox_false_positive_periods : 0.0);
+  printf("\n");
+}
+
 // This function is called once by the simulator on startup
 void l2_prefetcher_initialize(int cpu_num) 
 {
@@ -214,11 +274,13 @@ void l2_prefetcher_initialize(int cpu_num)
   
   printf("Knobs visible from prefetcher: %d %d %d\n", knob_scramble_loads, knob_small_llc, knob_low_bandwidth);
 
+  atexit(sandbox_print_false_positives);
+
   //** sandboxes
   int i;
   for (i=0; i<TOTAL_SANDBOX; i++) {
-  	sandboxes[i].size = 0;
-  	sandboxes[i].false_positive = FALSE_POSITIVE;
+  	sandbox_reset(&sandboxes[i]);
+  	sandbox_reset(&sandboxes_old[i]);
 
   	sandbox_scores[i] = 0;
   	// Each sandbox for a prefetcher max_size is different
@@ -366,27 +428,16 @@ void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned lo
 
 		//printf("\tactive prefetcher = %d\n", active_pref_num);
 
-		/*
-		for (i=0; i<TOTAL_SANDBOX; i++) {
-			printf("\tData %d\n:",i);
-			int j;
-			for (j=0; j<sandboxes[i].size; j++) 
-				printf("\t %d:",(int)sandboxes[i].data[j]);
-			printf("\n");
-		}		
-		printf("\n");
-		*/
+		// the sandboxes tested this period were filled during the last one
+		if (sandboxes_old[0].max_size) {
+			for (i=0; i<TOTAL_SANDBOX; i++)
+				sandbox_false_positive_sum[i] += sandbox_false_positive(&sandboxes_old[i]);
+			sandbox_false_positive_periods++;
+		}
 
 		// copy sandboxes to sandboxes_old
-		for (i=0; i<TOTAL_SANDBOX; i++) {
-			sandboxes_old[i].size = sandboxes[i].size;
-			sandboxes_old[i].false_positive = sandboxes[i].false_positive;
-			sandboxes_old[i].max_size = sandboxes[i].max_size;
-
-			int j;
-			for (j=0; j<sandboxes_old[i].size; j++) 
-				sandboxes_old[i].data[j] = sandboxes[i].data[j]; 
-		}
+		for (i=0; i<TOTAL_SANDBOX; i++)
+			sandboxes_old[i] = sandboxes[i];
 
 
 		// reset scores & sandbox
@@ -688,19 +739,125 @@ void l2_prefetcher_stream(unsigned long long int addr, sandbox_t *sandbox, int e
   version works only on smaller 4 KB physical pages.
 */
 
+// returns map with its bit order reversed, so bit 0 becomes bit 63
+uint64_t ampm_reverse_map(uint64_t map)
+{
+	map = ((map>>1)&0x5555555555555555ULL) | ((map&0x5555555555555555ULL)<<1);
+	map = ((map>>2)&0x3333333333333333ULL) | ((map&0x3333333333333333ULL)<<2);
+	map = ((map>>4)&0x0f0f0f0f0f0f0f0fULL) | ((map&0x0f0f0f0f0f0f0f0fULL)<<4);
+	return __builtin_bswap64(map);
+}
+
+// packs the even bits of map into the low 32 bits, so bit 2N becomes bit N
+uint64_t ampm_even_bits(uint64_t map)
+{
+	map &= 0x5555555555555555ULL;
+	map = (map | (map>>1)) & 0x3333333333333333ULL;
+	map = (map | (map>>2)) & 0x0f0f0f0f0f0f0f0fULL;
+	map = (map | (map>>4)) & 0x00ff00ff00ff00ffULL;
+	map = (map | (map>>8)) & 0x0000ffff0000ffffULL;
+	map = (map | (map>>16)) & 0x00000000ffffffffULL;
+	return map;
+}
+
+// returns the home slot of a page in the hash index
+int ampm_page_hash_slot(unsigned long long int page) {
+	unsigned long long int hash = page * 0x9e3779b97f4a7c15ULL;
+	return (int)((hash ^ (hash>>32)) & (AMPM_PAGE_HASH_SIZE-1));
+}
+
+// returns the ampm_pages index tracking this page, or -1 if the page is not tracked
+int ampm_page_find(unsigned long long int page) {
+	int slot = ampm_page_hash_slot(page);
+	while (ampm_page_hash[slot] != -1) {
+		if (ampm_pages[ampm_page_hash[slot]].page == page)
+			return ampm_page_hash[slot];
+		slot = (slot+1) & (AMPM_PAGE_HASH_SIZE-1);
+	}
+
+	return -1;
+}
+
+void ampm_page_hash_insert(int page_index) {
+	int slot = ampm_page_hash_slot(ampm_pages[page_index].page);
+	while (ampm_page_hash[slot] != -1)
+		slot = (slot+1) & (AMPM_PAGE_HASH_SIZE-1);
+
+	ampm_page_hash[slot] = page_index;
+}
+
+void ampm_page_hash_remove(int page_index) {
+	int slot = ampm_page_hash_slot(ampm_pages[page_index].page);
+	while (ampm_page_hash[slot] != page_index)
+		slot = (slot+1) & (AMPM_PAGE_HASH_SIZE-1);
+	ampm_page_hash[slot] = -1;
+
+	// close the gap, moving back any later entry of the probe run whose home slot allows it
+	int next = (slot+1) & (AMPM_PAGE_HASH_SIZE-1);
+	while (ampm_page_hash[next] != -1) {
+		int home = ampm_page_hash_slot(ampm_pages[ampm_page_hash[next]].page);
+		if (((next-home) & (AMPM_PAGE_HASH_SIZE-1)) >= ((next-slot) & (AMPM_PAGE_HASH_SIZE-1))) {
+			ampm_page_hash[slot] = ampm_page_hash[next];
+			ampm_page_hash[next] = -1;
+			slot = next;
+		}
+		next = (next+1) & (AMPM_PAGE_HASH_SIZE-1);
+	}
+}
+
+// moves a page to the most recently used end of the LRU list
+void ampm_page_touch(int page_index) {
+	if (ampm_lru_head == page_index)
+		return;
+
+	// unlink it
+	int newer = ampm_pages[page_index].lru_newer;
+	int older = ampm_pages[page_index].lru_older;
+	ampm_pages[newer].lru_older = older;
+	if (older == -1)
+		ampm_lru_tail = newer;
+	else
+		ampm_pages[older].lru_newer = newer;
+
+	// and put it back at the head
+	ampm_pages[page_index].lru_newer = -1;
+	ampm_pages[page_index].lru_older = ampm_lru_head;
+	ampm_pages[ampm_lru_head].lru_newer = page_index;
+	ampm_lru_head = page_index;
+}
+
+// replaces the least recently used page with this page, and returns its index
+int ampm_page_allocate(unsigned long long int page) {
+	int page_index = ampm_lru_tail;
+
+	if (ampm_pages[page_index].valid)
+		ampm_page_hash_remove(page_index);
+
+	ampm_pages[page_index].page = page;
+	ampm_pages[page_index].valid = 1;
+	ampm_pages[page_index].access_map = 0;
+	ampm_pages[page_index].pf_map = 0;
+	ampm_page_hash_insert(page_index);
+
+	return page_index;
+}
+
 void l2_prefetcher_initialize_ampm()
 {
   int i;
   for(i=0; i<AMPM_PAGE_COUNT; i++) {
     ampm_pages[i].page = 0;
-    ampm_pages[i].lru = 0;
-
-    int j;
-    for(j=0; j<64; j++) {
-		  ampm_pages[i].access_map[j] = 0;
-		  ampm_pages[i].pf_map[j] = 0;
-		}
+    ampm_pages[i].valid = 0;
+    ampm_pages[i].access_map = 0;
+    ampm_pages[i].pf_map = 0;
+    ampm_pages[i].lru_newer = (i == AMPM_PAGE_COUNT-1) ? -1 : i+1;
+    ampm_pages[i].lru_older = i-1;
   }
+  ampm_lru_head = AMPM_PAGE_COUNT-1;
+  ampm_lru_tail = 0;
+
+  for(i=0; i<AMPM_PAGE_HASH_SIZE; i++)
+    ampm_page_hash[i] = -1;
 }
 
 /*
@@ -714,131 +871,85 @@ void l2_prefetcher_ampm(unsigned long long int addr, sandbox_t *sandbox, int eva
 
   //** Serching for the Page
   // check to see if we have a page hit
-  int page_index = -1;
-  int i;
-  for(i=0; i<AMPM_PAGE_COUNT; i++) {
-    if(ampm_pages[i].page == page) {
-		  page_index = i;
-  		break;
-  	}
-	}
+  int page_index = ampm_page_find(page);
 
-	// the page was not found, so we must replace an old page with this new page
-  if(page_index == -1) {
-    // find the oldest page
-    int lru_index = 0;
-    unsigned long long int lru_cycle = ampm_pages[lru_index].lru;
-    int i;
-    for(i=0; i<AMPM_PAGE_COUNT; i++) {
-	  	if(ampm_pages[i].lru < lru_cycle) {
-	      lru_index = i;
-	      lru_cycle = ampm_pages[lru_index].lru;
-	    }
-		}
-		page_index = lru_index;
-
-    // reset the oldest page
-    ampm_pages[page_index].page = page;
-    for(i=0; i<64; i++) {
-		  ampm_pages[page_index].access_map[i] = 0;
-		  ampm_pages[page_index].pf_map[i] = 0;
-		}
-	}
+	// the page was not found, so we must replace the oldest page with this new page
+  if(page_index == -1)
+    page_index = ampm_page_allocate(page);
 
   // update LRU
-  ampm_pages[page_index].lru = get_current_cycle(0);
+  ampm_page_touch(page_index);
 
   // mark the access map
-  ampm_pages[page_index].access_map[page_offset] = 1;
+  ampm_pages[page_index].access_map |= 1ULL<<page_offset;
 
   //** Prefetching
-  // positive prefetching
-  int count_prefetches = 0;
-  for(i=1; i<=16; i++) {
-	  int check_index1 = page_offset - i;
-	  int check_index2 = page_offset - 2*i;
-	  int pf_index = page_offset + i;
-		
-		if(check_index2 < 0)
-	 		break;
-
-    if(pf_index > 63)
-	  	break;
+  // Bit i of each vector below describes the line i away from page_offset,
+  // so all 16 strides are matched at once. Lines off the page shift in as zeros.
+  uint64_t access_map = ampm_pages[page_index].access_map;
+  uint64_t free_map = ~(access_map | ampm_pages[page_index].pf_map);
 
-		if(count_prefetches >= AMPM_PREFETCH_DEGREE)
-	  	break;
-
-    if(ampm_pages[page_index].access_map[pf_index] == 1)
-	  	continue;
+  // positive prefetching
+  // lines page_offset-i and page_offset-2*i accessed, line page_offset+i not accessed or prefetched
+  uint64_t behind = ampm_reverse_map(access_map) >> (63-page_offset);
+  uint64_t candidates = behind & ampm_even_bits(behind) & (free_map >> page_offset) & AMPM_STRIDE_MASK;
 
-    if(ampm_pages[page_index].pf_map[pf_index] == 1)
-	  	continue;
+  // smallest strides first, up to the prefetch degree
+  int count_prefetches = 0;
+  while(candidates != 0 && count_prefetches < AMPM_PREFETCH_DEGREE) {
+	  int pf_index = page_offset + __builtin_ctzll(candidates);
+	  candidates &= candidates-1;
 
-		if((ampm_pages[page_index].access_map[check_index1]==1) && (ampm_pages[page_index].access_map[check_index2]==1)) {
-		  // we found the stride repeated twice, so issue a prefetch
-		  unsigned long long int pf_address = (page<<12)+(pf_index<<6);
+	  // we found the stride repeated twice, so issue a prefetch
+	  unsigned long long int pf_address = (page<<12)+(pf_index<<6);
 
-		  //if (evaluation)
-				if (!sandbox_insert (sandbox, pf_address)) {
-							printf("Error AMPM Insert - Sandbox Full\n");
-							exit(1);
-				}
-
-			if (!evaluation) {
-			  if(get_l2_mshr_occupancy(0) < 8)
-			  	l2_prefetch_line(0, addr, pf_address, FILL_L2);
-			  else
-					l2_prefetch_line(0, addr, pf_address, FILL_LLC);	     
-			} 
+	  //if (evaluation)
+			if (!sandbox_insert (sandbox, pf_address)) {
+						printf("Error AMPM Insert - Sandbox Full\n");
+						exit(1);
+			}
 
-		  // mark the prefetched line so we don't prefetch it again
-		  ampm_pages[page_index].pf_map[pf_index] = 1;
-		  count_prefetches++;
+		if (!evaluation) {
+		  if(get_l2_mshr_occupancy(0) < 8)
+		  	l2_prefetch_line(0, addr, pf_address, FILL_L2);
+		  else
+				l2_prefetch_line(0, addr, pf_address, FILL_LLC);
 		}
+
+	  // mark the prefetched line so we don't prefetch it again
+	  ampm_pages[page_index].pf_map |= 1ULL<<pf_index;
+	  count_prefetches++;
 	}
 
   // negative prefetching
-  count_prefetches = 0;
-  for(i=1; i<=16; i++) {
-		int check_index1 = page_offset + i;
-		int check_index2 = page_offset + 2*i;
-		int pf_index = page_offset - i;
+  // the mirror image: lines page_offset+i and page_offset+2*i accessed, line page_offset-i free
+  free_map = ~(access_map | ampm_pages[page_index].pf_map);
+  uint64_t ahead = access_map >> page_offset;
+  candidates = ahead & ampm_even_bits(ahead) & (ampm_reverse_map(free_map) >> (63-page_offset)) & AMPM_STRIDE_MASK;
 
-		if(check_index2 > 63)
-	  	break;
-
-    if(pf_index < 0)
-	  	break;
-
-    if(count_prefetches >= AMPM_PREFETCH_DEGREE)
-	  	break;
-
-    if(ampm_pages[page_index].access_map[pf_index] == 1)
-	  	continue;
-
-    if(ampm_pages[page_index].pf_map[pf_index] == 1)
-	  	continue;
+  count_prefetches = 0;
+  while(candidates != 0 && count_prefetches < AMPM_PREFETCH_DEGREE) {
+  	int pf_index = page_offset - __builtin_ctzll(candidates);
+  	candidates &= candidates-1;
 
-    if((ampm_pages[page_index].access_map[check_index1]==1) && (ampm_pages[page_index].access_map[check_index2]==1)) {
-	  	unsigned long long int pf_address = (page<<12)+(pf_index<<6);
+  	unsigned long long int pf_address = (page<<12)+(pf_index<<6);
 
-	  	//if (evaluation)
-				if (!sandbox_insert (sandbox, pf_address)) {
-					printf("Error AMPM Insert - Sandbox Full\n");
-					exit(1);
-				}
-
-		  if (!evaluation) {
-			  if(get_l2_mshr_occupancy(0) < 12)
-					l2_prefetch_line(0, addr, pf_address, FILL_L2);
-			  else
-					l2_prefetch_line(0, addr, pf_address, FILL_LLC);
+  	//if (evaluation)
+			if (!sandbox_insert (sandbox, pf_address)) {
+				printf("Error AMPM Insert - Sandbox Full\n");
+				exit(1);
 			}
 
-		  // mark the prefetched line so we don't prefetch it again
-		  ampm_pages[page_index].pf_map[pf_index] = 1;
-		  count_prefetches++;
+	  if (!evaluation) {
+		  if(get_l2_mshr_occupancy(0) < 12)
+				l2_prefetch_line(0, addr, pf_address, FILL_L2);
+		  else
+				l2_prefetch_line(0, addr, pf_address, FILL_LLC);
 		}
+
+	  // mark the prefetched line so we don't prefetch it again
+	  ampm_pages[page_index].pf_map |= 1ULL<<pf_index;
+	  count_prefetches++;
 	}
 
-}
\ No newline at end of file
+}
@@ -27,6 +27,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include "../inc/prefetcher.h"
 
 //**********************************************************************
@@ -52,7 +53,9 @@
 
 // AMPM
 #define AMPM_PAGE_COUNT 64
+#define AMPM_PAGE_HASH_SIZE (2*AMPM_PAGE_COUNT)	// power of two, larger than AMPM_PAGE_COUNT
 #define AMPM_PREFETCH_DEGREE 2
+#define AMPM_STRIDE_MASK 0x1fffeULL		// bits 1-16, one per stride checked
 
 
 //**********************************************************************
@@ -155,17 +158,21 @@ typedef struct ampm_page
   unsigned long long int page;
 
   // The access map itself.
-  // Each element is set when the corresponding cache line is accessed.
-  // The whole structure is analyzed to make prefetching decisions.
-  // While this is coded as an integer array, it is used conceptually as a single 64-bit vector.
-  int access_map[64];
+  // Bit N is set when cache line N of the page is accessed.
+  // The whole vector is analyzed at once to make prefetching decisions.
+  uint64_t access_map;
 
   // This map represents cache lines in this page that have already been prefetched.
   // We will only prefetch lines that haven't already been either demand accessed or prefetched.
-  int pf_map[64];
+  uint64_t pf_map;
+
+  // set once this entry has been allocated to a page
+  int valid;
 
   // used for page replacement
-  unsigned long long int lru;
+  // neighbours of this page in the LRU list, -1 at either end
+  int lru_newer;
+  int lru_older;
 } ampm_page_t;
 
 //**********************************************************************
@@ -192,6 +199,14 @@ int stream_replacement_index;
 //AMPM
 ampm_page_t ampm_pages[AMPM_PAGE_COUNT];
 
+// Open-addressing hash index from page number to ampm_pages index, using linear probing.
+// Empty slots hold -1. Removal shifts later entries back, so no tombstones are needed.
+int ampm_page_hash[AMPM_PAGE_HASH_SIZE];
+
+// the most and least recently used ampm_pages indices
+int ampm_lru_head;
+int ampm_lru_tail;
+
 //**********************************************************************
 // Instantiates
 //**********************************************************************
@@ -565,19 +580,125 @@ void l2_prefetcher_stream(unsigned long long int addr, sandbox_t *sandbox, int e
   version works only on smaller 4 KB physical pages.
 */
 
+// returns map with its bit order reversed, so bit 0 becomes bit 63
+uint64_t ampm_reverse_map(uint64_t map)
+{
+	map = ((map>>1)&0x5555555555555555ULL) | ((map&0x5555555555555555ULL)<<1);
+	map = ((map>>2)&0x3333333333333333ULL) | ((map&0x3333333333333333ULL)<<2);
+	map = ((map>>4)&0x0f0f0f0f0f0f0f0fULL) | ((map&0x0f0f0f0f0f0f0f0fULL)<<4);
+	return __builtin_bswap64(map);
+}
+
+// packs the even bits of map into the low 32 bits, so bit 2N becomes bit N
+uint64_t ampm_even_bits(uint64_t map)
+{
+	map &= 0x5555555555555555ULL;
+	map = (map | (map>>1)) & 0x3333333333333333ULL;
+	map = (map | (map>>2)) & 0x0f0f0f0f0f0f0f0fULL;
+	map = (map | (map>>4)) & 0x00ff00ff00ff00ffULL;
+	map = (map | (map>>8)) & 0x0000ffff0000ffffULL;
+	map = (map | (map>>16)) & 0x00000000ffffffffULL;
+	return map;
+}
+
+// returns the home slot of a page in the hash index
+int ampm_page_hash_slot(unsigned long long int page) {
+	unsigned long long int hash = page * 0x9e3779b97f4a7c15ULL;
+	return (int)((hash ^ (hash>>32)) & (AMPM_PAGE_HASH_SIZE-1));
+}
+
+// returns the ampm_pages index tracking this page, or -1 if the page is not tracked
+int ampm_page_find(unsigned long long int page) {
+	int slot = ampm_page_hash_slot(page);
+	while (ampm_page_hash[slot] != -1) {
+		if (ampm_pages[ampm_page_hash[slot]].page == page)
+			return ampm_page_hash[slot];
+		slot = (slot+1) & (AMPM_PAGE_HASH_SIZE-1);
+	}
+
+	return -1;
+}
+
+void ampm_page_hash_insert(int page_index) {
+	int slot = ampm_page_hash_slot(ampm_pages[page_index].page);
+	while (ampm_page_hash[slot] != -1)
+		slot = (slot+1) & (AMPM_PAGE_HASH_SIZE-1);
+
+	ampm_page_hash[slot] = page_index;
+}
+
+void ampm_page_hash_remove(int page_index) {
+	int slot = ampm_page_hash_slot(ampm_pages[page_index].page);
+	while (ampm_page_hash[slot] != page_index)
+		slot = (slot+1) & (AMPM_PAGE_HASH_SIZE-1);
+	ampm_page_hash[slot] = -1;
+
+	// close the gap, moving back any later entry of the probe run whose home slot allows it
+	int next = (slot+1) & (AMPM_PAGE_HASH_SIZE-1);
+	while (ampm_page_hash[next] != -1) {
+		int home = ampm_page_hash_slot(ampm_pages[ampm_page_hash[next]].page);
+		if (((next-home) & (AMPM_PAGE_HASH_SIZE-1)) >= ((next-slot) & (AMPM_PAGE_HASH_SIZE-1))) {
+			ampm_page_hash[slot] = ampm_page_hash[next];
+			ampm_page_hash[next] = -1;
+			slot = next;
+		}
+		next = (next+1) & (AMPM_PAGE_HASH_SIZE-1);
+	}
+}
+
+// moves a page to the most recently used end of the LRU list
+void ampm_page_touch(int page_index) {
+	if (ampm_lru_head == page_index)
+		return;
+
+	// unlink it
+	int newer = ampm_pages[page_index].lru_newer;
+	int older = ampm_pages[page_index].lru_older;
+	ampm_pages[newer].lru_older = older;
+	if (older == -1)
+		ampm_lru_tail = newer;
+	else
+		ampm_pages[older].lru_newer = newer;
+
+	// and put it back at the head
+	ampm_pages[page_index].lru_newer = -1;
+	ampm_pages[page_index].lru_older = ampm_lru_head;
+	ampm_pages[ampm_lru_head].lru_newer = page_index;
+	ampm_lru_head = page_index;
+}
+
+// replaces the least recently used page with this page, and returns its index
+int ampm_page_allocate(unsigned long long int page) {
+	int page_index = ampm_lru_tail;
+
+	if (ampm_pages[page_index].valid)
+		ampm_page_hash_remove(page_index);
+
+	ampm_pages[page_index].page = page;
+	ampm_pages[page_index].valid = 1;
+	ampm_pages[page_index].access_map = 0;
+	ampm_pages[page_index].pf_map = 0;
+	ampm_page_hash_insert(page_index);
+
+	return page_index;
+}
+
 void l2_prefetcher_initialize_ampm()
 {
   int i;
   for(i=0; i<AMPM_PAGE_COUNT; i++) {
     ampm_pages[i].page = 0;
-    ampm_pages[i].lru = 0;
-
-    int j;
-    for(j=0; j<64; j++) {
-		  ampm_pages[i].access_map[j] = 0;
-		  ampm_pages[i].pf_map[j] = 0;
-		}
+    ampm_pages[i].valid = 0;
+    ampm_pages[i].access_map = 0;
+    ampm_pages[i].pf_map = 0;
+    ampm_pages[i].lru_newer = (i == AMPM_PAGE_COUNT-1) ? -1 : i+1;
+    ampm_pages[i].lru_older = i-1;
   }
+  ampm_lru_head = AMPM_PAGE_COUNT-1;
+  ampm_lru_tail = 0;
+
+  for(i=0; i<AMPM_PAGE_HASH_SIZE; i++)
+    ampm_page_hash[i] = -1;
 }
 
 /*
@@ -591,131 +712,85 @@ void l2_prefetcher_ampm(unsigned long long int addr, sandbox_t *sandbox, int eva
 
   //** Serching for the Page
   // check to see if we have a page hit
-  int page_index = -1;
-  int i;
-  for(i=0; i<AMPM_PAGE_COUNT; i++) {
-    if(ampm_pages[i].page == page) {
-		  page_index = i;
-  		break;
-  	}
-	}
-
-	// the page was not found, so we must replace an old page with this new page
-  if(page_index == -1) {
-    // find the oldest page
-    int lru_index = 0;
-    unsigned long long int lru_cycle = ampm_pages[lru_index].lru;
-    int i;
-    for(i=0; i<AMPM_PAGE_COUNT; i++) {
-	  	if(ampm_pages[i].lru < lru_cycle) {
-	      lru_index = i;
-	      lru_cycle = ampm_pages[lru_index].lru;
-	    }
-		}
-		page_index = lru_index;
+  int page_index = ampm_page_find(page);
 
-    // reset the oldest page
-    ampm_pages[page_index].page = page;
-    for(i=0; i<64; i++) {
-		  ampm_pages[page_index].access_map[i] = 0;
-		  ampm_pages[page_index].pf_map[i] = 0;
-		}
-	}
+	// the page was not found, so we must replace the oldest page with this new page
+  if(page_index == -1)
+    page_index = ampm_page_allocate(page);
 
   // update LRU
-  ampm_pages[page_index].lru = get_current_cycle(0);
+  ampm_page_touch(page_index);
 
   // mark the access map
-  ampm_pages[page_index].access_map[page_offset] = 1;
+  ampm_pages[page_index].access_map |= 1ULL<<page_offset;
 
   //** Prefetching
-  // positive prefetching
-  int count_prefetches = 0;
-  for(i=1; i<=16; i++) {
-	  int check_index1 = page_offset - i;
-	  int check_index2 = page_offset - 2*i;
-	  int pf_index = page_offset + i;
-		
-		if(check_index2 < 0)
-	 		break;
+  // Bit i of each vector below describes the line i away from page_offset,
+  // so all 16 strides are matched at once. Lines off the page shift in as zeros.
+  uint64_t access_map = ampm_pages[page_index].access_map;
+  uint64_t free_map = ~(access_map | ampm_pages[page_index].pf_map);
 
-    if(pf_index > 63)
-	  	break;
-
-		if(count_prefetches >= AMPM_PREFETCH_DEGREE)
-	  	break;
-
-    if(ampm_pages[page_index].access_map[pf_index] == 1)
-	  	continue;
+  // positive prefetching
+  // lines page_offset-i and page_offset-2*i accessed, line page_offset+i not accessed or prefetched
+  uint64_t behind = ampm_reverse_map(access_map) >> (63-page_offset);
+  uint64_t candidates = behind & ampm_even_bits(behind) & (free_map >> page_offset) & AMPM_STRIDE_MASK;
 
-    if(ampm_pages[page_index].pf_map[pf_index] == 1)
-	  	continue;
+  // smallest strides first, up to the prefetch degree
+  int count_prefetches = 0;
+  while(candidates != 0 && count_prefetches < AMPM_PREFETCH_DEGREE) {
+	  int pf_index = page_offset + __builtin_ctzll(candidates);
+	  candidates &= candidates-1;
 
-		if((ampm_pages[page_index].access_map[check_index1]==1) && (ampm_pages[page_index].access_map[check_index2]==1)) {
-		  // we found the stride repeated twice, so issue a prefetch
-		  unsigned long long int pf_address = (page<<12)+(pf_index<<6);
+	  // we found the stride repeated twice, so issue a prefetch
+	  unsigned long long int pf_address = (page<<12)+(pf_index<<6);
 
-		  //if (evaluation)
-				if (!sandbox_insert (sandbox, pf_address)) {
-							printf("Error AMPM Insert - Sandbox Full\n");
-							exit(1);
-				}
-
-			if (!evaluation) {
-			  if(get_l2_mshr_occupancy(0) < 8)
-			  	l2_prefetch_line(0, addr, pf_address, FILL_L2);
-			  else
-					l2_prefetch_line(0, addr, pf_address, FILL_LLC);	     
-			} 
+	  //if (evaluation)
+			if (!sandbox_insert (sandbox, pf_address)) {
+						printf("Error AMPM Insert - Sandbox Full\n");
+						exit(1);
+			}
 
-		  // mark the prefetched line so we don't prefetch it again
-		  ampm_pages[page_index].pf_map[pf_index] = 1;
-		  count_prefetches++;
+		if (!evaluation) {
+		  if(get_l2_mshr_occupancy(0) < 8)
+		  	l2_prefetch_line(0, addr, pf_address, FILL_L2);
+		  else
+				l2_prefetch_line(0, addr, pf_address, FILL_LLC);
 		}
+
+	  // mark the prefetched line so we don't prefetch it again
+	  ampm_pages[page_index].pf_map |= 1ULL<<pf_index;
+	  count_prefetches++;
 	}
 
   // negative prefetching
-  count_prefetches = 0;
-  for(i=1; i<=16; i++) {
-		int check_index1 = page_offset + i;
-		int check_index2 = page_offset + 2*i;
-		int pf_index = page_offset - i;
-
-		if(check_index2 > 63)
-	  	break;
-
-    if(pf_index < 0)
-	  	break;
-
-    if(count_prefetches >= AMPM_PREFETCH_DEGREE)
-	  	break;
-
-    if(ampm_pages[page_index].access_map[pf_index] == 1)
-	  	continue;
+  // the mirror image: lines page_offset+i and page_offset+2*i accessed, line page_offset-i free
+  free_map = ~(access_map | ampm_pages[page_index].pf_map);
+  uint64_t ahead = access_map >> page_offset;
+  candidates = ahead & ampm_even_bits(ahead) & (ampm_reverse_map(free_map) >> (63-page_offset)) & AMPM_STRIDE_MASK;
 
-    if(ampm_pages[page_index].pf_map[pf_index] == 1)
-	  	continue;
+  count_prefetches = 0;
+  while(candidates != 0 && count_prefetches < AMPM_PREFETCH_DEGREE) {
+  	int pf_index = page_offset - __builtin_ctzll(candidates);
+  	candidates &= candidates-1;
 
-    if((ampm_pages[page_index].access_map[check_index1]==1) && (ampm_pages[page_index].access_map[check_index2]==1)) {
-	  	unsigned long long int pf_address = (page<<12)+(pf_index<<6);
+  	unsigned long long int pf_address = (page<<12)+(pf_index<<6);
 
-	  	//if (evaluation)
-				if (!sandbox_insert (sandbox, pf_address)) {
-					printf("Error AMPM Insert - Sandbox Full\n");
-					exit(1);
-				}
-
-		  if (!evaluation) {
-			  if(get_l2_mshr_occupancy(0) < 12)
-					l2_prefetch_line(0, addr, pf_address, FILL_L2);
-			  else
-					l2_prefetch_line(0, addr, pf_address, FILL_LLC);
+  	//if (evaluation)
+			if (!sandbox_insert (sandbox, pf_address)) {
+				printf("Error AMPM Insert - Sandbox Full\n");
+				exit(1);
 			}
 
-		  // mark the prefetched line so we don't prefetch it again
-		  ampm_pages[page_index].pf_map[pf_index] = 1;
-		  count_prefetches++;
+	  if (!evaluation) {
+		  if(get_l2_mshr_occupancy(0) < 12)
+				l2_prefetch_line(0, addr, pf_address, FILL_L2);
+		  else
+				l2_prefetch_line(0, addr, pf_address, FILL_LLC);
 		}
+
+	  // mark the prefetched line so we don't prefetch it again
+	  ampm_pages[page_index].pf_map |= 1ULL<<pf_index;
+	  count_prefetches++;
 	}
 
-}
\ No newline at end of file
+}
@@ -44,3 +44,8 @@ void l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, i
   // uncomment this line to see the information available to you when there is a cache fill event
   //printf("0x%llx %d %d %d 0x%llx\n", addr, set, way, prefetch, evicted_addr);
 }
+
+void l2_prefetcher_checkpoint(int cpu_num, void (*region)(void *data, unsigned long long int size))
+{
+  // this prefetcher has no state
+}
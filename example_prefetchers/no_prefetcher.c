@@ -28,3 +28,8 @@ void l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, i
 {
   
 }
+
+void l2_prefetcher_checkpoint(int cpu_num, void (*region)(void *data, unsigned long long int size))
+{
+  
+}
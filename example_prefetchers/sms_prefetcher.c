@@ -0,0 +1,271 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  This file describes a Spatial Memory Streaming (SMS) prefetcher, working on
+  4 KB pages as its spatial regions.
+
+  The first access to a page starts a generation.  The IP and page offset of
+  that trigger access are recorded, and every later access to the page sets a
+  bit in the page's footprint.  The generation ends when the L2 evicts any line
+  of the page (seen through the evicted_addr of l2_cache_fill), or when the
+  page is pushed out of the active generation table.  Its footprint is then
+  stored in the pattern history table, keyed by the trigger IP and offset.
+
+  When a later generation starts with the same IP and offset, the stored
+  footprint is prefetched all at once, instead of waiting for a stride or
+  stream to be detected access by access.  This covers footprints that are
+  irregular but repeat from page to page.
+
+  Prefetches are issued into the L2 or LLC depending on L2 MSHR occupancy.
+
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "../inc/prefetcher.h"
+
+// active generation table, tracking pages whose generation is in progress
+#define AGT_SET_COUNT 16
+#define AGT_WAYS 4
+
+// pattern history table, keyed by trigger IP and offset, set count must be a power of two
+#define PHT_SET_COUNT 256
+#define PHT_WAYS 4
+
+typedef struct active_generation
+{
+  int valid;
+
+  // which 4 KB page this generation covers
+  unsigned long long int page;
+
+  // the access that started the generation
+  unsigned long long int trigger_ip;
+  int trigger_offset;
+
+  // bit N is set when cache line N of the page has been accessed
+  uint64_t footprint;
+
+  // use LRU to end old generations
+  unsigned long long int lru_cycle;
+} active_generation_t;
+
+typedef struct pattern_entry
+{
+  int valid;
+
+  // trigger IP and offset this footprint was recorded for
+  unsigned long long int trigger_ip;
+  int trigger_offset;
+
+  uint64_t footprint;
+
+  // use LRU to evict old patterns
+  unsigned long long int lru_cycle;
+} pattern_entry_t;
+
+active_generation_t agt[AGT_SET_COUNT][AGT_WAYS];
+pattern_entry_t pht[PHT_SET_COUNT][PHT_WAYS];
+
+pattern_entry_t *pht_set(unsigned long long int ip, int offset)
+{
+  unsigned long long int hash = (ip ^ (ip>>9) ^ (ip>>18)) + offset*0x9e37ULL;
+
+  return pht[hash & (PHT_SET_COUNT-1)];
+}
+
+pattern_entry_t *pht_find(unsigned long long int ip, int offset)
+{
+  pattern_entry_t *set = pht_set(ip, offset);
+
+  int i;
+  for(i=0; i<PHT_WAYS; i++)
+    {
+      if(set[i].valid && (set[i].trigger_ip == ip) && (set[i].trigger_offset == offset))
+	{
+	  return &set[i];
+	}
+    }
+
+  return NULL;
+}
+
+// stores the footprint of a generation that has ended
+void end_generation(active_generation_t *generation)
+{
+  // a lone trigger access is not worth remembering
+  if((generation->footprint & (generation->footprint-1)) != 0)
+    {
+      pattern_entry_t *entry = pht_find(generation->trigger_ip, generation->trigger_offset);
+      if(entry == NULL)
+	{
+	  // replace the least recently used pattern in the set
+	  pattern_entry_t *set = pht_set(generation->trigger_ip, generation->trigger_offset);
+	  entry = &set[0];
+	  int i;
+	  for(i=1; i<PHT_WAYS; i++)
+	    {
+	      if(!set[i].valid)
+		{
+		  entry = &set[i];
+		  break;
+		}
+	      if(set[i].lru_cycle < entry->lru_cycle)
+		{
+		  entry = &set[i];
+		}
+	    }
+
+	  entry->valid = 1;
+	  entry->trigger_ip = generation->trigger_ip;
+	  entry->trigger_offset = generation->trigger_offset;
+	}
+
+      entry->footprint = generation->footprint;
+      entry->lru_cycle = get_current_cycle(0);
+    }
+
+  generation->valid = 0;
+}
+
+void l2_prefetcher_initialize(int cpu_num)
+{
+  printf("Spatial Memory Streaming Prefetcher\n");
+  // you can inspect these knob values from your code to see which configuration you're runnig in
+  printf("Knobs visible from prefetcher: %d %d %d\n", knob_scramble_loads, knob_small_llc, knob_low_bandwidth);
+
+  int i, j;
+  for(i=0; i<AGT_SET_COUNT; i++)
+    {
+      for(j=0; j<AGT_WAYS; j++)
+	{
+	  agt[i][j].valid = 0;
+	  agt[i][j].page = 0;
+	  agt[i][j].trigger_ip = 0;
+	  agt[i][j].trigger_offset = 0;
+	  agt[i][j].footprint = 0;
+	  agt[i][j].lru_cycle = 0;
+	}
+    }
+
+  for(i=0; i<PHT_SET_COUNT; i++)
+    {
+      for(j=0; j<PHT_WAYS; j++)
+	{
+	  pht[i][j].valid = 0;
+	  pht[i][j].trigger_ip = 0;
+	  pht[i][j].trigger_offset = 0;
+	  pht[i][j].footprint = 0;
+	  pht[i][j].lru_cycle = 0;
+	}
+    }
+}
+
+void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned long long int ip, int cache_hit)
+{
+  // uncomment this line to see all the information available to make prefetch decisions
+  //printf("(%lld 0x%llx 0x%llx %d %d %d) ", get_current_cycle(0), addr, ip, cache_hit, get_l2_read_queue_occupancy(0), get_l2_mshr_occupancy(0));
+
+  unsigned long long int cl_address = addr>>6;
+  unsigned long long int page = cl_address>>6;
+  int page_offset = cl_address&63;
+
+  // check for a generation in progress on this page
+  active_generation_t *set = agt[page % AGT_SET_COUNT];
+  int i;
+  for(i=0; i<AGT_WAYS; i++)
+    {
+      if(set[i].valid && (set[i].page == page))
+	{
+	  set[i].footprint |= 1ULL<<page_offset;
+	  set[i].lru_cycle = get_current_cycle(0);
+	  return;
+	}
+    }
+
+  // this is a trigger access, so start a new generation in place of the least recently used one
+  active_generation_t *generation = &set[0];
+  for(i=1; i<AGT_WAYS; i++)
+    {
+      if(!generation->valid)
+	{
+	  break;
+	}
+      if(!set[i].valid || (set[i].lru_cycle < generation->lru_cycle))
+	{
+	  generation = &set[i];
+	}
+    }
+
+  if(generation->valid)
+    {
+      end_generation(generation);
+    }
+
+  generation->valid = 1;
+  generation->page = page;
+  generation->trigger_ip = ip;
+  generation->trigger_offset = page_offset;
+  generation->footprint = 1ULL<<page_offset;
+  generation->lru_cycle = get_current_cycle(0);
+
+  // prefetch the footprint last seen from this trigger
+  pattern_entry_t *pattern = pht_find(ip, page_offset);
+  if(pattern == NULL)
+    {
+      return;
+    }
+  pattern->lru_cycle = get_current_cycle(0);
+
+  uint64_t pf_map = pattern->footprint & ~(1ULL<<page_offset);
+  while(pf_map != 0)
+    {
+      // the read queue is full, so the rest of the footprint would be dropped anyway
+      if(get_l2_read_queue_occupancy(0) >= L2_READ_QUEUE_SIZE)
+	{
+	  break;
+	}
+
+      int pf_index = __builtin_ctzll(pf_map);
+      pf_map &= pf_map-1;
+
+      unsigned long long int pf_address = (page<<12)+(pf_index<<6);
+
+      // check the MSHR occupancy to decide if we're going to prefetch to the L2 or LLC
+      if(get_l2_mshr_occupancy(0) < 8)
+	{
+	  l2_prefetch_line(0, addr, pf_address, FILL_L2);
+	}
+      else
+	{
+	  l2_prefetch_line(0, addr, pf_address, FILL_LLC);
+	}
+    }
+}
+
+void l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, int prefetch, unsigned long long int evicted_addr)
+{
+  // uncomment this line to see the information available to you when there is a cache fill event
+  //printf("0x%llx %d %d %d 0x%llx\n", addr, set, way, prefetch, evicted_addr);
+
+  if(evicted_addr == 0)
+    {
+      return;
+    }
+
+  // losing any line of an active page ends that page's generation
+  unsigned long long int evicted_page = evicted_addr>>12;
+  active_generation_t *agt_set = agt[evicted_page % AGT_SET_COUNT];
+  int i;
+  for(i=0; i<AGT_WAYS; i++)
+    {
+      if(agt_set[i].valid && (agt_set[i].page == evicted_page))
+	{
+	  end_generation(&agt_set[i]);
+	  break;
+	}
+    }
+}
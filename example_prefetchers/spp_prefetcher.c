@@ -0,0 +1,339 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  This file describes a Signature Path Prefetcher (SPP).  Each 4 KB page keeps
+  a short signature, a hash of the last few cache line deltas seen in that page.
+  A pattern table indexed by signature learns which delta usually follows it,
+  and how often.
+
+  On every access the prefetcher walks ahead along the most likely path:
+  it predicts the next delta, folds it into the signature, and looks up the
+  pattern table again, multiplying the confidence of each step into a path
+  confidence.  The walk stops when the path confidence drops below a threshold,
+  or when it leaves the current 4 KB page.
+
+  Prefetches with high path confidence are issued into the L2.  The confidence
+  needed to fill the L2 rises with L2 MSHR occupancy, and the confidence needed
+  to prefetch at all rises with L2 read queue occupancy, so the lookahead gets
+  shallower as the memory system gets busier.
+
+ */
+
+#include <stdio.h>
+#include "../inc/prefetcher.h"
+
+// signature table, tracking the last offset and signature of recently used pages
+#define ST_SET_COUNT 64
+#define ST_WAYS 4
+
+// pattern table, indexed by signature
+#define PT_COUNT 512
+#define PT_DELTAS 4
+#define SIG_BITS 12
+#define SIG_SHIFT 3
+#define C_SIG_MAX 15
+#define C_DELTA_MAX 15
+
+// confidences are in percent
+// each lookahead step scales the path confidence by this much
+#define LOOKAHEAD_ALPHA 90
+// path confidence needed to prefetch at all, with an empty read queue
+#define PF_THRESHOLD 25
+// path confidence needed to fill the L2, with no MSHRs in use
+#define FILL_THRESHOLD 50
+#define MAX_LOOKAHEAD_DEPTH 8
+
+// recently prefetched lines, so the lookahead does not prefetch them twice
+#define PF_FILTER_COUNT 1024
+
+typedef struct signature_entry
+{
+  // which 4 KB page this entry is tracking
+  unsigned long long int page;
+
+  // cache line index within the page of the last access
+  int last_offset;
+
+  // hash of the recent deltas within the page
+  int signature;
+
+  // use LRU to evict old pages
+  unsigned long long int lru_cycle;
+} signature_entry_t;
+
+typedef struct pattern_entry
+{
+  // how many times this signature has been seen
+  int c_sig;
+
+  // the deltas that followed this signature, and how often each did
+  int delta[PT_DELTAS];
+  int c_delta[PT_DELTAS];
+} pattern_entry_t;
+
+signature_entry_t signature_table[ST_SET_COUNT][ST_WAYS];
+pattern_entry_t pattern_table[PT_COUNT];
+unsigned long long int pf_filter[PF_FILTER_COUNT];
+
+// folds a delta into a signature
+int spp_next_signature(int signature, int delta)
+{
+  // sign-magnitude encoding, so +n and -n make different signatures
+  int encoded = (delta < 0) ? (((-delta)&63) | 64) : delta;
+
+  return ((signature<<SIG_SHIFT) ^ encoded) & ((1<<SIG_BITS)-1);
+}
+
+// records that delta followed signature
+void spp_train(int signature, int delta)
+{
+  pattern_entry_t *entry = &pattern_table[signature % PT_COUNT];
+
+  int i;
+  int delta_index = -1;
+  for(i=0; i<PT_DELTAS; i++)
+    {
+      if((entry->c_delta[i] > 0) && (entry->delta[i] == delta))
+	{
+	  delta_index = i;
+	  break;
+	}
+    }
+
+  if(delta_index == -1)
+    {
+      // replace the delta we are least confident in
+      delta_index = 0;
+      for(i=1; i<PT_DELTAS; i++)
+	{
+	  if(entry->c_delta[i] < entry->c_delta[delta_index])
+	    {
+	      delta_index = i;
+	    }
+	}
+      entry->delta[delta_index] = delta;
+      entry->c_delta[delta_index] = 0;
+    }
+
+  entry->c_delta[delta_index]++;
+  entry->c_sig++;
+
+  // when either counter saturates, halve them all to keep the ratios
+  if((entry->c_sig > C_SIG_MAX) || (entry->c_delta[delta_index] > C_DELTA_MAX))
+    {
+      entry->c_sig >>= 1;
+      for(i=0; i<PT_DELTAS; i++)
+	{
+	  entry->c_delta[i] >>= 1;
+	}
+    }
+}
+
+int spp_filter_index(unsigned long long int cl_address)
+{
+  return (cl_address ^ (cl_address>>10)) & (PF_FILTER_COUNT-1);
+}
+
+// returns 1 if this line was recently prefetched
+int spp_filter_check(unsigned long long int pf_address)
+{
+  unsigned long long int cl_address = pf_address>>6;
+
+  return pf_filter[spp_filter_index(cl_address)] == cl_address;
+}
+
+// remembers a prefetch the L2 took
+void spp_filter_add(unsigned long long int pf_address)
+{
+  unsigned long long int cl_address = pf_address>>6;
+
+  pf_filter[spp_filter_index(cl_address)] = cl_address;
+}
+
+void l2_prefetcher_initialize(int cpu_num)
+{
+  printf("Signature Path Prefetcher\n");
+  // you can inspect these knob values from your code to see which configuration you're runnig in
+  printf("Knobs visible from prefetcher: %d %d %d\n", knob_scramble_loads, knob_small_llc, knob_low_bandwidth);
+
+  int i, j;
+  for(i=0; i<ST_SET_COUNT; i++)
+    {
+      for(j=0; j<ST_WAYS; j++)
+	{
+	  signature_table[i][j].page = 0;
+	  signature_table[i][j].last_offset = 0;
+	  signature_table[i][j].signature = 0;
+	  signature_table[i][j].lru_cycle = 0;
+	}
+    }
+
+  for(i=0; i<PT_COUNT; i++)
+    {
+      pattern_table[i].c_sig = 0;
+      for(j=0; j<PT_DELTAS; j++)
+	{
+	  pattern_table[i].delta[j] = 0;
+	  pattern_table[i].c_delta[j] = 0;
+	}
+    }
+
+  for(i=0; i<PF_FILTER_COUNT; i++)
+    {
+      pf_filter[i] = 0;
+    }
+}
+
+void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned long long int ip, int cache_hit)
+{
+  // uncomment this line to see all the information available to make prefetch decisions
+  //printf("(%lld 0x%llx 0x%llx %d %d %d) ", get_current_cycle(0), addr, ip, cache_hit, get_l2_read_queue_occupancy(0), get_l2_mshr_occupancy(0));
+
+  unsigned long long int cl_address = addr>>6;
+  unsigned long long int page = cl_address>>6;
+  int page_offset = cl_address&63;
+
+  // check the signature table for this page
+  signature_entry_t *set = signature_table[page % ST_SET_COUNT];
+  signature_entry_t *entry = NULL;
+
+  int i;
+  for(i=0; i<ST_WAYS; i++)
+    {
+      if(set[i].page == page)
+	{
+	  entry = &set[i];
+	  break;
+	}
+    }
+
+  if(entry == NULL)
+    {
+      // this is a new page, so replace the least recently used one in its set
+      entry = &set[0];
+      for(i=1; i<ST_WAYS; i++)
+	{
+	  if(set[i].lru_cycle < entry->lru_cycle)
+	    {
+	      entry = &set[i];
+	    }
+	}
+
+      // there is no delta to learn from until the second access
+      entry->page = page;
+      entry->last_offset = page_offset;
+      entry->signature = 0;
+      entry->lru_cycle = get_current_cycle(0);
+
+      return;
+    }
+
+  entry->lru_cycle = get_current_cycle(0);
+
+  int delta = page_offset - entry->last_offset;
+  if(delta == 0)
+    {
+      return;
+    }
+
+  // learn from this access, then predict from the updated signature
+  spp_train(entry->signature, delta);
+  entry->signature = spp_next_signature(entry->signature, delta);
+  entry->last_offset = page_offset;
+
+  // set the confidence cutoffs from how busy the L2 is
+  int pf_threshold = PF_THRESHOLD + ((100-PF_THRESHOLD)*get_l2_read_queue_occupancy(0))/L2_READ_QUEUE_SIZE;
+  int fill_threshold = FILL_THRESHOLD + ((100-FILL_THRESHOLD)*get_l2_mshr_occupancy(0))/L2_MSHR_COUNT;
+
+  // walk ahead along the most likely delta path
+  int signature = entry->signature;
+  int base_offset = page_offset;
+  int path_confidence = 100;
+  int depth;
+  for(depth=0; depth<MAX_LOOKAHEAD_DEPTH; depth++)
+    {
+      pattern_entry_t *pattern = &pattern_table[signature % PT_COUNT];
+      if(pattern->c_sig == 0)
+	{
+	  break;
+	}
+
+      // prefetch every delta that is confident enough on its own,
+      // and remember the most likely one to continue the walk
+      int best_index = -1;
+      for(i=0; i<PT_DELTAS; i++)
+	{
+	  if(pattern->c_delta[i] == 0)
+	    {
+	      continue;
+	    }
+
+	  if((best_index == -1) || (pattern->c_delta[i] > pattern->c_delta[best_index]))
+	    {
+	      best_index = i;
+	    }
+
+	  int confidence = (path_confidence*pattern->c_delta[i])/pattern->c_sig;
+	  if(confidence < pf_threshold)
+	    {
+	      continue;
+	    }
+
+	  int pf_offset = base_offset + pattern->delta[i];
+	  if((pf_offset < 0) || (pf_offset > 63))
+	    {
+	      // only prefetch within the current 4 KB page
+	      continue;
+	    }
+
+	  unsigned long long int pf_address = (page<<12)+(pf_offset<<6);
+	  if(spp_filter_check(pf_address))
+	    {
+	      continue;
+	    }
+
+	  // a prefetch dropped for a full queue or full MSHRs is not remembered, so it can be tried again
+	  if(l2_prefetch_line(0, addr, pf_address, (confidence >= fill_threshold) ? FILL_L2 : FILL_LLC))
+	    {
+	      spp_filter_add(pf_address);
+	    }
+	}
+
+      if(best_index == -1)
+	{
+	  break;
+	}
+
+      path_confidence = (path_confidence*pattern->c_delta[best_index]*LOOKAHEAD_ALPHA)/(pattern->c_sig*100);
+      if(path_confidence < pf_threshold)
+	{
+	  break;
+	}
+
+      base_offset += pattern->delta[best_index];
+      if((base_offset < 0) || (base_offset > 63))
+	{
+	  // the path has left the page
+	  break;
+	}
+
+      signature = spp_next_signature(signature, pattern->delta[best_index]);
+    }
+}
+
+void l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, int prefetch, unsigned long long int evicted_addr)
+{
+  // uncomment this line to see the information available to you when there is a cache fill event
+  //printf("0x%llx %d %d %d 0x%llx\n", addr, set, way, prefetch, evicted_addr);
+
+  // a line that has left the L2 may be prefetched again
+  unsigned long long int cl_address = evicted_addr>>6;
+  int index = spp_filter_index(cl_address);
+  if(pf_filter[index] == cl_address)
+    {
+      pf_filter[index] = 0;
+    }
+}
@@ -8,16 +8,21 @@
   This file describes a streaming prefetcher. Prefetches are issued after
   a spatial locality is detected, and a stream direction can be determined.
 
-  Prefetches are issued into the L2 or LLC depending on L2 MSHR occupancy.
+  The prefetch degree and distance, and whether prefetches are issued into
+  the L2 or LLC, are adjusted at run time by the feedback throttle in
+  inc/throttle.h.
 
  */
 
 #include <stdio.h>
 #include "../inc/prefetcher.h"
+#include "../inc/throttle.h"
 
 #define STREAM_DETECTOR_COUNT 64
 #define STREAM_WINDOW 16
 #define PREFETCH_DEGREE 2
+// how far ahead of the current access the stream may run, in cache lines
+#define PREFETCH_DISTANCE 32
 
 typedef struct stream_detector
 {
@@ -43,6 +48,8 @@ void l2_prefetcher_initialize(int cpu_num)
   // you can inspect these knob values from your code to see which configuration you're runnig in
   printf("Knobs visible from prefetcher: %d %d %d\n", knob_scramble_loads, knob_small_llc, knob_low_bandwidth);
 
+  throttle_initialize();
+
   int i;
   for(i=0; i<STREAM_DETECTOR_COUNT; i++)
     {
@@ -60,6 +67,8 @@ void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned lo
   // uncomment this line to see all the information available to make prefetch decisions
   //printf("(%lld 0x%llx 0x%llx %d %d %d) ", get_current_cycle(0), addr, ip, cache_hit, get_l2_read_queue_occupancy(0), get_l2_mshr_occupancy(0));
 
+  throttle_operate(addr, cache_hit);
+
   unsigned long long int cl_address = addr>>6;
   unsigned long long int page = cl_address>>6;
   int page_offset = cl_address&63;
@@ -137,10 +146,19 @@ void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned lo
   // prefetch if confidence is high enough
   if(detectors[detector_index].confidence >= 2)
     {
+      int degree = throttle_degree(PREFETCH_DEGREE);
+      int distance = throttle_distance(PREFETCH_DISTANCE);
       int i;
-      for(i=0; i<PREFETCH_DEGREE; i++)
+      for(i=0; i<degree; i++)
 	{
-	  detectors[detector_index].pf_index += detectors[detector_index].direction;
+	  int next_index = detectors[detector_index].pf_index + detectors[detector_index].direction;
+	  if((next_index-page_offset > distance) || (page_offset-next_index > distance))
+	    {
+	      // we're far enough ahead of the demand stream for now
+	      break;
+	    }
+
+	  detectors[detector_index].pf_index = next_index;
 
 	  if((detectors[detector_index].pf_index < 0) || (detectors[detector_index].pf_index > 63))
 	    {
@@ -151,17 +169,7 @@ void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned lo
 	  // perform prefetches
 	  unsigned long long int pf_address = (page<<12)+((detectors[detector_index].pf_index)<<6);
 	  
-	  // check MSHR occupancy to decide whether to prefetch into the L2 or LLC
-	  if(get_l2_mshr_occupancy(0) > 8)
-	    {
-	      // conservatively prefetch into the LLC, because MSHRs are scarce
-	      l2_prefetch_line(0, addr, pf_address, FILL_LLC);
-	    }
-	  else
-	    {
-	      // MSHRs not too busy, so prefetch into L2
-	      l2_prefetch_line(0, addr, pf_address, FILL_L2);
-	    }
+	  throttle_prefetch_line(addr, pf_address, throttle_fill_level(9));
 	}
     }
 }
@@ -170,4 +178,14 @@ void l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, i
 {
   // uncomment this line to see the information available to you when there is a cache fill event
   //printf("0x%llx %d %d %d 0x%llx\n", addr, set, way, prefetch, evicted_addr);
+
+  throttle_cache_fill(addr, set, way, prefetch, evicted_addr);
+}
+
+void l2_prefetcher_checkpoint(int cpu_num, void (*region)(void *data, unsigned long long int size))
+{
+  region(detectors, sizeof(detectors));
+  region(&replacement_index, sizeof(replacement_index));
+
+  throttle_checkpoint(region);
 }
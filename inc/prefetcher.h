@@ -91,3 +91,9 @@ void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned lo
 // reconstruct a view of the contents of the L2 cache.
 // Using this function is optional.
 void l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, int prefetch, unsigned long long int evicted_addr);
+
+// This function is optional, and only called by the checkpointing in tools/checkpoint.c.
+// Call region() once for each piece of prefetcher state, with its address and size in bytes, in the same order every time.
+// The same calls save the state at the end of the warmup, and restore it when the checkpoint is loaded.
+// A prefetcher that does not define this function starts with the state l2_prefetcher_initialize() gave it.
+void l2_prefetcher_checkpoint(int cpu_num, void (*region)(void *data, unsigned long long int size));
@@ -0,0 +1,377 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+  Feedback-directed prefetch throttling, shared by the example prefetchers.
+
+  Include this after prefetcher.h in a prefetcher .c file.  Everything is
+  defined here, so the prefetcher still builds as a single file against
+  lib/dpc2sim.a.
+
+  The throttle measures four things about the prefetches it is told about:
+   - accuracy: the fraction of prefetched L2 fills that a demand access used
+   - lateness: the fraction of useful prefetches that a demand access missed
+     on while they were still in flight
+   - pollution: the fraction of demand misses to lines evicted by a prefetch fill
+   - coverage: the fraction of would-be demand misses that useful prefetches removed
+
+  Every THROTTLE_INTERVAL L2 accesses it moves an aggressiveness level up or
+  down from these measurements.  Level THROTTLE_LEVEL_START keeps a
+  prefetcher's own degree and distance, lower levels shrink them and higher
+  levels grow them.  Accurate prefetches that leave misses behind grow the
+  level only while the last step up raised coverage.  Prefetches go to the
+  LLC when inaccurate, and otherwise fill the L2 below the prefetcher's own
+  MSHR occupancy cutoff.
+
+  To use it:
+   - call throttle_initialize() from l2_prefetcher_initialize()
+   - call throttle_operate() first thing in l2_prefetcher_operate()
+   - call throttle_cache_fill() from l2_cache_fill()
+   - issue prefetches through throttle_prefetch_line()
+   - size them with throttle_degree(), throttle_distance() and throttle_fill_level()
+*/
+
+#define THROTTLE_INTERVAL 4096
+#define THROTTLE_LEVEL_COUNT 5
+#define THROTTLE_LEVEL_START 2
+
+// accuracy bounds, in percent
+#define THROTTLE_ACCURACY_HIGH 75
+#define THROTTLE_ACCURACY_LOW 40
+// lateness and pollution thresholds, in percent
+#define THROTTLE_LATENESS 10
+#define THROTTLE_POLLUTION 5
+// coverage below this, in percent, asks accurate prefetchers for more
+#define THROTTLE_COVERAGE 50
+
+// must be powers of two
+#define THROTTLE_INFLIGHT_COUNT 256
+#define THROTTLE_POLLUTION_COUNT 4096
+
+// scale factors applied to a prefetcher's degree and distance at each level, in quarters
+int throttle_scale[THROTTLE_LEVEL_COUNT] = {1, 2, 4, 6, 8};
+
+int throttle_level;
+int throttle_access_count;
+
+// counts for the current interval
+int throttle_issued;
+int throttle_filled;
+int throttle_useful;
+int throttle_late;
+int throttle_demand_misses;
+int throttle_polluting_misses;
+
+// measurements from the last interval, in percent
+int throttle_accuracy;
+int throttle_lateness;
+int throttle_pollution;
+int throttle_coverage;
+
+// coverage when the level last grew for coverage alone, -1 if it has not since
+int throttle_grown_coverage;
+
+// shadow of the L2 tags and whether each line was prefetched and not yet used
+unsigned long long int throttle_tags[L2_SET_COUNT][L2_ASSOCIATIVITY];
+int throttle_prefetched[L2_SET_COUNT][L2_ASSOCIATIVITY];
+
+// L2 prefetches issued but not yet filled, direct-mapped by line address,
+// and whether a demand miss has already counted each one as late
+unsigned long long int throttle_inflight[THROTTLE_INFLIGHT_COUNT];
+int throttle_inflight_late[THROTTLE_INFLIGHT_COUNT];
+
+// lines evicted by a prefetch fill, direct-mapped by line address
+unsigned long long int throttle_pollution_filter[THROTTLE_POLLUTION_COUNT];
+
+int throttle_hash(unsigned long long int cl_address)
+{
+  return (int)(cl_address ^ (cl_address>>12) ^ (cl_address>>24));
+}
+
+void throttle_initialize()
+{
+  int i, j;
+  for(i=0; i<L2_SET_COUNT; i++)
+    {
+      for(j=0; j<L2_ASSOCIATIVITY; j++)
+	{
+	  throttle_tags[i][j] = 0;
+	  throttle_prefetched[i][j] = 0;
+	}
+    }
+  for(i=0; i<THROTTLE_INFLIGHT_COUNT; i++)
+    {
+      throttle_inflight[i] = 0;
+      throttle_inflight_late[i] = 0;
+    }
+  for(i=0; i<THROTTLE_POLLUTION_COUNT; i++)
+    {
+      throttle_pollution_filter[i] = 0;
+    }
+
+  throttle_level = THROTTLE_LEVEL_START;
+  throttle_access_count = 0;
+  throttle_issued = 0;
+  throttle_filled = 0;
+  throttle_useful = 0;
+  throttle_late = 0;
+  throttle_demand_misses = 0;
+  throttle_polluting_misses = 0;
+
+  // start out assuming the prefetcher is doing well
+  throttle_accuracy = THROTTLE_ACCURACY_HIGH;
+  throttle_lateness = 0;
+  throttle_pollution = 0;
+  throttle_coverage = 100;
+  throttle_grown_coverage = -1;
+}
+
+// moves the aggressiveness level from the measurements of the interval that just ended
+void throttle_adjust()
+{
+  // only judge accuracy once there are enough prefetches to judge
+  if(throttle_filled >= 16)
+    {
+      throttle_accuracy = (100*throttle_useful)/throttle_filled;
+      if(throttle_accuracy > 100)
+	{
+	  // a few useful prefetches may have been filled in the previous interval
+	  throttle_accuracy = 100;
+	}
+    }
+  throttle_lateness = (throttle_useful > 0) ? (100*throttle_late)/throttle_useful : 0;
+  throttle_pollution = (throttle_demand_misses > 0) ? (100*throttle_polluting_misses)/throttle_demand_misses : 0;
+  throttle_coverage = (throttle_useful+throttle_demand_misses > 0) ? (100*throttle_useful)/(throttle_useful+throttle_demand_misses) : 100;
+
+  int late = (throttle_lateness >= THROTTLE_LATENESS);
+  int polluting = (throttle_pollution >= THROTTLE_POLLUTION);
+  int uncovered = (throttle_coverage < THROTTLE_COVERAGE);
+
+  int change = 0;
+  if(throttle_accuracy >= THROTTLE_ACCURACY_HIGH)
+    {
+      // accurate prefetches that arrive late should start earlier,
+      // and ones that leave many misses behind can afford to do more
+      if(polluting)
+	{
+	  change = -1;
+	}
+      else if(late)
+	{
+	  change = 1;
+	}
+      else if(uncovered)
+	{
+	  // only keep growing while growing removes misses, since a prefetcher
+	  // that has no more to find just spends the bandwidth
+	  if((throttle_grown_coverage < 0) || (throttle_coverage > throttle_grown_coverage))
+	    {
+	      change = 1;
+	      throttle_grown_coverage = throttle_coverage;
+	    }
+	}
+    }
+  else if(throttle_accuracy >= THROTTLE_ACCURACY_LOW)
+    {
+      // half-wasted prefetches are only worth growing when they are late
+      if(late && !polluting)
+	{
+	  change = 1;
+	}
+      else
+	{
+	  change = -1;
+	}
+    }
+  else
+    {
+      // inaccurate prefetches only cost bandwidth
+      change = -1;
+    }
+
+  if(change < 0)
+    {
+      throttle_grown_coverage = -1;
+    }
+  throttle_level += change;
+  if(throttle_level < 0)
+    {
+      throttle_level = 0;
+    }
+  if(throttle_level >= THROTTLE_LEVEL_COUNT)
+    {
+      throttle_level = THROTTLE_LEVEL_COUNT-1;
+    }
+
+  // keep half of the history, so one quiet interval does not erase the last
+  throttle_issued /= 2;
+  throttle_filled /= 2;
+  throttle_useful /= 2;
+  throttle_late /= 2;
+  throttle_demand_misses /= 2;
+  throttle_polluting_misses /= 2;
+}
+
+void throttle_operate(unsigned long long int addr, int cache_hit)
+{
+  unsigned long long int cl_address = addr>>6;
+
+  if(cache_hit)
+    {
+      // the first demand hit on a prefetched line makes that prefetch useful
+      int set = l2_get_set(addr);
+      int way;
+      for(way=0; way<L2_ASSOCIATIVITY; way++)
+	{
+	  if((throttle_tags[set][way] == cl_address) && throttle_prefetched[set][way])
+	    {
+	      throttle_prefetched[set][way] = 0;
+	      throttle_useful++;
+	      break;
+	    }
+	}
+    }
+  else
+    {
+      throttle_demand_misses++;
+
+      // a miss on a line we are still prefetching means the prefetch was useful but late
+      int index = throttle_hash(cl_address) & (THROTTLE_INFLIGHT_COUNT-1);
+      if((throttle_inflight[index] == cl_address) && !throttle_inflight_late[index])
+	{
+	  throttle_inflight_late[index] = 1;
+	  throttle_useful++;
+	  throttle_late++;
+	}
+
+      // a miss on a line a prefetch pushed out of the L2 is pollution
+      index = throttle_hash(cl_address) & (THROTTLE_POLLUTION_COUNT-1);
+      if(throttle_pollution_filter[index] == cl_address)
+	{
+	  throttle_pollution_filter[index] = 0;
+	  throttle_polluting_misses++;
+	}
+    }
+
+  throttle_access_count++;
+  if(throttle_access_count == THROTTLE_INTERVAL)
+    {
+      throttle_adjust();
+      throttle_access_count = 0;
+    }
+}
+
+void throttle_cache_fill(unsigned long long int addr, int set, int way, int prefetch, unsigned long long int evicted_addr)
+{
+  unsigned long long int cl_address = addr>>6;
+
+  if(prefetch)
+    {
+      throttle_filled++;
+
+      // the prefetch is no longer in flight
+      int index = throttle_hash(cl_address) & (THROTTLE_INFLIGHT_COUNT-1);
+      if(throttle_inflight[index] == cl_address)
+	{
+	  // a prefetch already counted as late must not count as useful again
+	  if(throttle_inflight_late[index])
+	    {
+	      prefetch = 0;
+	    }
+	  throttle_inflight[index] = 0;
+	  throttle_inflight_late[index] = 0;
+	}
+
+      // remember demand lines this prefetch pushed out
+      if((evicted_addr != 0) && !throttle_prefetched[set][way])
+	{
+	  throttle_pollution_filter[throttle_hash(evicted_addr>>6) & (THROTTLE_POLLUTION_COUNT-1)] = evicted_addr>>6;
+	}
+    }
+
+  throttle_tags[set][way] = cl_address;
+  throttle_prefetched[set][way] = prefetch;
+}
+
+// the prefetch degree to use, given the prefetcher's own degree
+int throttle_degree(int degree)
+{
+  int scaled = (degree*throttle_scale[throttle_level])/4;
+
+  return (scaled < 1) ? 1 : scaled;
+}
+
+// the prefetch distance to use, given the prefetcher's own distance
+int throttle_distance(int distance)
+{
+  int scaled = (distance*throttle_scale[throttle_level])/4;
+
+  return (scaled < 1) ? 1 : scaled;
+}
+
+// FILL_L2 or FILL_LLC, from accuracy and current MSHR occupancy, mshr_limit
+// being the occupancy below which the prefetcher on its own fills the L2
+int throttle_fill_level(int mshr_limit)
+{
+  // inaccurate prefetches go to the LLC, where they do not take an L2 MSHR
+  if(throttle_accuracy < THROTTLE_ACCURACY_LOW)
+    {
+      return FILL_LLC;
+    }
+
+  if(get_l2_mshr_occupancy(0) < mshr_limit)
+    {
+      return FILL_L2;
+    }
+
+  return FILL_LLC;
+}
+
+// issues a prefetch through l2_prefetch_line(), and tracks it
+int throttle_prefetch_line(unsigned long long int base_addr, unsigned long long int pf_addr, int fill_level)
+{
+  int issued = l2_prefetch_line(0, base_addr, pf_addr, fill_level);
+
+  if(issued)
+    {
+      throttle_issued++;
+
+      // only L2 fills come back through l2_cache_fill
+      if(fill_level == FILL_L2)
+	{
+	  unsigned long long int cl_address = pf_addr>>6;
+	  int index = throttle_hash(cl_address) & (THROTTLE_INFLIGHT_COUNT-1);
+	  throttle_inflight[index] = cl_address;
+	  throttle_inflight_late[index] = 0;
+	}
+    }
+
+  return issued;
+}
+
+// passes the throttle's state to region(), for l2_prefetcher_checkpoint()
+void throttle_checkpoint(void (*region)(void *data, unsigned long long int size))
+{
+  region(&throttle_level, sizeof(throttle_level));
+  region(&throttle_access_count, sizeof(throttle_access_count));
+
+  region(&throttle_issued, sizeof(throttle_issued));
+  region(&throttle_filled, sizeof(throttle_filled));
+  region(&throttle_useful, sizeof(throttle_useful));
+  region(&throttle_late, sizeof(throttle_late));
+  region(&throttle_demand_misses, sizeof(throttle_demand_misses));
+  region(&throttle_polluting_misses, sizeof(throttle_polluting_misses));
+
+  region(&throttle_accuracy, sizeof(throttle_accuracy));
+  region(&throttle_lateness, sizeof(throttle_lateness));
+  region(&throttle_pollution, sizeof(throttle_pollution));
+  region(&throttle_coverage, sizeof(throttle_coverage));
+  region(&throttle_grown_coverage, sizeof(throttle_grown_coverage));
+
+  region(throttle_tags, sizeof(throttle_tags));
+  region(throttle_prefetched, sizeof(throttle_prefetched));
+  region(throttle_inflight, sizeof(throttle_inflight));
+  region(throttle_inflight_late, sizeof(throttle_inflight_late));
+  region(throttle_pollution_filter, sizeof(throttle_pollution_filter));
+}
@@ -2,20 +2,66 @@
 #########################################################################################
 # Author: Ramyad Hadidi (rhadidi@gatech.edu)
 #########################################################################################
+from __future__ import print_function
 import sys
 import os
 import argparse
+import json
+import subprocess
+import threading
+import multiprocessing
+import time
+
+try:
+    import Queue as queue
+except ImportError:
+    import queue
+
+#########################################################################################
+# championship configurations, name -> extra dpc2sim switches
+#########################################################################################
+CONFIGS = {
+    "default"        : [],
+    "small_llc"      : ["-small_llc"],
+    "low_bandwidth"  : ["-low_bandwidth"],
+    "scramble_loads" : ["-scramble_loads"],
+    }
+CONFIG_ORDER = ["default", "small_llc", "low_bandwidth", "scramble_loads"]
+
+INDEX_FILENAME = "index.json"
+
+# traces converted by tools/trace_convert, read back with tools/trace_cat
+COLUMNS_SUFFIX = ".dpcc"
+TRACE_SUFFIXES = (".dpc.gz", COLUMNS_SUFFIX)
+
+# bytes per instruction in an uncompressed trace
+RECORD_SIZE = 48
 
 #########################################################################################
 # sanity check
 #########################################################################################
 def sanity_check(args):
-    if not args.exe:
-        print "ERROR: Define executables with -e option"
+    if args.submit:
+        print("ERROR: qsub submission is not supported, jobs run on the local machine (see -j)")
+        exit(0)
+    for config in args.config:
+        if config not in CONFIGS:
+            print("ERROR: Unknown config " + config + ", choose from " + ", ".join(CONFIG_ORDER))
+            exit(0)
+    if args.jobs < 1:
+        print("ERROR: Need at least one job")
+        exit(0)
+    if args.sample and (args.sampleInterval < 1 or args.sampleWarmup < 0 or args.sampleFunctionalWarmup < 0):
+        print("ERROR: --sampleInterval must be positive, --sampleWarmup and --sampleFunctionalWarmup not negative")
+        exit(0)
+    if args.l2PrefetchRRPV is not None and (args.l2Replacement is None or args.l2PrefetchRRPV < 0 or args.l2PrefetchRRPV > 3):
+        print("ERROR: --l2PrefetchRRPV needs --l2Replacement and must be between 0 and 3")
         exit(0)
-	if not args.degree:
-		print "ERROR: Define degree"
-		exit(0)
+    for rrpv in ["llcPrefetchRRPV", "llcWritebackRRPV"]:
+        value = getattr(args, rrpv)
+        if value is not None and (args.llcReplacement is None or value < 0 or value > 3):
+            print("ERROR: --" + rrpv + " needs --llcReplacement and must be between 0 and 3")
+            exit(0)
 
     return
 
@@ -24,14 +70,405 @@ def sanity_check(args):
 #########################################################################################
 def process_options():
     parser = argparse.ArgumentParser(description='run.py')
-    parser.add_argument("--dryRun", help="Print out the generated script(s) instead of launching jobs", action="store_true", default=False)
+    parser.add_argument("--dryRun", help="Print out the generated commands instead of launching jobs", action="store_true", default=False)
     parser.add_argument("-o", "--outputDir", help="Root directory for result files", default="results")
-    parser.add_argument("-e", "--exe", action='append', nargs='*', help="Executables to run")
+    parser.add_argument("-e", "--exe", action='append', nargs='*', help="Executables to run, default is every compiled prefetcher")
+    parser.add_argument("-t", "--trace", action='append', nargs='*', help="Traces to run (e.g. lbm), default is every trace in traces/")
+    parser.add_argument("-c", "--config", action='append', nargs='*', help="Configs to run (" + ", ".join(CONFIG_ORDER) + "), default is all four")
     parser.add_argument("-s", "--submit",  help="Submit Jobs to qsub", action="store_true", default=False)
     parser.add_argument("-d", "--degree", help="Degree of Prefetcher, for name generation", default=0)
+    parser.add_argument("-j", "--jobs", type=int, help="Number of concurrent simulations, default is the core count", default=multiprocessing.cpu_count())
+    parser.add_argument("-r", "--retries", type=int, help="Times a failed simulation is retried", default=2)
+    parser.add_argument("-a", "--dpcArgs", help="Extra dpc2sim switches, e.g. \"-warmup_instructions 1000000\"", default="")
+    parser.add_argument("--ccFlags", help="Flags used to compile the prefetchers", default="-Wall")
+    parser.add_argument("--noCompile", help="Use the existing dpc2sim_* executables", action="store_true", default=False)
+    parser.add_argument("-f", "--fanout", help="Decompress each trace once and feed every prefetcher from it through trace_fanout, -j then counts traces x configs", action="store_true", default=False)
+    parser.add_argument("--rerun", help="Run jobs even if their result file already exists", action="store_true", default=False)
+    parser.add_argument("--sample", help="Simulate only the representative intervals picked by tools/simpoint, and report their weighted IPC", action="store_true", default=False)
+    parser.add_argument("--sampleInterval", type=int, help="Instructions per sampled interval", default=1000000)
+    parser.add_argument("--sampleWarmup", type=int, help="Instructions simulated before each sampled interval to warm it up", default=1000000)
+    parser.add_argument("--sampleFunctionalWarmup", type=int, help="Instructions before --sampleWarmup that only warm the caches and the prefetcher, see tools/functional_warmup.c", default=0)
+    parser.add_argument("--l2Replacement", choices=["lru", "srrip", "drrip", "ship"], help="Build the prefetchers with tools/mlc.c and use this L2 replacement policy", default=None)
+    parser.add_argument("--l2PrefetchRRPV", type=int, help="Insertion RRPV of L2 prefetch fills (0-3) with --l2Replacement, see tools/mlc.c", default=None)
+    parser.add_argument("--llcReplacement", choices=["lru", "srrip", "drrip", "hawkeye"], help="Build the prefetchers with tools/llc.c and tools/mlc.c and use this LLC replacement policy", default=None)
+    parser.add_argument("--llcPrefetchRRPV", type=int, help="Insertion RRPV of LLC prefetch fills (0-3) with --llcReplacement, see tools/llc.c", default=None)
+    parser.add_argument("--llcWritebackRRPV", type=int, help="Insertion RRPV of LLC write back fills (0-3) with --llcReplacement, see tools/llc.c", default=None)
+    parser.add_argument("--dramModel", choices=["library", "ddr"], help="Build the prefetchers with tools/memory_controller.c and use this DRAM model", default=None)
+    parser.add_argument("--stats", help="Build the prefetchers with tools/stats.c and write each job's counters next to its result, as JSON lines", action="store_true", default=False)
 
     return parser
 
+# flattens an append/nargs option into a list, None if it was not given
+def flatten(option):
+    if option is None:
+        return None
+    return [item for group in option for item in group]
+
+#########################################################################################
+# compile every prefetcher in example_prefetchers into dpc2sim_<name>
+#########################################################################################
+def compile_prefetchers(current_dir, args):
+    source_dir = os.path.join(current_dir, 'example_prefetchers')
+    executables = []
+    for source in sorted(os.listdir(source_dir)):
+        output = 'dpc2sim_' + source.split('_')[0]
+        # tools/mlc.c, tools/llc.c and tools/memory_controller.c have to come before lib/dpc2sim.a to replace
+        # its mlc.o, llc.o and memory_controller.o, and tools/llc.c takes the load ips from tools/mlc.c
+        tools = ''
+        if args.llcReplacement is not None:
+            tools += ' tools/llc.c'
+        if args.l2Replacement is not None or args.llcReplacement is not None:
+            tools += ' tools/mlc.c'
+        if args.dramModel is not None:
+            tools += ' tools/memory_controller.c'
+        if args.stats:
+            command = (
+                'gcc ' + args.ccFlags + ' -o ' + output +
+                ' -DPREFETCHER=\'"../example_prefetchers/' + source + '"\' tools/stats.c' + tools + ' lib/dpc2sim.a' +
+                ' -Wl,--wrap=memory_controller_operate,--wrap=dcu_add_to_read_queue,--wrap=mlc_add_to_read_queue,--wrap=llc_add_to_read_queue,--wrap=mc_add_to_read_queue'
+                )
+        else:
+            command = (
+                'gcc ' + args.ccFlags + ' -o ' + output +
+                ' example_prefetchers/'+ source + tools + ' lib/dpc2sim.a'
+                )
+        if args.sample and args.sampleFunctionalWarmup > 0:
+            command += ' tools/functional_warmup.c -Wl,--wrap=initialize_llc,--wrap=l2_prefetch_line'
+        print(command)
+        if args.dryRun:
+            executables.append(output)
+        elif os.system(command) == 0:
+            executables.append(output)
+        else:
+            print("ERROR: Failed to compile " + source + ", skipping it")
+
+    return executables
+
+# builds tools/trace_fanout.c, returns its path
+def compile_fanout(current_dir, args):
+    output = os.path.join(current_dir, 'trace_fanout')
+    command = 'gcc -Wall -O2 -o ' + output + ' tools/trace_fanout.c -lpthread'
+    print(command)
+    if not args.dryRun and os.system(command) != 0:
+        print("ERROR: Failed to compile tools/trace_fanout.c")
+        exit(1)
+
+    return output
+
+# builds tools/trace_cat.c, returns its path
+def compile_trace_cat(current_dir, args):
+    output = os.path.join(current_dir, 'trace_cat')
+    command = 'gcc -Wall -O2 -o ' + output + ' tools/trace_cat.c -lz'
+    print(command)
+    if not args.dryRun and os.system(command) != 0:
+        print("ERROR: Failed to compile tools/trace_cat.c")
+        exit(1)
+
+    return output
+
+# builds tools/simpoint.c, returns its path
+def compile_simpoint(current_dir, args):
+    output = os.path.join(current_dir, 'simpoint')
+    command = 'gcc -Wall -O2 -o ' + output + ' tools/simpoint.c -lm'
+    print(command)
+    if not args.dryRun and os.system(command) != 0:
+        print("ERROR: Failed to compile tools/simpoint.c")
+        exit(1)
+
+    return output
+
+#########################################################################################
+# sampled simulation, SimPoint style
+#########################################################################################
+# one representative interval of a trace, and the share of the trace it stands for
+class Sample(object):
+    def __init__(self, index, weight, interval):
+        self.index = index
+        self.weight = weight
+        self.interval = interval
+
+# the shell command that streams a trace, from instruction first on
+def trace_reader(args, trace_path, first=0):
+    if trace_path.endswith(COLUMNS_SUFFIX):
+        return [args.traceCatPath, "-skip", str(first), trace_path]
+    if first == 0:
+        return ["zcat", trace_path]
+    return ["sh", "-c", "zcat '{}' | tail -c +{}".format(trace_path, first*RECORD_SIZE + 1)]
+
+# picks the intervals of each trace with tools/simpoint once, and reads them back
+def find_samples(current_dir, args, traces):
+    samples = {}
+    for trace in traces:
+        trace_path = os.path.join(current_dir, 'traces', trace)
+        base = trace[:-len(COLUMNS_SUFFIX)] if trace.endswith(COLUMNS_SUFFIX) else trace[:-len(".dpc.gz")]
+        simpoints_path = os.path.join(current_dir, 'traces', "{}.{}.simpoints".format(base, args.sampleInterval))
+        if not os.path.exists(simpoints_path):
+            command = (" ".join(trace_reader(args, trace_path)) + " | " + args.simpointPath +
+                       " -interval " + str(args.sampleInterval) + " > " + simpoints_path)
+            print(command)
+            if args.dryRun:
+                samples[trace] = []
+                continue
+            if os.system(command) != 0:
+                if os.path.exists(simpoints_path):
+                    os.remove(simpoints_path)
+                print("ERROR: Failed to pick the intervals of " + trace)
+                exit(1)
+
+        samples[trace] = []
+        with open(simpoints_path) as simpoints:
+            for line in simpoints:
+                if line.startswith("#") or not line.strip():
+                    continue
+                index, weight = line.split()
+                samples[trace].append(Sample(int(index), float(weight), args.sampleInterval))
+
+    return samples
+
+# returns the final IPC of a finished result file, None if it did not finish
+def read_ipc(path):
+    if not os.path.exists(path):
+        return None
+    with open(path) as result:
+        for line in result:
+            if line.startswith("Simulation complete") and "IPC:" in line:
+                return float(line.split("IPC:")[1].split()[0])
+    return None
+
+#########################################################################################
+# one simulation: executable x trace x config, or one sampled interval of it
+#########################################################################################
+class Job(object):
+    def __init__(self, current_dir, args, exe, trace, config, sample=None):
+        self.exe = exe
+        self.trace = trace
+        self.config = config
+        self.sample = sample
+        self.degree = str(args.degree)
+        self.trace_path = os.path.join(current_dir, 'traces', trace)
+        self.exe_path = os.path.join(current_dir, exe)
+        self.dpc_options = ["-hide_heartbeat"] + CONFIGS[config] + args.dpcArgs.split()
+        self.env = {}
+        if args.l2Replacement is not None:
+            self.env["MLC_REPLACEMENT"] = args.l2Replacement
+            if args.l2PrefetchRRPV is not None:
+                self.env["MLC_PREFETCH_RRPV"] = str(args.l2PrefetchRRPV)
+        if args.llcReplacement is not None:
+            self.env["LLC_REPLACEMENT"] = args.llcReplacement
+            if args.llcPrefetchRRPV is not None:
+                self.env["LLC_PREFETCH_RRPV"] = str(args.llcPrefetchRRPV)
+            if args.llcWritebackRRPV is not None:
+                self.env["LLC_WRITEBACK_RRPV"] = str(args.llcWritebackRRPV)
+        if args.dramModel is not None:
+            self.env["DRAM_MODEL"] = args.dramModel
+
+        # default config keeps the original file names, so old results are still found
+        output_filename = "{}_{}_{}".format(exe.split('_')[1], trace.split('_')[0], args.degree)
+        if config != "default":
+            output_filename += "_" + config
+        self.full_output_path = os.path.join(current_dir, args.outputDir, output_filename)
+
+        if sample is None:
+            self.reader = trace_reader(args, self.trace_path)
+        else:
+            # the interval is warmed up by simulating the instructions just before it,
+            # and optionally by warming the caches functionally before those
+            start = sample.index*sample.interval
+            warmup = min(args.sampleWarmup, start)
+            functional = min(args.sampleFunctionalWarmup, start - warmup)
+            self.reader = trace_reader(args, self.trace_path, start - warmup - functional)
+            if functional > 0:
+                self.env["FUNCTIONAL_WARMUP"] = str(functional)
+            self.dpc_options += ["-warmup_instructions", str(warmup), "-simulation_instructions", str(sample.interval)]
+            output_filename += "_sp{}".format(sample.index)
+        self.output_path = os.path.join(current_dir, args.outputDir, output_filename)
+        self.stats_path = None
+        if args.stats:
+            self.stats_path = self.output_path + ".stats.jsonl"
+            self.dpc_options += ["-stats_out", self.stats_path]
+
+        self.status = "pending"
+        self.attempts = 0
+        self.seconds = 0.0
+        self.ipc = None
+
+    def command(self):
+        return " ".join(self.reader) + " | " + self.sim_command()
+
+    def read_ipc(self):
+        return read_ipc(self.output_path)
+
+    # results go to a temporary file that is only renamed into place on
+    # success, so a killed run never looks finished
+    def partial_path(self):
+        return self.output_path + ".partial"
+
+    # shell command that runs the simulator on a trace from stdin
+    def sim_command(self):
+        env = "".join("{}={} ".format(name, value) for name, value in sorted(self.env.items()))
+        return env + self.exe_path + " " + " ".join(self.dpc_options) + " > " + self.partial_path()
+
+    def finish(self, ok):
+        if not ok:
+            return False
+        os.rename(self.partial_path(), self.output_path)
+        self.ipc = self.read_ipc()
+        if self.ipc is None:
+            os.remove(self.output_path)
+            return False
+        return True
+
+    # runs the simulation once, with its own trace reader
+    def run_once(self):
+        with open(self.partial_path(), "w") as output, open(os.devnull, "w") as devnull:
+            # the simulator stops reading once it is done, so zcat's broken pipe is expected
+            zcat = subprocess.Popen(self.reader, stdout=subprocess.PIPE, stderr=devnull)
+            sim = subprocess.Popen([self.exe_path] + self.dpc_options, stdin=zcat.stdout, stdout=output,
+                                   env=dict(os.environ, **self.env))
+            zcat.stdout.close()
+            sim.wait()
+            zcat.wait()
+
+        return self.finish(sim.returncode == 0)
+
+    def record(self):
+        record = {
+            "exe"      : self.exe,
+            "trace"    : self.trace.split('_')[0],
+            "config"   : self.config,
+            "degree"   : self.degree,
+            "file"     : self.output_path,
+            "status"   : self.status,
+            "attempts" : self.attempts,
+            "seconds"  : round(self.seconds, 1),
+            "ipc"      : self.ipc,
+            }
+        if self.sample is not None:
+            record["sample"] = self.sample.index
+            record["weight"] = self.sample.weight
+        if self.stats_path is not None:
+            record["stats"] = self.stats_path
+        return record
+
+#########################################################################################
+# bounded pool of local workers
+#########################################################################################
+# runs jobs that share a trace and config once, with one zcat fanned out to
+# every simulator through trace_fanout, returns the jobs that failed
+def run_fanout(group, args):
+    with open(os.devnull, "w") as devnull:
+        zcat = subprocess.Popen(group[0].reader, stdout=subprocess.PIPE, stderr=devnull)
+        fanout = subprocess.Popen([args.fanoutPath] + [job.sim_command() for job in group], stdin=zcat.stdout)
+        zcat.stdout.close()
+        fanout.wait()
+        zcat.wait()
+
+    # trace_fanout only reports that some command failed, so judge each result on its own
+    return [job for job in group if not job.finish(os.path.exists(job.partial_path()))]
+
+def run_group(group, args):
+    if args.fanout:
+        return run_fanout(group, args)
+    return [job for job in group if not job.run_once()]
+
+def worker(pending, args, lock, progress):
+    while True:
+        try:
+            group = pending.get_nowait()
+        except queue.Empty:
+            return
+
+        start = time.time()
+        remaining = group
+        attempt = 0
+        while remaining and attempt <= args.retries:
+            attempt += 1
+            for job in remaining:
+                job.attempts += 1
+            remaining = run_group(remaining, args)
+        seconds = time.time() - start
+
+        with lock:
+            for job in group:
+                job.status = "failed" if job in remaining else "done"
+                job.seconds = seconds
+                progress[0] += 1
+                print("[{}/{}] {} {} {}: {} ipc {} ({} attempts, {:.0f}s)".format(
+                    progress[0], progress[1], job.exe, job.trace.split('_')[0], job.config,
+                    job.status, job.ipc, job.attempts, job.seconds))
+            sys.stdout.flush()
+
+# jobs on the same trace and config, which can share one trace_fanout
+def group_jobs(jobs):
+    keys = []
+    groups = []
+    for job in jobs:
+        key = (job.trace, job.config, job.sample.index if job.sample else None)
+        if key not in keys:
+            keys.append(key)
+            groups.append([])
+        groups[keys.index(key)].append(job)
+
+    return groups
+
+def run_jobs(jobs, args):
+    groups = group_jobs(jobs) if args.fanout else [[job] for job in jobs]
+
+    pending = queue.Queue()
+    for group in groups:
+        pending.put(group)
+
+    lock = threading.Lock()
+    progress = [0, len(jobs)]
+    threads = []
+    for i in range(min(args.jobs, len(groups))):
+        thread = threading.Thread(target=worker, args=(pending, args, lock, progress))
+        thread.start()
+        threads.append(thread)
+    for thread in threads:
+        thread.join()
+
+#########################################################################################
+# results index, one record per job in the matrix
+#########################################################################################
+def write_index(jobs, args):
+    index_path = os.path.join(args.outputDir, INDEX_FILENAME)
+    with open(index_path, "w") as index:
+        json.dump([job.record() for job in jobs], index, indent=1, sort_keys=True)
+    print("Results index written to " + index_path)
+
+#########################################################################################
+# weighted IPC of sampled jobs, one summary file per executable x trace x config
+#########################################################################################
+def write_sampled(jobs):
+    runs = []
+    for job in jobs:
+        if job.sample is not None and job.full_output_path not in [run[0].full_output_path for run in runs]:
+            runs.append([other for other in jobs if other.full_output_path == job.full_output_path])
+
+    for run in runs:
+        first = run[0]
+        if any(job.ipc is None for job in run):
+            continue
+
+        # intervals are the same length, so their cycles add up as weighted CPIs
+        cpi = sum(job.sample.weight/job.ipc for job in run)/sum(job.sample.weight for job in run)
+        ipc = 1.0/cpi
+
+        # compare against a full run, if there is one
+        full = read_ipc(first.full_output_path)
+
+        with open(first.full_output_path + "_sampled", "w") as summary:
+            for job in sorted(run, key=lambda job: job.sample.index):
+                summary.write("Interval {} weight {:.6f} IPC: {:.6f}\n".format(job.sample.index, job.sample.weight, job.ipc))
+            summary.write("Sampled IPC: {:.6f}\n".format(ipc))
+            if full is not None:
+                summary.write("Full IPC: {:.6f} Error: {:+.2f}%\n".format(full, 100.0*(ipc - full)/full))
+
+        print("{} {} {}: sampled ipc {:.6f} from {} intervals{}".format(
+            first.exe, first.trace.split('_')[0], first.config, ipc, len(run),
+            "" if full is None else ", full ipc {:.6f}, error {:+.2f}%".format(full, 100.0*(ipc - full)/full)))
+
 #########################################################################################
 # main function
 #########################################################################################
@@ -39,51 +476,81 @@ def main(argv):
     #parse arguments
     parser = process_options()
     args = parser.parse_args()
+    args.config = flatten(args.config) or CONFIG_ORDER
     sanity_check(args)
-    
+
     current_dir = os.getcwd()
 
     #compile files
-    source_dir = os.path.join(current_dir, 'example_prefetchers')
-    sources = os.listdir (source_dir)
-    for source in sources:
-        output = source.split('_')[0]
-        command = (
-            'gcc -Wall -o dpc2sim_' + output +
-            ' example_prefetchers/'+ source + ' lib/dpc2sim.a'
-            )
-        print command
-        os.system(command)
+    if args.noCompile:
+        executables = sorted(name for name in os.listdir(current_dir) if name.startswith('dpc2sim_'))
+    else:
+        executables = compile_prefetchers(current_dir, args)
+    if flatten(args.exe) is not None:
+        executables = flatten(args.exe)
+    if args.fanout:
+        args.fanoutPath = compile_fanout(current_dir, args)
 
     #make results dir if not exist
     if not os.path.exists(args.outputDir):
-        os.makedirs(args.outputDir)    
+        os.makedirs(args.outputDir)
 
     #find traces
     trace_dir = os.path.join(current_dir, 'traces' )
-    traces = os.listdir (trace_dir)
+    traces = sorted(trace for trace in os.listdir(trace_dir) if trace.endswith(TRACE_SUFFIXES))
+    # a converted trace replaces the .dpc.gz it was made from
+    traces = [trace for trace in traces if not
+              (trace.endswith(".dpc.gz") and trace[:-len(".dpc.gz")] + COLUMNS_SUFFIX in traces)]
+    if any(trace.endswith(COLUMNS_SUFFIX) for trace in traces):
+        args.traceCatPath = compile_trace_cat(current_dir, args)
+    if flatten(args.trace) is not None:
+        wanted = flatten(args.trace)
+        traces = [trace for trace in traces if trace.split('_')[0] in wanted or trace in wanted]
 
-    #dpc options - currently nothing
-    dpc_options = ["-hide_heartbeat"]
-    dpc_options = " ".join(dpc_options)
+    if args.sample:
+        args.simpointPath = compile_simpoint(current_dir, args)
+        samples = find_samples(current_dir, args, traces)
 
-    for dpc in args.exe[0]:
+    #build the matrix, skipping finished results
+    jobs = []
+    for dpc in executables:
         for trace in traces:
-            output_filename = "{}_{}_{}".format(dpc.split('_')[1], trace.split('_')[0], args.degree)
-            command = ( 
-                "zcat " + os.path.join(trace_dir, trace) + " | " + 
-                os.path.join(current_dir, dpc) + " " + dpc_options + " | tee " + 
-                os.path.join (current_dir, args.outputDir ,output_filename)
-                )
-            if args.dryRun:
-                print command
-            else:
-                #submitting to qsub
-                if args.submit:
-                    exit()
-                #run on current machine
+            for config in args.config:
+                if args.sample:
+                    for sample in samples[trace]:
+                        jobs.append(Job(current_dir, args, dpc, trace, config, sample))
                 else:
-                    os.system(command)
+                    jobs.append(Job(current_dir, args, dpc, trace, config))
+
+    to_run = []
+    for job in jobs:
+        job.ipc = job.read_ipc()
+        if job.ipc is not None and not args.rerun:
+            job.status = "done"
+        else:
+            to_run.append(job)
+
+    print("{} jobs, {} already done, running {} at a time".format(len(jobs), len(jobs) - len(to_run), args.jobs))
+
+    if args.dryRun:
+        if args.fanout:
+            for group in group_jobs(to_run):
+                print(" ".join(group[0].reader) + " | " + args.fanoutPath + " " +
+                      " ".join("'" + job.sim_command() + "'" for job in group))
+        else:
+            for job in to_run:
+                print(job.command())
+        return
+
+    run_jobs(to_run, args)
+    write_index(jobs, args)
+    if args.sample:
+        write_sampled(jobs)
+
+    failed = [job for job in jobs if job.status != "done"]
+    if failed:
+        print("ERROR: {} jobs failed".format(len(failed)))
+        exit(1)
 
 
 #########################################################################################
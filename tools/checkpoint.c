@@ -0,0 +1,349 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  Saves the simulator's state at the end of the warmup to a checkpoint file,
+  and starts later runs from that checkpoint instead of simulating the
+  warmup again, so that a sweep over one trace only pays for one warmup.
+
+  lib/dpc2sim.a keeps all of its state in global variables: the core, the
+  caches, the MSHRs, the uncore and the DRAM channels.  This file is linked
+  in next to the prefetcher, and the linker's --wrap option routes four of
+  the simulator's calls through the functions below:
+   - initialize_cpus(), which main() calls once before the first
+     instruction, loads the checkpoint and skips the trace up to the
+     instruction it was taken at
+   - add_to_instruction_window(), which main() calls once per instruction,
+     saves the checkpoint once the warmup is complete
+   - srand() and rand(), so that the random number state is in the
+     checkpoint too
+
+  The prefetcher's own state is only in the checkpoint if the prefetcher
+  defines the optional l2_prefetcher_checkpoint() (see inc/prefetcher.h).
+  Otherwise it starts cold after a checkpoint is loaded.
+
+  How to compile:
+
+  gcc -Wall -o dpc2sim example_prefetchers/stream_prefetcher.c tools/checkpoint.c lib/dpc2sim.a -Wl,--wrap=initialize_cpus,--wrap=add_to_instruction_window,--wrap=srand,--wrap=rand
+
+  It can be linked together with tools/trace_mmap.c,
+  tools/functional_warmup.c, whose functional warmup is then part of the
+  saved checkpoint, tools/mlc.c and tools/llc.c, whose replacement state
+  is saved too, and tools/memory_controller.c, whose DRAM state is saved
+  too.
+
+  How to run:
+
+  zcat traces/lbm_trace2.dpc.gz | CHECKPOINT_SAVE=lbm.ckpt ./dpc2sim
+  zcat traces/lbm_trace2.dpc.gz | CHECKPOINT_LOAD=lbm.ckpt ./dpc2sim
+
+  The first run simulates as usual and also saves the checkpoint.  The
+  second reads and drops the warmup instructions from the trace, loads the
+  checkpoint, and goes straight to the measured region, which starts one
+  instruction later than in the first run.  The checkpoint keeps the warmup
+  length, and the knobs it was saved with must be passed to the second run
+  too.  A checkpoint only fits the simulator library and the prefetcher it
+  was saved with, except that it can be loaded into a prefetcher without
+  l2_prefetcher_checkpoint(), which then starts cold.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define CHECKPOINT_MAGIC "DPC2CKP1"
+#define CHECKPOINT_MAGIC_SIZE 8
+
+// size of the random number state, as used by glibc's rand()
+#define CHECKPOINT_RANDOM_STATE_SIZE 128
+
+// where the core keeps its retired instruction count
+#define OOO_CPU_RETIRED_OFFSET 16
+
+// the simulator's state, with the sizes it has in lib/dpc2sim.a
+extern unsigned char ooo_cpu[];
+extern unsigned char uncore[];
+extern unsigned char dcu_cache[];
+extern unsigned char mlc_cache[];
+extern unsigned char mlc_mshr[];
+extern unsigned char llc_cache[];
+extern unsigned char dram_channel[];
+
+extern int knob_low_bandwidth;
+extern int knob_small_llc;
+extern int knob_scramble_loads;
+extern long long int warmup_instructions;
+
+typedef struct checkpoint_region
+{
+  const char *name;
+  unsigned char *data;
+  unsigned long long int size;
+} checkpoint_region_t;
+
+checkpoint_region_t checkpoint_regions[] =
+  {
+    { "ooo_cpu", ooo_cpu, 0x9c270 },
+    { "uncore", uncore, 0x1830 },
+    { "dcu_cache", dcu_cache, 0x2800 },
+    { "mlc_cache", mlc_cache, 0x14000 },
+    { "mlc_mshr", mlc_mshr, 0x100 },
+    { "llc_cache", llc_cache, 0xa0000 },
+    { "dram_channel", dram_channel, 0x70 },
+  };
+
+#define CHECKPOINT_REGION_COUNT (sizeof(checkpoint_regions)/sizeof(checkpoint_region_t))
+
+typedef struct checkpoint_header
+{
+  char magic[CHECKPOINT_MAGIC_SIZE];
+
+  // instructions read from the trace when the checkpoint was saved
+  unsigned long long int instructions;
+
+  long long int warmup_instructions;
+  int knob_low_bandwidth;
+  int knob_small_llc;
+  int knob_scramble_loads;
+
+  // 1 if the prefetcher's state follows the simulator's
+  int has_prefetcher;
+} checkpoint_header_t;
+
+// the prefetcher's optional hook
+void l2_prefetcher_checkpoint(int cpu_num, void (*region)(void *data, unsigned long long int size)) __attribute__((weak));
+
+// the replacement state of tools/mlc.c and tools/llc.c, if they are linked in
+void mlc_checkpoint(void (*region)(void *data, unsigned long long int size)) __attribute__((weak));
+void llc_checkpoint(void (*region)(void *data, unsigned long long int size)) __attribute__((weak));
+
+// the DRAM state of tools/memory_controller.c, if it is linked in
+void mc_checkpoint(void (*region)(void *data, unsigned long long int size)) __attribute__((weak));
+
+// instructions read by tools/functional_warmup.c, if it is linked in
+extern unsigned long long int functional_warmup_instructions __attribute__((weak));
+
+void __real_initialize_cpus();
+void __real_add_to_instruction_window(void *instruction, int cpu_num);
+
+// rand() and srand() use this state instead of glibc's hidden one
+struct random_data checkpoint_random;
+char checkpoint_random_state[CHECKPOINT_RANDOM_STATE_SIZE];
+
+// instructions passed to add_to_instruction_window() so far, counting those skipped by a loaded checkpoint
+unsigned long long int checkpoint_instructions;
+int checkpoint_saved;
+
+// the file being saved to or loaded from
+FILE *checkpoint_file;
+const char *checkpoint_filename;
+
+void checkpoint_fail(const char *message)
+{
+  printf("Checkpoint %s: %s. Exiting.\n", checkpoint_filename, message);
+  exit(1);
+}
+
+// each region is stored after its size, so that a checkpoint from a different prefetcher is caught
+void checkpoint_write(void *data, unsigned long long int size)
+{
+  if((fwrite(&size, sizeof(size), 1, checkpoint_file) != 1) ||
+     (fwrite(data, 1, size, checkpoint_file) != size))
+    {
+      checkpoint_fail("could not write");
+    }
+}
+
+void checkpoint_read(void *data, unsigned long long int size)
+{
+  unsigned long long int saved_size;
+  if(fread(&saved_size, sizeof(saved_size), 1, checkpoint_file) != 1)
+    {
+      checkpoint_fail("truncated");
+    }
+  if(saved_size != size)
+    {
+      checkpoint_fail("saved with a different simulator or prefetcher");
+    }
+  if(fread(data, 1, size, checkpoint_file) != size)
+    {
+      checkpoint_fail("truncated");
+    }
+}
+
+// writes or reads everything after the header
+void checkpoint_state(void (*region)(void *data, unsigned long long int size), int has_prefetcher)
+{
+  unsigned int i;
+  for(i=0; i<CHECKPOINT_REGION_COUNT; i++)
+    {
+      region(checkpoint_regions[i].data, checkpoint_regions[i].size);
+    }
+
+  // the random state is stored as offsets into checkpoint_random_state
+  int front = checkpoint_random.fptr - (int32_t *)checkpoint_random_state;
+  int rear = checkpoint_random.rptr - (int32_t *)checkpoint_random_state;
+  region(checkpoint_random_state, CHECKPOINT_RANDOM_STATE_SIZE);
+  region(&front, sizeof(front));
+  region(&rear, sizeof(rear));
+  if((front < 0) || (front*sizeof(int32_t) >= CHECKPOINT_RANDOM_STATE_SIZE) ||
+     (rear < 0) || (rear*sizeof(int32_t) >= CHECKPOINT_RANDOM_STATE_SIZE))
+    {
+      checkpoint_fail("corrupt random state");
+    }
+  checkpoint_random.fptr = (int32_t *)checkpoint_random_state + front;
+  checkpoint_random.rptr = (int32_t *)checkpoint_random_state + rear;
+
+  if(mlc_checkpoint)
+    {
+      mlc_checkpoint(region);
+    }
+  if(llc_checkpoint)
+    {
+      llc_checkpoint(region);
+    }
+  if(mc_checkpoint)
+    {
+      mc_checkpoint(region);
+    }
+
+  if(has_prefetcher)
+    {
+      l2_prefetcher_checkpoint(0, region);
+    }
+}
+
+void checkpoint_save()
+{
+  checkpoint_file = fopen(checkpoint_filename, "wb");
+  if(checkpoint_file == NULL)
+    {
+      checkpoint_fail("could not create");
+    }
+
+  checkpoint_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE);
+  header.instructions = checkpoint_instructions;
+  if(&functional_warmup_instructions != NULL)
+    {
+      header.instructions += functional_warmup_instructions;
+    }
+  header.warmup_instructions = warmup_instructions;
+  header.knob_low_bandwidth = knob_low_bandwidth;
+  header.knob_small_llc = knob_small_llc;
+  header.knob_scramble_loads = knob_scramble_loads;
+  header.has_prefetcher = (l2_prefetcher_checkpoint != NULL);
+
+  checkpoint_write(&header, sizeof(header));
+  checkpoint_state(checkpoint_write, header.has_prefetcher);
+  if(fclose(checkpoint_file) != 0)
+    {
+      checkpoint_fail("could not write");
+    }
+
+  printf("Checkpoint saved to %s after %llu instructions\n", checkpoint_filename, checkpoint_instructions);
+}
+
+void checkpoint_load()
+{
+  checkpoint_file = fopen(checkpoint_filename, "rb");
+  if(checkpoint_file == NULL)
+    {
+      checkpoint_fail("could not open");
+    }
+
+  // the functional warmup has already read the start of the trace
+  if((&functional_warmup_instructions != NULL) && (functional_warmup_instructions != 0))
+    {
+      checkpoint_fail("cannot be loaded after a functional warmup");
+    }
+
+  checkpoint_header_t header;
+  checkpoint_read(&header, sizeof(header));
+  if(memcmp(header.magic, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE))
+    {
+      checkpoint_fail("not a checkpoint");
+    }
+  if((header.knob_low_bandwidth != knob_low_bandwidth) ||
+     (header.knob_small_llc != knob_small_llc) ||
+     (header.knob_scramble_loads != knob_scramble_loads))
+    {
+      checkpoint_fail("saved with different knobs");
+    }
+
+  // a checkpoint saved without the prefetcher's state leaves it as l2_prefetcher_initialize() set it
+  int has_prefetcher = header.has_prefetcher && (l2_prefetcher_checkpoint != NULL);
+  checkpoint_state(checkpoint_read, has_prefetcher);
+  fclose(checkpoint_file);
+
+  // main() ends the warmup after the next instruction
+  warmup_instructions = header.warmup_instructions;
+
+  unsigned char record[48];
+  for(checkpoint_instructions=0; checkpoint_instructions<header.instructions; checkpoint_instructions++)
+    {
+      if(fread(record, sizeof(record), 1, stdin) != 1)
+	{
+	  checkpoint_fail("the trace is shorter than the warmup");
+	}
+    }
+
+  printf("Checkpoint loaded from %s, skipped %llu instructions%s\n", checkpoint_filename, checkpoint_instructions,
+	 has_prefetcher ? "" : ", prefetcher state starts cold");
+}
+
+void __wrap_srand(unsigned int seed)
+{
+  initstate_r(seed, checkpoint_random_state, CHECKPOINT_RANDOM_STATE_SIZE, &checkpoint_random);
+}
+
+int __wrap_rand()
+{
+  int32_t result;
+  random_r(&checkpoint_random, &result);
+
+  return result;
+}
+
+void __wrap_initialize_cpus()
+{
+  // like glibc, rand() without srand() behaves as if seeded with 1
+  initstate_r(1, checkpoint_random_state, CHECKPOINT_RANDOM_STATE_SIZE, &checkpoint_random);
+
+  __real_initialize_cpus();
+
+  checkpoint_filename = getenv("CHECKPOINT_LOAD");
+  if(checkpoint_filename != NULL)
+    {
+      checkpoint_load();
+      checkpoint_saved = 1;
+      return;
+    }
+
+  checkpoint_filename = getenv("CHECKPOINT_SAVE");
+  checkpoint_saved = (checkpoint_filename == NULL);
+}
+
+void __wrap_add_to_instruction_window(void *instruction, int cpu_num)
+{
+  if(!checkpoint_saved)
+    {
+      long long int retired;
+      memcpy(&retired, ooo_cpu + OOO_CPU_RETIRED_OFFSET, sizeof(retired));
+
+      // main() has just ended the warmup, and this instruction is the first after it
+      if(retired > warmup_instructions)
+	{
+	  checkpoint_save();
+	  checkpoint_saved = 1;
+	}
+    }
+
+  checkpoint_instructions++;
+  __real_add_to_instruction_window(instruction, cpu_num);
+}
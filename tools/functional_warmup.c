@@ -0,0 +1,378 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  Warms the caches and the prefetcher functionally over the start of the
+  trace, before the simulator's detailed warmup and measured region, so a
+  long warmup window does not have to go through the timing model.
+
+  During the functional warmup each load and store only updates the cache
+  tags and LRU state, through the simulator's own dcu_*, mlc_* and llc_*
+  functions.  A load or store that misses the DCU calls the prefetcher's
+  l2_prefetcher_operate(), and a line filled into the L2 calls
+  l2_cache_fill(), like in the detailed simulation.  The prefetches it
+  issues are filled at once, after l2_prefetcher_operate() returns.  There
+  are no queues, MSHRs or DRAM timing, and no instructions retire.  The
+  core and uncore clocks advance by one cycle per instruction, so that LRU
+  state and get_current_cycle() keep moving.
+
+  This file is linked in next to the prefetcher, and the linker's --wrap
+  option routes two of the simulator's calls through the functions below:
+   - initialize_llc(), the last cache the simulator sets up, after which
+     the functional warmup runs on the first instructions of the trace
+   - l2_prefetch_line(), which fills the line at once during the
+     functional warmup, and goes to the simulator after it
+
+  How to compile:
+
+  gcc -Wall -o dpc2sim example_prefetchers/stream_prefetcher.c tools/functional_warmup.c lib/dpc2sim.a -Wl,--wrap=initialize_llc,--wrap=l2_prefetch_line
+
+  It can be linked together with tools/trace_mmap.c, tools/checkpoint.c,
+  tools/mlc.c and tools/llc.c, whose replacement policies then also place
+  the lines the functional warmup fills.
+
+  How to run:
+
+  zcat traces/lbm_trace2.dpc.gz | FUNCTIONAL_WARMUP=50000000 ./dpc2sim -warmup_instructions 1000000
+
+  The first FUNCTIONAL_WARMUP instructions of the trace are warmed
+  functionally.  -warmup_instructions then counts the detailed warmup that
+  follows, which fills the pipeline and queues again.  The cycles the
+  functional warmup advanced show up in the warmup's IPC, but not in the
+  measured region's.  run.py --sampleFunctionalWarmup uses this before each
+  sampled interval.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../inc/prefetcher.h"
+
+// where the core and the uncore keep their cycle counts
+#define OOO_CPU_CYCLE_OFFSET 8
+#define UNCORE_CYCLE_OFFSET 0
+
+#define FUNCTIONAL_RECORD_SIZE 48
+#define FUNCTIONAL_READ_RECORDS 4096
+
+// prefetches issued by one l2_prefetcher_operate() call, more are rejected
+#define FUNCTIONAL_PREFETCH_COUNT 64
+
+// the caches' line layout in lib/dpc2sim.a
+typedef struct functional_line
+{
+  int valid;
+  unsigned long long int tag;
+  int dirty;
+  unsigned long long int lru;
+  unsigned long long int reserved;
+} functional_line_t;
+
+#define DCU_SETS 32
+#define DCU_WAYS 8
+#define MLC_SETS 256
+#define MLC_WAYS 8
+#define LLC_WAYS 16
+
+extern unsigned char ooo_cpu[];
+extern unsigned char uncore[];
+extern functional_line_t dcu_cache[][DCU_SETS][DCU_WAYS];
+extern functional_line_t mlc_cache[][MLC_SETS][MLC_WAYS];
+extern functional_line_t llc_cache[][LLC_WAYS];
+
+// the simulator's cache functions
+int dcu_get_set(unsigned long long int addr);
+int dcu_get_way(int cpu_num, unsigned long long int addr, int set);
+int dcu_get_eviction_way(int cpu_num, int set);
+void dcu_fill(int cpu_num, unsigned long long int addr, int set, int way);
+void dcu_update_lru(int cpu_num, int set, int way);
+void dcu_mark_dirty(int cpu_num, int set, int way);
+int dcu_check_invalidate_write_back(int cpu_num, unsigned long long int addr);
+void dcu_invalidate(int cpu_num, unsigned long long int addr);
+
+int mlc_get_set(unsigned long long int addr);
+int mlc_get_way(int cpu_num, unsigned long long int addr, int set);
+int mlc_get_eviction_way(int cpu_num, int set);
+unsigned long long int mlc_fill(int cpu_num, unsigned long long int addr, int set, int way);
+void mlc_update_lru(int cpu_num, int set, int way);
+void mlc_mark_dirty(int cpu_num, int set, int way);
+void mlc_invalidate(int cpu_num, unsigned long long int addr);
+
+// defined by tools/mlc.c, if it is linked in
+void mlc_insert(int cpu_num, int set, int way, int prefetch, unsigned long long int ip) __attribute__((weak));
+
+int llc_get_set(unsigned long long int addr);
+int llc_get_way(unsigned long long int addr, int set);
+int llc_get_eviction_way(int set);
+void llc_fill(unsigned long long int addr, int set, int way);
+void llc_update_lru(int set, int way);
+void llc_mark_dirty(int set, int way);
+
+// defined by tools/llc.c, if it is linked in
+void llc_insert(int set, int way, int prefetch, int fill_level, unsigned long long int ip) __attribute__((weak));
+
+unsigned long long int va_to_pa(unsigned long long int va);
+
+void __real_initialize_llc();
+int __real_l2_prefetch_line(int cpu_num, unsigned long long int base_addr, unsigned long long int pf_addr, int fill_level);
+
+typedef struct functional_prefetch
+{
+  unsigned long long int addr;
+  int fill_level;
+} functional_prefetch_t;
+
+// 1 while the functional warmup runs
+int functional_active;
+
+// prefetches waiting for the current l2_prefetcher_operate() call to return
+functional_prefetch_t functional_prefetches[FUNCTIONAL_PREFETCH_COUNT];
+int functional_prefetch_count;
+
+// instructions read from the trace by the functional warmup
+unsigned long long int functional_warmup_instructions;
+
+void functional_advance_clock()
+{
+  unsigned long long int cycle;
+  memcpy(&cycle, ooo_cpu + OOO_CPU_CYCLE_OFFSET, sizeof(cycle));
+  cycle++;
+  memcpy(ooo_cpu + OOO_CPU_CYCLE_OFFSET, &cycle, sizeof(cycle));
+
+  memcpy(&cycle, uncore + UNCORE_CYCLE_OFFSET, sizeof(cycle));
+  cycle++;
+  memcpy(uncore + UNCORE_CYCLE_OFFSET, &cycle, sizeof(cycle));
+}
+
+// a dirty line written back from an upper level only marks the line below it dirty
+void functional_mark_dirty(unsigned long long int cl_addr, int mlc)
+{
+  if(mlc)
+    {
+      int set = mlc_get_set(cl_addr);
+      int way = mlc_get_way(0, cl_addr, set);
+      if(way != -1)
+	{
+	  mlc_mark_dirty(0, set, way);
+	}
+    }
+  else
+    {
+      int set = llc_get_set(cl_addr);
+      int way = llc_get_way(cl_addr, set);
+      if(way != -1)
+	{
+	  llc_mark_dirty(set, way);
+	}
+    }
+}
+
+void functional_llc_access(unsigned long long int cl_addr, int prefetch, int fill_level, unsigned long long int ip)
+{
+  int set = llc_get_set(cl_addr);
+  int way = llc_get_way(cl_addr, set);
+  if(way == -1)
+    {
+      // the LLC is inclusive, so its victim leaves the L2 and the DCU too
+      way = llc_get_eviction_way(set);
+      if(llc_cache[set][way].valid)
+	{
+	  mlc_invalidate(0, llc_cache[set][way].tag);
+	  dcu_invalidate(0, llc_cache[set][way].tag);
+	}
+      llc_fill(cl_addr, set, way);
+      if(llc_insert)
+	{
+	  // tools/llc.c places the line by its replacement policy
+	  llc_insert(set, way, prefetch, fill_level, ip);
+	  return;
+	}
+    }
+  llc_update_lru(set, way);
+}
+
+// fills a line into the L2 from the LLC
+void functional_mlc_fill(unsigned long long int cl_addr, int set, int prefetch, unsigned long long int ip)
+{
+  functional_llc_access(cl_addr, prefetch, FILL_L2, ip);
+
+  // the L2 is inclusive of the DCU
+  int way = mlc_get_eviction_way(0, set);
+  unsigned long long int evicted_addr = 0;
+  if(mlc_cache[0][set][way].valid)
+    {
+      evicted_addr = mlc_cache[0][set][way].tag;
+      if(dcu_check_invalidate_write_back(0, evicted_addr) || mlc_cache[0][set][way].dirty)
+	{
+	  functional_mark_dirty(evicted_addr, 0);
+	}
+      dcu_invalidate(0, evicted_addr);
+    }
+
+  mlc_fill(0, cl_addr, set, way);
+  if(mlc_insert)
+    {
+      // tools/mlc.c places the line by its replacement policy
+      mlc_insert(0, set, way, prefetch, ip);
+    }
+  else
+    {
+      mlc_update_lru(0, set, way);
+    }
+
+  l2_cache_fill(0, cl_addr, set, way, prefetch, evicted_addr);
+}
+
+void functional_mlc_access(unsigned long long int addr, unsigned long long int ip)
+{
+  unsigned long long int cl_addr = (addr>>6)<<6;
+  int set = mlc_get_set(cl_addr);
+  int way = mlc_get_way(0, cl_addr, set);
+
+  functional_prefetch_count = 0;
+  l2_prefetcher_operate(0, addr, ip, way != -1);
+
+  if(way == -1)
+    {
+      functional_mlc_fill(cl_addr, set, 0, ip);
+    }
+  else
+    {
+      mlc_update_lru(0, set, way);
+    }
+
+  // prefetches arrive after the demand access that caused them
+  int i;
+  for(i=0; i<functional_prefetch_count; i++)
+    {
+      unsigned long long int pf_cl_addr = (functional_prefetches[i].addr>>6)<<6;
+      if(functional_prefetches[i].fill_level == FILL_LLC)
+	{
+	  functional_llc_access(pf_cl_addr, 1, FILL_LLC, 0);
+	}
+      else
+	{
+	  int pf_set = mlc_get_set(pf_cl_addr);
+	  if(mlc_get_way(0, pf_cl_addr, pf_set) == -1)
+	    {
+	      functional_mlc_fill(pf_cl_addr, pf_set, 1, 0);
+	    }
+	}
+    }
+  functional_prefetch_count = 0;
+}
+
+void functional_dcu_access(unsigned long long int addr, unsigned long long int ip, int store)
+{
+  unsigned long long int cl_addr = (addr>>6)<<6;
+  int set = dcu_get_set(cl_addr);
+  int way = dcu_get_way(0, cl_addr, set);
+  if(way == -1)
+    {
+      functional_mlc_access(addr, ip);
+
+      way = dcu_get_eviction_way(0, set);
+      if(dcu_cache[0][set][way].valid && dcu_cache[0][set][way].dirty)
+	{
+	  functional_mark_dirty(dcu_cache[0][set][way].tag, 1);
+	}
+      dcu_fill(0, cl_addr, set, way);
+    }
+  dcu_update_lru(0, set, way);
+
+  if(store)
+    {
+      dcu_mark_dirty(0, set, way);
+    }
+}
+
+void functional_warmup(unsigned long long int instructions)
+{
+  static unsigned char records[FUNCTIONAL_READ_RECORDS*FUNCTIONAL_RECORD_SIZE];
+
+  clock_t start = clock();
+  functional_active = 1;
+
+  while(functional_warmup_instructions < instructions)
+    {
+      size_t wanted = FUNCTIONAL_READ_RECORDS;
+      if(instructions - functional_warmup_instructions < wanted)
+	{
+	  wanted = instructions - functional_warmup_instructions;
+	}
+
+      size_t read_count = fread(records, FUNCTIONAL_RECORD_SIZE, wanted, stdin);
+      if(read_count == 0)
+	{
+	  break;
+	}
+
+      size_t r;
+      for(r=0; r<read_count; r++)
+	{
+	  // ip, register ids, the stored address, then up to three loaded addresses
+	  unsigned long long int words[6];
+	  memcpy(words, &records[r*FUNCTIONAL_RECORD_SIZE], sizeof(words));
+
+	  int m;
+	  for(m=3; m<6; m++)
+	    {
+	      if(words[m] != 0)
+		{
+		  functional_dcu_access(va_to_pa(words[m]), words[0], 0);
+		}
+	    }
+	  if(words[2] != 0)
+	    {
+	      functional_dcu_access(va_to_pa(words[2]), words[0], 1);
+	    }
+
+	  functional_advance_clock();
+	}
+
+      functional_warmup_instructions += read_count;
+    }
+
+  functional_active = 0;
+
+  double seconds = (double)(clock() - start)/CLOCKS_PER_SEC;
+  printf("Functional warmup complete. Instructions: %llu Seconds: %.2f Instructions per second: %.0f\n",
+	 functional_warmup_instructions, seconds, (seconds > 0) ? functional_warmup_instructions/seconds : 0.0);
+}
+
+void __wrap_initialize_llc()
+{
+  __real_initialize_llc();
+
+  const char *instructions = getenv("FUNCTIONAL_WARMUP");
+  if(instructions != NULL)
+    {
+      functional_warmup(strtoull(instructions, NULL, 10));
+    }
+}
+
+int __wrap_l2_prefetch_line(int cpu_num, unsigned long long int base_addr, unsigned long long int pf_addr, int fill_level)
+{
+  if(!functional_active)
+    {
+      return __real_l2_prefetch_line(cpu_num, base_addr, pf_addr, fill_level);
+    }
+
+  // the same checks the simulator makes, except for queue space
+  if(((base_addr>>12) != (pf_addr>>12)) ||
+     ((fill_level != FILL_L2) && (fill_level != FILL_LLC)) ||
+     (functional_prefetch_count == FUNCTIONAL_PREFETCH_COUNT))
+    {
+      return 0;
+    }
+
+  functional_prefetches[functional_prefetch_count].addr = pf_addr;
+  functional_prefetches[functional_prefetch_count].fill_level = fill_level;
+  functional_prefetch_count++;
+
+  return 1;
+}
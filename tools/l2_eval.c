@@ -0,0 +1,515 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  Evaluates many prefetchers in one pass over a recorded L2 event stream
+  (see tools/l2_record.c), without running the simulator.  Only the recorded
+  accesses are used, each prefetcher's fills come from its own shadow L2.
+
+  This generalises the sandbox idea of mix1_prefetcher.c: every prefetcher
+  sees the same access stream, against its own shadow copy of the L2, and
+  nothing it does affects the others.  Each prefetcher is built as a shared
+  object from its unchanged .c file and loaded with dlopen(), so each gets its
+  own copy of its global tables.  The functions of inc/prefetcher.h are
+  provided here, and answer for whichever prefetcher is being called.
+
+  How to compile:
+
+  gcc -Wall -O2 -rdynamic -o l2_eval tools/l2_eval.c -ldl
+  gcc -Wall -O2 -shared -fPIC -Wl,-Bsymbolic -o ampm_lite.so example_prefetchers/ampm_lite_prefetcher.c
+
+  -Bsymbolic makes a prefetcher use its own globals even when their names
+  clash with the C library (ampmE_ has a table called poll, for example), as
+  they would when it is linked statically against lib/dpc2sim.a.
+
+  How to run:
+
+  ./l2_eval lbm.l2s ampm_lite.so ip_stride.so ...
+
+  The shadow L2 has the geometry of the real one, with LRU replacement.
+  Demand misses fill it at once.  L2 prefetches take an L2 MSHR and fill it
+  PREFETCH_LATENCY cycles after they are issued, so a demand access to a line
+  still in flight counts as a late prefetch.  The read queue drains one
+  request per cycle.  LLC prefetches only record their line, and count as
+  useful if a demand miss asks for it later, though that miss still counts
+  against coverage.  All of this is a proxy for the real memory system, good
+  for ranking prefetchers and picking degrees, not for predicting IPC.
+
+  For each prefetcher, the report has:
+   - coverage: the fraction of the demand misses of a run without prefetching
+     that the prefetcher removed
+   - accuracy: the fraction of completed prefetches that a demand access used
+   - lateness: the fraction of useful prefetches that were still in flight
+   - the prefetches issued, rejected and found redundant
+
+  Options (before the stream file):
+
+  -latency <number>
+  Cycles from issuing an L2 prefetch to its fill.  Default is 200.
+
+  -max_accesses <number>
+  Stop after this many accesses.  Default is the whole stream.
+
+  -small_llc, -low_bandwidth, -scramble_loads
+  Set the knob seen by the prefetchers.  They have no other effect here.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include "../inc/prefetcher.h"
+#include "l2_stream.h"
+
+#define MAX_PLUGINS 64
+
+// cycles from issuing an L2 prefetch until it fills the shadow L2, by default
+#define PREFETCH_LATENCY 200
+
+// LLC prefetched lines, direct-mapped by line address, must be a power of two
+#define LLC_PREFETCH_COUNT 4096
+
+typedef struct shadow_line
+{
+  int valid;
+  unsigned long long int cl_address;
+
+  // prefetched and not yet used by a demand access
+  int prefetched;
+
+  unsigned long long int lru_cycle;
+} shadow_line_t;
+
+typedef struct inflight
+{
+  int valid;
+  unsigned long long int cl_address;
+  unsigned long long int ready_cycle;
+
+  // a demand access has already counted this prefetch as late
+  int late;
+} inflight_t;
+
+typedef struct plugin
+{
+  const char *name;
+
+  // NULL for the run without prefetching that coverage is measured against
+  void (*initialize)(int);
+  void (*operate)(int, unsigned long long int, unsigned long long int, int);
+  void (*cache_fill)(int, unsigned long long int, int, int, int, unsigned long long int);
+
+  shadow_line_t cache[L2_SET_COUNT][L2_ASSOCIATIVITY];
+  inflight_t inflight[L2_MSHR_COUNT];
+  unsigned long long int llc_prefetched[LLC_PREFETCH_COUNT];
+
+  int read_queue;
+  unsigned long long int read_queue_cycle;
+
+  unsigned long long int hits;
+  unsigned long long int misses;
+  unsigned long long int issued_l2;
+  unsigned long long int issued_llc;
+  unsigned long long int rejected;
+  unsigned long long int redundant;
+  unsigned long long int filled;
+  unsigned long long int useful;
+  unsigned long long int late;
+  unsigned long long int llc_useful;
+} plugin_t;
+
+plugin_t *plugins[MAX_PLUGINS+1];
+int plugin_count;
+
+// the prefetcher being called, and the cycle of the access being replayed
+plugin_t *current;
+unsigned long long int current_cycle;
+
+unsigned long long int prefetch_latency = PREFETCH_LATENCY;
+
+int knob_low_bandwidth;
+int knob_small_llc;
+int knob_scramble_loads;
+
+//
+// the functions of inc/prefetcher.h, answered for the current prefetcher
+//
+
+unsigned long long int get_current_cycle(int cpu_num)
+{
+  return current_cycle;
+}
+
+int get_l2_mshr_occupancy(int cpu_num)
+{
+  int occupancy = 0;
+  int i;
+  for(i=0; i<L2_MSHR_COUNT; i++)
+    {
+      occupancy += current->inflight[i].valid;
+    }
+
+  return occupancy;
+}
+
+int get_l2_read_queue_occupancy(int cpu_num)
+{
+  return current->read_queue;
+}
+
+int l2_get_set(unsigned long long int addr)
+{
+  return (addr>>6) & (L2_SET_COUNT-1);
+}
+
+int l2_get_way(int cpu_num, unsigned long long int addr, int set)
+{
+  int way;
+  for(way=0; way<L2_ASSOCIATIVITY; way++)
+    {
+      if(current->cache[set][way].valid && (current->cache[set][way].cl_address == (addr>>6)))
+	{
+	  return way;
+	}
+    }
+
+  return -1;
+}
+
+int llc_prefetch_index(unsigned long long int cl_address)
+{
+  return (cl_address ^ (cl_address>>12)) & (LLC_PREFETCH_COUNT-1);
+}
+
+int l2_prefetch_line(int cpu_num, unsigned long long int base_addr, unsigned long long int pf_addr, int fill_level)
+{
+  unsigned long long int cl_address = pf_addr>>6;
+
+  if(((base_addr>>12) != (pf_addr>>12)) || (current->read_queue >= L2_READ_QUEUE_SIZE))
+    {
+      current->rejected++;
+      return 0;
+    }
+
+  int set = l2_get_set(pf_addr);
+  if(l2_get_way(0, pf_addr, set) != -1)
+    {
+      // already in the L2, the prefetch costs a read queue slot but does nothing
+      current->read_queue++;
+      current->redundant++;
+      return 1;
+    }
+
+  if(fill_level == FILL_LLC)
+    {
+      current->read_queue++;
+      current->issued_llc++;
+      current->llc_prefetched[llc_prefetch_index(cl_address)] = cl_address;
+      return 1;
+    }
+
+  int free_index = -1;
+  int i;
+  for(i=0; i<L2_MSHR_COUNT; i++)
+    {
+      if(current->inflight[i].valid && (current->inflight[i].cl_address == cl_address))
+	{
+	  current->read_queue++;
+	  current->redundant++;
+	  return 1;
+	}
+      if(!current->inflight[i].valid)
+	{
+	  free_index = i;
+	}
+    }
+
+  if(free_index == -1)
+    {
+      // all L2 MSHRs are busy
+      current->rejected++;
+      return 0;
+    }
+
+  current->inflight[free_index].valid = 1;
+  current->inflight[free_index].cl_address = cl_address;
+  current->inflight[free_index].ready_cycle = current_cycle + prefetch_latency;
+  current->inflight[free_index].late = 0;
+
+  current->read_queue++;
+  current->issued_l2++;
+  return 1;
+}
+
+//
+// shadow L2
+//
+
+// puts a line into the shadow L2 and tells the prefetcher about it
+void shadow_fill(plugin_t *plugin, unsigned long long int cl_address, int prefetch)
+{
+  int set = cl_address & (L2_SET_COUNT-1);
+
+  int victim = 0;
+  int way;
+  for(way=0; way<L2_ASSOCIATIVITY; way++)
+    {
+      if(!plugin->cache[set][way].valid)
+	{
+	  victim = way;
+	  break;
+	}
+      if(plugin->cache[set][way].lru_cycle < plugin->cache[set][victim].lru_cycle)
+	{
+	  victim = way;
+	}
+    }
+
+  shadow_line_t *line = &plugin->cache[set][victim];
+  unsigned long long int evicted_addr = line->valid ? (line->cl_address<<6) : 0;
+
+  line->valid = 1;
+  line->cl_address = cl_address;
+  line->prefetched = prefetch;
+  line->lru_cycle = current_cycle;
+
+  if(plugin->cache_fill != NULL)
+    {
+      current = plugin;
+      plugin->cache_fill(0, cl_address<<6, set, victim, prefetch, evicted_addr);
+    }
+}
+
+// fills the L2 prefetches that have arrived by now
+void shadow_complete(plugin_t *plugin)
+{
+  int i;
+  for(i=0; i<L2_MSHR_COUNT; i++)
+    {
+      inflight_t *request = &plugin->inflight[i];
+      if(request->valid && (request->ready_cycle <= current_cycle))
+	{
+	  request->valid = 0;
+	  plugin->filled++;
+
+	  // a prefetch a demand access already waited on is not useful again
+	  shadow_fill(plugin, request->cl_address, !request->late);
+	}
+    }
+}
+
+void shadow_access(plugin_t *plugin, unsigned long long int addr, unsigned long long int ip)
+{
+  unsigned long long int cl_address = addr>>6;
+
+  shadow_complete(plugin);
+
+  // the read queue drains one request per cycle
+  unsigned long long int drained = current_cycle - plugin->read_queue_cycle;
+  plugin->read_queue = (drained >= (unsigned long long int)plugin->read_queue) ? 0 : plugin->read_queue - drained;
+  plugin->read_queue_cycle = current_cycle;
+
+  current = plugin;
+  int set = l2_get_set(addr);
+  int way = l2_get_way(0, addr, set);
+  int cache_hit = (way != -1);
+
+  if(cache_hit)
+    {
+      plugin->hits++;
+      plugin->cache[set][way].lru_cycle = current_cycle;
+      if(plugin->cache[set][way].prefetched)
+	{
+	  plugin->cache[set][way].prefetched = 0;
+	  plugin->useful++;
+	}
+    }
+  else
+    {
+      int inflight = 0;
+      int i;
+      for(i=0; i<L2_MSHR_COUNT; i++)
+	{
+	  inflight_t *request = &plugin->inflight[i];
+	  if(request->valid && (request->cl_address == cl_address))
+	    {
+	      inflight = 1;
+	      if(!request->late)
+		{
+		  request->late = 1;
+		  plugin->useful++;
+		  plugin->late++;
+		}
+	    }
+	}
+
+      if(!inflight)
+	{
+	  plugin->misses++;
+
+	  int index = llc_prefetch_index(cl_address);
+	  if(plugin->llc_prefetched[index] == cl_address)
+	    {
+	      plugin->llc_prefetched[index] = 0;
+	      plugin->llc_useful++;
+	    }
+
+	  shadow_fill(plugin, cl_address, 0);
+	}
+    }
+
+  if(plugin->operate != NULL)
+    {
+      current = plugin;
+      plugin->operate(0, addr, ip, cache_hit);
+    }
+}
+
+plugin_t *load_plugin(const char *path)
+{
+  plugin_t *plugin = calloc(1, sizeof(plugin_t));
+  if(plugin == NULL)
+    {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+  plugin->name = path;
+
+  if(path == NULL)
+    {
+      plugin->name = "(none)";
+      return plugin;
+    }
+
+  // dlopen only looks in the current directory for paths with a slash
+  char local_path[4096];
+  snprintf(local_path, sizeof(local_path), "%s%s", strchr(path, '/') ? "" : "./", path);
+
+  void *handle = dlopen(local_path, RTLD_NOW | RTLD_LOCAL);
+  if(handle == NULL)
+    {
+      fprintf(stderr, "Could not load %s: %s\n", path, dlerror());
+      exit(1);
+    }
+
+  plugin->initialize = dlsym(handle, "l2_prefetcher_initialize");
+  plugin->operate = dlsym(handle, "l2_prefetcher_operate");
+  plugin->cache_fill = dlsym(handle, "l2_cache_fill");
+  if((plugin->initialize == NULL) || (plugin->operate == NULL) || (plugin->cache_fill == NULL))
+    {
+      fprintf(stderr, "%s is not a prefetcher\n", path);
+      exit(1);
+    }
+
+  return plugin;
+}
+
+// percentage, or 0 when there is nothing to divide by
+double percent(unsigned long long int part, unsigned long long int whole)
+{
+  return (whole > 0) ? (100.0*part)/whole : 0.0;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long long int max_accesses = 0;
+
+  int arg = 1;
+  while((arg < argc) && (argv[arg][0] == '-'))
+    {
+      if(!strcmp(argv[arg], "-latency") && (arg+1 < argc))
+	{
+	  prefetch_latency = strtoull(argv[arg+1], NULL, 10);
+	  arg += 2;
+	}
+      else if(!strcmp(argv[arg], "-max_accesses") && (arg+1 < argc))
+	{
+	  max_accesses = strtoull(argv[arg+1], NULL, 10);
+	  arg += 2;
+	}
+      else if(!strcmp(argv[arg], "-small_llc"))
+	{
+	  knob_small_llc = 1;
+	  arg++;
+	}
+      else if(!strcmp(argv[arg], "-low_bandwidth"))
+	{
+	  knob_low_bandwidth = 1;
+	  arg++;
+	}
+      else if(!strcmp(argv[arg], "-scramble_loads"))
+	{
+	  knob_scramble_loads = 1;
+	  arg++;
+	}
+      else
+	{
+	  fprintf(stderr, "Unknown option %s\n", argv[arg]);
+	  return 1;
+	}
+    }
+
+  if((argc - arg < 2) || (argc - arg - 1 > MAX_PLUGINS))
+    {
+      fprintf(stderr, "Usage: %s [options] <stream file> <prefetcher.so> [<prefetcher.so> ...]\n", argv[0]);
+      return 1;
+    }
+
+  l2_stream_t *stream = l2_stream_open(argv[arg]);
+  if(stream == NULL)
+    {
+      fprintf(stderr, "Could not open L2 stream %s\n", argv[arg]);
+      return 1;
+    }
+
+  // plugin 0 does no prefetching, the others are measured against it
+  plugins[0] = load_plugin(NULL);
+  plugin_count = 1;
+  int i;
+  for(i=arg+1; i<argc; i++)
+    {
+      plugins[plugin_count] = load_plugin(argv[i]);
+      current = plugins[plugin_count];
+      current->initialize(0);
+      plugin_count++;
+    }
+
+  l2_event_t event;
+  unsigned long long int access_count = 0;
+  while(((max_accesses == 0) || (access_count < max_accesses)) && l2_stream_read(stream, &event))
+    {
+      if(event.type != L2_EVENT_OPERATE)
+	{
+	  continue;
+	}
+
+      current_cycle = event.cycle;
+      for(i=0; i<plugin_count; i++)
+	{
+	  shadow_access(plugins[i], event.addr, event.ip);
+	}
+      access_count++;
+    }
+  l2_stream_close(stream);
+
+  unsigned long long int base_misses = plugins[0]->misses;
+  printf("\n%llu L2 accesses, %llu misses without prefetching, %llu cycle prefetch latency\n\n", access_count, base_misses, prefetch_latency);
+  printf("%-32s %9s %9s %9s %12s %12s %12s %12s\n", "prefetcher", "coverage", "accuracy", "lateness", "issued_l2", "issued_llc", "rejected", "redundant");
+  for(i=1; i<plugin_count; i++)
+    {
+      plugin_t *plugin = plugins[i];
+
+      // LLC prefetches are useful when a miss finds them, they never fill the L2
+      unsigned long long int covered = (base_misses > plugin->misses) ? base_misses - plugin->misses : 0;
+      double accuracy = percent(plugin->useful + plugin->llc_useful, plugin->filled + plugin->issued_llc);
+
+      printf("%-32s %8.1f%% %8.1f%% %8.1f%% %12llu %12llu %12llu %12llu\n", plugin->name,
+	     percent(covered, base_misses), accuracy, percent(plugin->late, plugin->useful),
+	     plugin->issued_l2, plugin->issued_llc, plugin->rejected, plugin->redundant);
+    }
+
+  return 0;
+}
@@ -0,0 +1,111 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  Records the L2 event stream of a simulator run, for offline evaluation with
+  tools/l2_eval.c or replay into a single prefetcher with tools/l2_replay.c.
+
+  This file wraps a prefetcher .c file: the prefetcher runs as usual, and every
+  call to l2_prefetcher_operate() and l2_cache_fill() is also appended to a
+  stream file, with the cycle and the L2 MSHR and read queue occupancy (see
+  tools/l2_stream.h).  The file name is taken from the L2_STREAM environment
+  variable, and defaults to l2_stream.bin.
+
+  How to compile, e.g. to record the demand stream with no prefetching:
+
+  gcc -Wall -o dpc2sim_record -DPREFETCHER='"../example_prefetchers/no_prefetcher.c"' tools/l2_record.c lib/dpc2sim.a
+
+  How to run:
+
+  zcat trace.dpc.gz | L2_STREAM=lbm.l2s ./dpc2sim_record
+
+  The recorded hits, fills and cycles are those of the run with the wrapped
+  prefetcher, so record with the prefetcher whose L2 behaviour you want to
+  evaluate against, normally the no prefetcher.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../inc/prefetcher.h"
+#include "l2_stream.h"
+
+#ifndef PREFETCHER
+#error "Define PREFETCHER as the path of the prefetcher .c file to record with"
+#endif
+
+// the wrapped prefetcher's entry points get renamed, so the ones below can call them
+#define l2_prefetcher_initialize recorded_l2_prefetcher_initialize
+#define l2_prefetcher_operate recorded_l2_prefetcher_operate
+#define l2_cache_fill recorded_l2_cache_fill
+#include PREFETCHER
+#undef l2_prefetcher_initialize
+#undef l2_prefetcher_operate
+#undef l2_cache_fill
+
+l2_stream_t *record_stream;
+
+void record_close()
+{
+  if(record_stream != NULL)
+    {
+      l2_stream_close(record_stream);
+      record_stream = NULL;
+    }
+}
+
+void l2_prefetcher_initialize(int cpu_num)
+{
+  const char *filename = getenv("L2_STREAM");
+  if(filename == NULL)
+    {
+      filename = "l2_stream.bin";
+    }
+
+  record_stream = l2_stream_create(filename);
+  if(record_stream == NULL)
+    {
+      fprintf(stderr, "Could not create L2 stream file %s\n", filename);
+      exit(1);
+    }
+  printf("Recording L2 accesses to %s\n", filename);
+
+  // the simulator exits without telling the prefetcher, so flush on exit
+  atexit(record_close);
+
+  recorded_l2_prefetcher_initialize(cpu_num);
+}
+
+void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned long long int ip, int cache_hit)
+{
+  l2_event_t event;
+  event.type = L2_EVENT_OPERATE;
+  event.cycle = get_current_cycle(0);
+  event.addr = addr;
+  event.mshr_occupancy = get_l2_mshr_occupancy(0);
+  event.read_queue_occupancy = get_l2_read_queue_occupancy(0);
+  event.ip = ip;
+  event.cache_hit = cache_hit;
+  l2_stream_write(record_stream, &event);
+
+  recorded_l2_prefetcher_operate(cpu_num, addr, ip, cache_hit);
+}
+
+void l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, int prefetch, unsigned long long int evicted_addr)
+{
+  l2_event_t event;
+  event.type = L2_EVENT_FILL;
+  event.cycle = get_current_cycle(0);
+  event.addr = addr;
+  event.mshr_occupancy = get_l2_mshr_occupancy(0);
+  event.read_queue_occupancy = get_l2_read_queue_occupancy(0);
+  event.set = set;
+  event.way = way;
+  event.prefetch = prefetch;
+  event.evicted_addr = evicted_addr;
+  l2_stream_write(record_stream, &event);
+
+  recorded_l2_cache_fill(cpu_num, addr, set, way, prefetch, evicted_addr);
+}
@@ -0,0 +1,250 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  Replays a recorded L2 event stream (see tools/l2_record.c) into one
+  prefetcher, without running the simulator, so that a prefetcher's tables
+  can be tuned at the speed of reading the stream.
+
+  This file wraps a prefetcher .c file, and stands in for lib/dpc2sim.a.
+  Every recorded l2_prefetcher_operate() and l2_cache_fill() call is made
+  again, in order.  While a call runs, get_current_cycle(),
+  get_l2_mshr_occupancy() and get_l2_read_queue_occupancy() return the
+  recorded values, raised by the prefetches issued during the call.  The L2
+  contents seen through l2_get_way() are rebuilt from the recorded fills.
+
+  How to compile:
+
+  gcc -Wall -O2 -o replay_ampm -DPREFETCHER='"../example_prefetchers/ampm_lite_prefetcher.c"' tools/l2_replay.c
+
+  How to run:
+
+  ./replay_ampm lbm.l2s
+
+  The recorded accesses and fills do not change with what the prefetcher
+  does, so the report counts the prefetches issued, rejected and redundant,
+  and how many prefetched lines the recorded accesses went on to use.  For a
+  measure of coverage against a shadow L2, use tools/l2_eval.c.
+
+  Options (before the stream file):
+
+  -max_accesses <number>
+  Stop after this many accesses.  Default is the whole stream.
+
+  -small_llc, -low_bandwidth, -scramble_loads
+  Set the knob seen by the prefetcher.  They have no other effect here.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../inc/prefetcher.h"
+#include "l2_stream.h"
+
+#ifndef PREFETCHER
+#error "Define PREFETCHER as the path of the prefetcher .c file to replay into"
+#endif
+
+// lines prefetched and not yet accessed, direct-mapped by line address, must be a power of two
+#define PREFETCHED_COUNT 65536
+
+int knob_low_bandwidth;
+int knob_small_llc;
+int knob_scramble_loads;
+
+// the event being replayed
+l2_event_t replay_event;
+
+// prefetches issued while replaying the current event
+int replay_event_read_queue;
+int replay_event_mshr;
+
+// the L2 contents, rebuilt from the recorded fills
+unsigned long long int replay_tags[L2_SET_COUNT][L2_ASSOCIATIVITY];
+
+unsigned long long int replay_prefetched_lines[PREFETCHED_COUNT];
+
+unsigned long long int replay_issued_l2;
+unsigned long long int replay_issued_llc;
+unsigned long long int replay_rejected;
+unsigned long long int replay_redundant;
+unsigned long long int replay_used;
+
+unsigned long long int get_current_cycle(int cpu_num)
+{
+  return replay_event.cycle;
+}
+
+int get_l2_mshr_occupancy(int cpu_num)
+{
+  int occupancy = replay_event.mshr_occupancy + replay_event_mshr;
+
+  return (occupancy > L2_MSHR_COUNT) ? L2_MSHR_COUNT : occupancy;
+}
+
+int get_l2_read_queue_occupancy(int cpu_num)
+{
+  int occupancy = replay_event.read_queue_occupancy + replay_event_read_queue;
+
+  return (occupancy > L2_READ_QUEUE_SIZE) ? L2_READ_QUEUE_SIZE : occupancy;
+}
+
+int l2_get_set(unsigned long long int addr)
+{
+  return (addr>>6) & (L2_SET_COUNT-1);
+}
+
+int l2_get_way(int cpu_num, unsigned long long int addr, int set)
+{
+  int way;
+  for(way=0; way<L2_ASSOCIATIVITY; way++)
+    {
+      if(replay_tags[set][way] == (addr>>6))
+	{
+	  return way;
+	}
+    }
+
+  return -1;
+}
+
+int replay_prefetched_index(unsigned long long int cl_address)
+{
+  return (cl_address ^ (cl_address>>16)) & (PREFETCHED_COUNT-1);
+}
+
+int l2_prefetch_line(int cpu_num, unsigned long long int base_addr, unsigned long long int pf_addr, int fill_level)
+{
+  if(((base_addr>>12) != (pf_addr>>12)) ||
+     (get_l2_read_queue_occupancy(0) >= L2_READ_QUEUE_SIZE) ||
+     ((fill_level == FILL_L2) && (get_l2_mshr_occupancy(0) >= L2_MSHR_COUNT)))
+    {
+      replay_rejected++;
+      return 0;
+    }
+
+  replay_event_read_queue++;
+  if(fill_level == FILL_L2)
+    {
+      replay_event_mshr++;
+      replay_issued_l2++;
+    }
+  else
+    {
+      replay_issued_llc++;
+    }
+
+  unsigned long long int cl_address = pf_addr>>6;
+  if(l2_get_way(0, pf_addr, l2_get_set(pf_addr)) != -1)
+    {
+      replay_redundant++;
+    }
+  else
+    {
+      replay_prefetched_lines[replay_prefetched_index(cl_address)] = cl_address;
+    }
+
+  return 1;
+}
+
+#include PREFETCHER
+
+// percentage, or 0 when there is nothing to divide by
+double replay_percent(unsigned long long int part, unsigned long long int whole)
+{
+  return (whole > 0) ? (100.0*part)/whole : 0.0;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long long int max_accesses = 0;
+
+  int arg = 1;
+  while((arg < argc) && (argv[arg][0] == '-'))
+    {
+      if(!strcmp(argv[arg], "-max_accesses") && (arg+1 < argc))
+	{
+	  max_accesses = strtoull(argv[arg+1], NULL, 10);
+	  arg += 2;
+	}
+      else if(!strcmp(argv[arg], "-small_llc"))
+	{
+	  knob_small_llc = 1;
+	  arg++;
+	}
+      else if(!strcmp(argv[arg], "-low_bandwidth"))
+	{
+	  knob_low_bandwidth = 1;
+	  arg++;
+	}
+      else if(!strcmp(argv[arg], "-scramble_loads"))
+	{
+	  knob_scramble_loads = 1;
+	  arg++;
+	}
+      else
+	{
+	  fprintf(stderr, "Unknown option %s\n", argv[arg]);
+	  return 1;
+	}
+    }
+
+  if(argc - arg != 1)
+    {
+      fprintf(stderr, "Usage: %s [options] <stream file>\n", argv[0]);
+      return 1;
+    }
+
+  l2_stream_t *stream = l2_stream_open(argv[arg]);
+  if(stream == NULL)
+    {
+      fprintf(stderr, "Could not open L2 stream %s\n", argv[arg]);
+      return 1;
+    }
+
+  clock_t start = clock();
+
+  memset(&replay_event, 0, sizeof(replay_event));
+  l2_prefetcher_initialize(0);
+
+  unsigned long long int access_count = 0;
+  unsigned long long int fill_count = 0;
+  while(((max_accesses == 0) || (access_count < max_accesses)) && l2_stream_read(stream, &replay_event))
+    {
+      replay_event_read_queue = 0;
+      replay_event_mshr = 0;
+
+      if(replay_event.type == L2_EVENT_OPERATE)
+	{
+	  unsigned long long int cl_address = replay_event.addr>>6;
+	  int index = replay_prefetched_index(cl_address);
+	  if(replay_prefetched_lines[index] == cl_address)
+	    {
+	      replay_prefetched_lines[index] = 0;
+	      replay_used++;
+	    }
+
+	  l2_prefetcher_operate(0, replay_event.addr, replay_event.ip, replay_event.cache_hit);
+	  access_count++;
+	}
+      else
+	{
+	  replay_tags[replay_event.set][replay_event.way] = replay_event.addr>>6;
+	  l2_cache_fill(0, replay_event.addr, replay_event.set, replay_event.way, replay_event.prefetch, replay_event.evicted_addr);
+	  fill_count++;
+	}
+    }
+  l2_stream_close(stream);
+
+  double seconds = (double)(clock() - start)/CLOCKS_PER_SEC;
+
+  printf("\nReplayed %llu accesses and %llu fills in %.2f seconds\n", access_count, fill_count, seconds);
+  printf("Prefetches issued: %llu L2, %llu LLC, %llu rejected, %llu redundant\n", replay_issued_l2, replay_issued_llc, replay_rejected, replay_redundant);
+  printf("Prefetched lines accessed later: %llu (%.1f%% of non-redundant prefetches)\n", replay_used, replay_percent(replay_used, replay_issued_l2 + replay_issued_llc - replay_redundant));
+
+  return 0;
+}
@@ -0,0 +1,289 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+  L2 event stream files, written by tools/l2_record.c and read by
+  tools/l2_eval.c and tools/l2_replay.c.
+
+  A stream is the sequence of prefetcher callbacks the simulator made during
+  one run, both l2_prefetcher_operate() and l2_cache_fill() calls, each with
+  the cycle and the L2 MSHR and read queue occupancy at the time of the call.
+
+  The file starts with L2_STREAM_MAGIC.  Each event then starts with a flags
+  byte (L2_EVENT_*), followed by unsigned LEB128 varints:
+   - cycles since the previous event
+   - the cache line address, as a zigzag delta from the previous event's
+   - the MSHR occupancy plus the read queue occupancy times 32
+   - for operate events, the IP as a zigzag delta from the previous IP
+   - for fill events, the set times L2_ASSOCIATIVITY plus the way, and the
+     evicted line as a zigzag delta from the filled line if there is one
+  and, when L2_EVENT_OFFSET is set, one byte with the low 6 address bits.
+
+  Cycles, IPs and occupancies take a byte or so each this way, so an event
+  takes about 13 bytes on lbm instead of the 40 or more of a raw record.
+
+  Include this after prefetcher.h.  Everything is defined here, so each tool
+  still builds as a single file.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#define L2_STREAM_MAGIC "DPC2L2S2"
+#define L2_STREAM_MAGIC_SIZE 8
+
+// flags byte of each event
+#define L2_EVENT_FILL (1<<0)
+// cache_hit for operate events, prefetch for fill events
+#define L2_EVENT_FLAG (1<<1)
+#define L2_EVENT_OFFSET (1<<2)
+#define L2_EVENT_EVICTED (1<<3)
+
+#define L2_EVENT_OPERATE 0
+
+typedef struct l2_event
+{
+  // L2_EVENT_OPERATE or L2_EVENT_FILL
+  int type;
+
+  unsigned long long int cycle;
+  unsigned long long int addr;
+  int mshr_occupancy;
+  int read_queue_occupancy;
+
+  // operate events
+  unsigned long long int ip;
+  int cache_hit;
+
+  // fill events
+  int set;
+  int way;
+  int prefetch;
+  unsigned long long int evicted_addr;
+} l2_event_t;
+
+typedef struct l2_stream
+{
+  FILE *file;
+
+  // the delta bases, as of the previous event
+  unsigned long long int cycle;
+  unsigned long long int cl_address;
+  unsigned long long int ip;
+} l2_stream_t;
+
+void l2_stream_put_varint(l2_stream_t *stream, unsigned long long int value)
+{
+  while(value >= 0x80)
+    {
+      putc((int)(value & 0x7f) | 0x80, stream->file);
+      value >>= 7;
+    }
+  putc((int)value, stream->file);
+}
+
+// returns 0 if the stream ends in the middle of the varint
+int l2_stream_get_varint(l2_stream_t *stream, unsigned long long int *value)
+{
+  *value = 0;
+
+  int shift;
+  for(shift=0; shift<64; shift+=7)
+    {
+      int byte = getc(stream->file);
+      if(byte == EOF)
+	{
+	  return 0;
+	}
+      *value |= (unsigned long long int)(byte & 0x7f) << shift;
+      if(!(byte & 0x80))
+	{
+	  return 1;
+	}
+    }
+
+  return 0;
+}
+
+unsigned long long int l2_stream_zigzag(unsigned long long int delta)
+{
+  return (delta << 1) ^ (unsigned long long int)((long long int)delta >> 63);
+}
+
+unsigned long long int l2_stream_unzigzag(unsigned long long int value)
+{
+  return (value >> 1) ^ (0 - (value & 1));
+}
+
+void l2_stream_init(l2_stream_t *stream, FILE *file)
+{
+  stream->file = file;
+  stream->cycle = 0;
+  stream->cl_address = 0;
+  stream->ip = 0;
+}
+
+// opens a stream for writing and writes the header, returns NULL on failure
+l2_stream_t *l2_stream_create(const char *filename)
+{
+  static l2_stream_t stream;
+
+  FILE *file = fopen(filename, "wb");
+  if(file == NULL)
+    {
+      return NULL;
+    }
+  l2_stream_init(&stream, file);
+
+  fwrite(L2_STREAM_MAGIC, 1, L2_STREAM_MAGIC_SIZE, file);
+
+  return &stream;
+}
+
+void l2_stream_write(l2_stream_t *stream, l2_event_t *event)
+{
+  unsigned long long int cl_address = event->addr>>6;
+  int offset = event->addr & 63;
+
+  int flags = event->type;
+  if((event->type == L2_EVENT_OPERATE) ? event->cache_hit : event->prefetch)
+    {
+      flags |= L2_EVENT_FLAG;
+    }
+  if(offset != 0)
+    {
+      flags |= L2_EVENT_OFFSET;
+    }
+  if((event->type == L2_EVENT_FILL) && (event->evicted_addr != 0))
+    {
+      flags |= L2_EVENT_EVICTED;
+    }
+  putc(flags, stream->file);
+
+  l2_stream_put_varint(stream, event->cycle - stream->cycle);
+  l2_stream_put_varint(stream, l2_stream_zigzag(cl_address - stream->cl_address));
+  l2_stream_put_varint(stream, event->mshr_occupancy + event->read_queue_occupancy*32);
+
+  if(event->type == L2_EVENT_OPERATE)
+    {
+      l2_stream_put_varint(stream, l2_stream_zigzag(event->ip - stream->ip));
+      stream->ip = event->ip;
+    }
+  else
+    {
+      l2_stream_put_varint(stream, event->set*L2_ASSOCIATIVITY + event->way);
+      if(flags & L2_EVENT_EVICTED)
+	{
+	  l2_stream_put_varint(stream, l2_stream_zigzag(event->evicted_addr - (cl_address<<6)));
+	}
+    }
+
+  if(flags & L2_EVENT_OFFSET)
+    {
+      putc(offset, stream->file);
+    }
+
+  stream->cycle = event->cycle;
+  stream->cl_address = cl_address;
+}
+
+void l2_stream_close(l2_stream_t *stream)
+{
+  fclose(stream->file);
+  stream->file = NULL;
+}
+
+// opens a stream for reading and checks the header, returns NULL on failure
+l2_stream_t *l2_stream_open(const char *filename)
+{
+  static l2_stream_t stream;
+
+  FILE *file = fopen(filename, "rb");
+  if(file == NULL)
+    {
+      return NULL;
+    }
+
+  char magic[L2_STREAM_MAGIC_SIZE];
+  if((fread(magic, 1, L2_STREAM_MAGIC_SIZE, file) != L2_STREAM_MAGIC_SIZE) ||
+     memcmp(magic, L2_STREAM_MAGIC, L2_STREAM_MAGIC_SIZE))
+    {
+      fclose(file);
+      return NULL;
+    }
+  l2_stream_init(&stream, file);
+
+  return &stream;
+}
+
+// reads the next event, returns 0 at the end of the stream
+int l2_stream_read(l2_stream_t *stream, l2_event_t *event)
+{
+  int flags = getc(stream->file);
+  if(flags == EOF)
+    {
+      return 0;
+    }
+
+  unsigned long long int cycle_delta, cl_delta, occupancy, value;
+  if(!l2_stream_get_varint(stream, &cycle_delta) ||
+     !l2_stream_get_varint(stream, &cl_delta) ||
+     !l2_stream_get_varint(stream, &occupancy))
+    {
+      return 0;
+    }
+
+  event->type = flags & L2_EVENT_FILL;
+  event->cycle = stream->cycle + cycle_delta;
+  event->addr = (stream->cl_address + l2_stream_unzigzag(cl_delta))<<6;
+  event->mshr_occupancy = occupancy % 32;
+  event->read_queue_occupancy = occupancy / 32;
+  event->cache_hit = 0;
+  event->prefetch = 0;
+  event->evicted_addr = 0;
+
+  if(event->type == L2_EVENT_OPERATE)
+    {
+      if(!l2_stream_get_varint(stream, &value))
+	{
+	  return 0;
+	}
+      event->ip = stream->ip + l2_stream_unzigzag(value);
+      event->cache_hit = (flags & L2_EVENT_FLAG) != 0;
+      stream->ip = event->ip;
+    }
+  else
+    {
+      if(!l2_stream_get_varint(stream, &value))
+	{
+	  return 0;
+	}
+      event->set = value / L2_ASSOCIATIVITY;
+      event->way = value % L2_ASSOCIATIVITY;
+      event->prefetch = (flags & L2_EVENT_FLAG) != 0;
+      if(flags & L2_EVENT_EVICTED)
+	{
+	  if(!l2_stream_get_varint(stream, &value))
+	    {
+	      return 0;
+	    }
+	  event->evicted_addr = event->addr + l2_stream_unzigzag(value);
+	}
+    }
+
+  stream->cycle = event->cycle;
+  stream->cl_address = event->addr>>6;
+
+  if(flags & L2_EVENT_OFFSET)
+    {
+      int offset = getc(stream->file);
+      if(offset == EOF)
+	{
+	  return 0;
+	}
+      event->addr |= offset;
+    }
+
+  return 1;
+}
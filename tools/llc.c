@@ -0,0 +1,1606 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  The LLC of lib/dpc2sim.a as source, with a choice of replacement
+  policies that tell prefetches, demand reads and write backs apart.
+  Linked in next to the prefetcher, it defines every function and
+  variable of the library's llc.o, so the linker never pulls llc.o out of
+  lib/dpc2sim.a.  With the default LRU policy the simulation is the same as
+  the library's, cycle for cycle.
+
+  The LLC is LLC_SETS sets of 16 ways, 1024 sets or 256 with -small_llc.
+  Each cycle llc_operate() handles at most one fill from DRAM, one write
+  back from the L2 and one read from the L2, in that order and oldest
+  first.  The LLC has no MSHRs, a miss is sent to the memory controller,
+  which merges misses to the same line.  A write back that misses reads
+  the line from DRAM and marks it dirty once it is filled.
+
+  Every access and every line belongs to one of three classes: demand
+  reads, prefetches (reads the L2 sent for its prefetcher), and write
+  backs.  A line's class is the class of the access that missed for it,
+  or demand if a demand read missed for it too.
+
+  The replacement policy decides which valid line a fill evicts, and how
+  fills and hits update its state.  A fill goes to the first invalid way
+  whatever the policy.  No policy promotes a line on a write back hit.
+   - lru: the least recently filled or read line, the library's policy
+   - srrip: static re-reference interval prediction, with 2 bit RRPVs.
+     Lines are inserted at RRPV 2 and promoted to 0 on a demand hit, a
+     prefetch hit does not promote the line (PACMan).
+   - drrip: dynamic RRIP, set dueling between srrip and bimodal RRIP,
+     which inserts at RRPV 3 and only every 32nd line at 2.  Only demand
+     misses in the leader sets steer the others.  The leader sets are
+     spread over every offset within a page, since the first lines of a
+     page miss the most under a prefetcher that learns per page.
+   - hawkeye: Hawkeye, which replays the reads of one set in 16, picked
+     like drrip's leader sets, through Belady's optimal policy (OPTgen),
+     and learns per load ip whether the lines it reads would have hit
+     under it.  Lines from an ip that would have hit are inserted at
+     RRPV 0 of 7 and age the other lines, the rest at 7.  Prefetches learn apart from demand reads, and those
+     that only fill the LLC apart from those the L2 was also sent.  Write
+     backs are always inserted at 7.  The load ips come from tools/mlc.c,
+     without it every demand read looks like the same load.
+  The LLC sees no reads to a line while the L2 holds it, so by default
+  drrip and hawkeye only evict a line the L2 holds when the L2 holds the
+  whole set.  Evicting it would also take it out of the L2.
+
+  Built with -DNUM_CPUS=<n> for tools/multicore.c, the LLC is shared by
+  the cores' L2s.  A line the LLC evicts is taken out of every core's L2
+  and DCU, and a line that several cores missed on is read from DRAM once
+  and filled into each of their L2s.  The reads and write backs the L2s
+  send wait in a ring per core until llc_commit_requests() adds the ones
+  sent before a given cycle to the LLC's queues, in core order.  So the
+  cores do not see each other's requests within a cycle, and their
+  private caches can be simulated in any order, or in parallel, with
+  each core's thread adding to its own ring without locks.  Each core
+  may only send a read while the read queue has room for one from every
+  core.  When tools/multicore.c runs the cores several cycles ahead of
+  the LLC, each core may instead have up to LLC_READ_QUEUE_SIZE reads in
+  its ring, which wait there while the LLC's read queue is full.
+
+  At the end of the simulation the LLC's hits and misses per access
+  class, and its fills, evictions, and evictions of lines that no demand
+  read hit, per line class, are printed, counted after the warmup.
+
+  How to compile:
+
+  gcc -Wall -o dpc2sim example_prefetchers/ampmE__prefetcher.c tools/llc.c tools/mlc.c lib/dpc2sim.a
+
+  tools/mlc.c is only needed for hawkeye.  It can be linked together with
+  the other files in tools/.
+
+  How to run:
+
+  zcat traces/lbm_trace2.dpc.gz | LLC_REPLACEMENT=hawkeye ./dpc2sim -small_llc
+
+  Options:
+
+  LLC_REPLACEMENT=<lru|srrip|drrip|hawkeye>
+  The LLC replacement policy.  Default is lru.
+
+  LLC_PREFETCH_RRPV=<0-3>
+  LLC_WRITEBACK_RRPV=<0-3>
+  The RRPV prefetched and written back lines are inserted at, 3 being
+  the next to be evicted.  Only prefetches that fill the LLC alone
+  (FILL_LLC) count as prefetched lines here, since a line the L2 was
+  also sent leaves the L2 when the LLC evicts it.  With lru, 3 inserts
+  them at the LRU position and anything else at the MRU position.
+  hawkeye ignores them.  Default is to insert them like demand lines.
+
+  LLC_KEEP_MLC_LINES=<0|1>
+  1 keeps srrip, drrip and hawkeye from evicting a line the L2 holds,
+  unless it holds the whole set.  Default is 1 for drrip and hawkeye and
+  0 for srrip, lru ignores it.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../inc/prefetcher.h"
+
+// where the uncore keeps its cycle count and the memory controller its read queue's length
+#define UNCORE_CYCLE_OFFSET 0
+#define UNCORE_MC_READ_COUNT_OFFSET 8
+#define UNCORE_LLC_QUEUES_OFFSET 0xa18
+
+// where a core keeps its cycle and retired instruction counts, and its L2 fill queue's length
+#define OOO_CPU_SIZE 0x9c270
+#define OOO_CPU_CYCLE_OFFSET 8
+#define OOO_CPU_RETIRED_OFFSET 16
+#define OOO_CPU_MLC_FILL_COUNT_OFFSET 0x9be68
+
+#define LLC_MAX_SETS 1024
+#define LLC_WAYS 16
+#define LLC_LATENCY 20
+#define LLC_READ_QUEUE_SIZE 32
+#define LLC_WRITE_QUEUE_SIZE 32
+#define LLC_FILL_QUEUE_SIZE 32
+#define MLC_FILL_QUEUE_SIZE 8
+#define MC_READ_QUEUE_SIZE 32
+
+// a read that fills the DCU, next to FILL_L2 and FILL_LLC
+#define FILL_L1 (1<<0)
+
+// the access and line classes
+#define LLC_DEMAND 0
+#define LLC_PREFETCH 1
+#define LLC_WRITEBACK 2
+#define LLC_CLASS_COUNT 3
+
+// misses on their way back from DRAM, whose class and waiting cores the fill needs
+#define LLC_PENDING_COUNT 64
+
+// lib/dpc2sim.a simulates one core, tools/multicore.c is built with -DNUM_CPUS for more
+#ifndef NUM_CPUS
+#define NUM_CPUS 1
+#endif
+#define LLC_CPUS NUM_CPUS
+
+// tools/multicore.c may run the cores up to LLC_MAX_QUANTUM cycles ahead of
+// the LLC, and each core's L2 sends at most two write backs a cycle, after
+// up to LLC_READ_QUEUE_SIZE reads the LLC did not take yet
+#define LLC_MAX_QUANTUM 100
+#define LLC_DEFERRED_COUNT 256
+#define LLC_DEFERRED_READ 0
+#define LLC_DEFERRED_WRITE 1
+
+typedef struct llc_line
+{
+  int valid;
+  unsigned long long int tag;
+  int dirty;
+  long long int lru;
+  unsigned long long int reserved;
+} llc_line_t;
+
+// a read from the L2
+typedef struct llc_read
+{
+  int cpu_num;
+  unsigned long long int addr;
+  // only set by tools/mlc.c, lib/dpc2sim.a leaves it 0
+  unsigned long long int ip;
+  long long int cycle;
+  int prefetch;
+  int fill_level;
+} llc_read_t;
+
+// a dirty line written back from the L2
+typedef struct llc_write
+{
+  int cpu_num;
+  unsigned long long int addr;
+  unsigned long long int reserved;
+  long long int cycle;
+  // 1 once the line missed, and the write waits for it to be filled
+  int missed;
+} llc_write_t;
+
+// a line coming back from DRAM
+typedef struct llc_fill_request
+{
+  int cpu_num;
+  unsigned long long int addr;
+  long long int cycle;
+  int fill_level;
+} llc_fill_request_t;
+
+typedef struct llc_queues
+{
+  int read_count;
+  llc_read_t read[LLC_READ_QUEUE_SIZE];
+  int write_count;
+  llc_write_t write[LLC_WRITE_QUEUE_SIZE];
+  int fill_count;
+  llc_fill_request_t fill[LLC_FILL_QUEUE_SIZE];
+} llc_queues_t;
+
+typedef struct llc_pending
+{
+  unsigned long long int addr;
+  int line_class;
+  unsigned long long int ip;
+  // the fill level each core missed with, 0 for the cores not waiting for the line
+  int fill_level[LLC_CPUS];
+} llc_pending_t;
+
+// a request from an L2, waiting for the LLC
+typedef struct llc_deferred
+{
+  int type;
+  unsigned long long int addr;
+  // 1 once tools/mlc.c gave the read's ip
+  int has_ip;
+  unsigned long long int ip;
+  // the core's cycle when it sent the request
+  long long int cycle;
+  int fill_level;
+  int prefetch;
+} llc_deferred_t;
+
+// one core's requests, a ring that only the core's thread adds to and only
+// llc_commit_requests() takes from, each side on its own cache line
+typedef struct llc_deferred_queue
+{
+  llc_deferred_t request[LLC_DEFERRED_COUNT];
+  // the core's side: where its next request goes, how far it published, and the reads it sent
+  unsigned int next __attribute__((aligned(64)));
+  unsigned int tail;
+  unsigned int reads_sent;
+  // the LLC's side: the oldest request it did not take, and the reads it took
+  unsigned int head __attribute__((aligned(64)));
+  unsigned int reads_committed;
+} llc_deferred_queue_t;
+
+typedef struct llc_counters
+{
+  unsigned long long int hits[LLC_CLASS_COUNT];
+  unsigned long long int misses[LLC_CLASS_COUNT];
+  unsigned long long int fills[LLC_CLASS_COUNT];
+  unsigned long long int evictions[LLC_CLASS_COUNT];
+  unsigned long long int unused_evictions[LLC_CLASS_COUNT];
+} llc_counters_t;
+
+extern unsigned char ooo_cpu[];
+extern unsigned char uncore[];
+extern int LLC_SETS;
+extern long long int warmup_instructions;
+
+llc_line_t llc_cache[LLC_MAX_SETS][LLC_WAYS];
+
+// the class of each line, and whether a demand read hit it since it was filled
+unsigned char llc_line_class[LLC_MAX_SETS][LLC_WAYS];
+unsigned char llc_line_used[LLC_MAX_SETS][LLC_WAYS];
+
+llc_pending_t llc_pending[LLC_PENDING_COUNT];
+
+// the number of cores the LLC is built for, and the number sharing it, set by tools/multicore.c
+int llc_max_cpus = LLC_CPUS;
+int llc_cpus = 1;
+
+// the most cycles the cores may run ahead of the LLC, and how many they do, set by tools/multicore.c
+int llc_max_quantum = LLC_MAX_QUANTUM;
+int llc_quantum = 1;
+
+llc_deferred_queue_t llc_deferred[LLC_CPUS];
+
+llc_counters_t llc_counters;
+int llc_warmup_complete;
+
+const char *llc_class_names[LLC_CLASS_COUNT] = { "demand", "prefetch", "writeback" };
+
+// the simulator's other caches and its memory controller
+void mlc_add_to_fill_queue(int cpu_num, unsigned long long int addr, int fill_level);
+int mlc_check_hit(int cpu_num, unsigned long long int addr);
+int mlc_check_invalidate_write_back(int cpu_num, unsigned long long int addr);
+void mlc_invalidate(int cpu_num, unsigned long long int addr);
+int dcu_check_invalidate_write_back(int cpu_num, unsigned long long int addr);
+void dcu_invalidate(int cpu_num, unsigned long long int addr);
+void mc_add_to_read_queue(int cpu_num, unsigned long long int addr, int fill_level, int prefetch);
+void mc_add_to_write_queue(unsigned long long int addr);
+
+llc_queues_t *llc_queues()
+{
+  return (llc_queues_t *)(uncore + UNCORE_LLC_QUEUES_OFFSET);
+}
+
+long long int llc_cycle()
+{
+  return *(long long int *)(uncore + UNCORE_CYCLE_OFFSET);
+}
+
+long long int llc_core_cycle(int cpu_num)
+{
+  return *(long long int *)(ooo_cpu + cpu_num*OOO_CPU_SIZE + OOO_CPU_CYCLE_OFFSET);
+}
+
+long long int llc_core_retired(int cpu_num)
+{
+  return *(long long int *)(ooo_cpu + cpu_num*OOO_CPU_SIZE + OOO_CPU_RETIRED_OFFSET);
+}
+
+int llc_mlc_fill_count(int cpu_num)
+{
+  return *(int *)(ooo_cpu + cpu_num*OOO_CPU_SIZE + OOO_CPU_MLC_FILL_COUNT_OFFSET);
+}
+
+int llc_mc_read_count()
+{
+  return *(int *)(uncore + UNCORE_MC_READ_COUNT_OFFSET);
+}
+
+/*
+  Replacement policies
+*/
+
+#define LLC_RRPV_MAX 3
+
+// DRRIP leader sets of each policy, and Hawkeye's sampled sets, out of every LLC_SAMPLE_PERIOD sets
+#define LLC_SAMPLE_PERIOD 16
+#define LLC_SAMPLED_SETS (LLC_MAX_SETS/LLC_SAMPLE_PERIOD)
+#define LLC_PSEL_MAX 1023
+#define LLC_BRRIP_PERIOD 32
+
+// Hawkeye's RRPVs are 3 bits, and a line is predicted to hit if its counter is at least half way up
+#define LLC_HAWKEYE_RRPV_MAX 7
+#define LLC_PREDICTOR_SIZE 8192
+#define LLC_PREDICTOR_MAX 7
+#define LLC_PREDICTOR_FRIENDLY 4
+
+// OPTgen looks back 8 times the associativity, in accesses to the set
+#define LLC_OPTGEN_SIZE (8*LLC_WAYS)
+#define LLC_SAMPLER_SIZE LLC_OPTGEN_SIZE
+
+typedef struct llc_replacement
+{
+  const char *name;
+  // picks the way to evict when every way of the set is valid
+  int (*victim)(int set);
+  // a read or a write back hit the line, fill_level being the levels the read fills
+  void (*hit)(int set, int way, int access_class, int fill_level, unsigned long long int ip);
+  // a line was filled, after llc_fill(), fill_level being the levels the cores that missed on it fill
+  void (*insert)(int set, int way, int line_class, int fill_level, unsigned long long int ip);
+  // a read hit or missed, once the LLC is done with it
+  void (*access)(int set, unsigned long long int addr, int access_class, int fill_level, unsigned long long int ip);
+  // 1 if by default the policy only evicts a line the L2 holds when it holds the whole set
+  int keep_mlc_lines;
+} llc_replacement_t;
+
+// an access to a sampled set, OPTgen's history of the set
+typedef struct llc_sample
+{
+  unsigned long long int addr;
+  unsigned int time;
+  unsigned short signature;
+  unsigned char valid;
+} llc_sample_t;
+
+unsigned char llc_rrpv[LLC_MAX_SETS][LLC_WAYS];
+unsigned short llc_signature[LLC_MAX_SETS][LLC_WAYS];
+int llc_psel;
+int llc_brrip_count;
+
+unsigned char llc_predictor[LLC_PREDICTOR_SIZE];
+unsigned int llc_optgen_time[LLC_SAMPLED_SETS];
+unsigned char llc_optgen_occupancy[LLC_SAMPLED_SETS][LLC_OPTGEN_SIZE];
+llc_sample_t llc_sampler[LLC_SAMPLED_SETS][LLC_SAMPLER_SIZE];
+
+// the RRPV of prefetched and written back lines, -1 for the policy's own
+int llc_prefetch_rrpv = -1;
+int llc_writeback_rrpv = -1;
+
+// 1 to keep srrip, drrip and hawkeye from evicting lines the L2 holds
+int llc_keep_mlc_lines;
+
+int llc_lru_victim(int set)
+{
+  // the LRU cycle is compared as an int, like in lib/dpc2sim.a
+  int lru_way = 0;
+  int lru_cycle = llc_cache[set][0].lru;
+  int way;
+  for(way=1; way<LLC_WAYS; way++)
+    {
+      if(llc_cache[set][way].lru < lru_cycle)
+	{
+	  lru_cycle = llc_cache[set][way].lru;
+	  lru_way = way;
+	}
+    }
+
+  return lru_way;
+}
+
+void llc_lru_hit(int set, int way, int access_class, int fill_level, unsigned long long int ip)
+{
+  if(access_class != LLC_WRITEBACK)
+    {
+      llc_cache[set][way].lru = llc_cycle();
+    }
+}
+
+// 1 for a prefetch that only fills the LLC, the one kind of prefetch LLC_PREFETCH_RRPV applies to,
+// since demoting a line the L2 was also sent would take it out of the L2 with it
+int llc_prefetch_only(int line_class, int fill_level)
+{
+  return (line_class == LLC_PREFETCH) && !(fill_level & (FILL_L1 | FILL_L2));
+}
+
+void llc_lru_insert(int set, int way, int line_class, int fill_level, unsigned long long int ip)
+{
+  if((llc_prefetch_only(line_class, fill_level) && (llc_prefetch_rrpv == LLC_RRPV_MAX)) ||
+     ((line_class == LLC_WRITEBACK) && (llc_writeback_rrpv == LLC_RRPV_MAX)))
+    {
+      llc_cache[set][way].lru = 0;
+    }
+  else
+    {
+      llc_cache[set][way].lru = llc_cycle();
+    }
+}
+
+void llc_no_access(int set, unsigned long long int addr, int access_class, int fill_level, unsigned long long int ip)
+{
+}
+
+// the LLC sees no accesses to a line while the L2 holds it, so with
+// LLC_KEEP_MLC_LINES=1 such a line only goes when the L2 holds every line
+// (query based selection)
+int llc_mlc_holds(unsigned long long int addr)
+{
+  if(!llc_keep_mlc_lines)
+    {
+      return 0;
+    }
+
+  int cpu;
+  for(cpu=0; cpu<llc_cpus; cpu++)
+    {
+      if(mlc_check_hit(cpu, addr))
+	{
+	  return 1;
+	}
+    }
+
+  return 0;
+}
+
+int llc_rrip_victim(int set)
+{
+  // the first line with the highest RRPV that the L2 does not hold, or of all lines if it holds them all,
+  // which without LLC_KEEP_MLC_LINES is the first line with the highest RRPV
+  int victim = -1;
+  int way;
+  for(way=0; way<LLC_WAYS; way++)
+    {
+      if(((victim == -1) || (llc_rrpv[set][way] > llc_rrpv[set][victim])) && !llc_mlc_holds(llc_cache[set][way].tag))
+	{
+	  victim = way;
+	}
+    }
+  if(victim == -1)
+    {
+      victim = 0;
+      for(way=1; way<LLC_WAYS; way++)
+	{
+	  if(llc_rrpv[set][way] > llc_rrpv[set][victim])
+	    {
+	      victim = way;
+	    }
+	}
+    }
+
+  // age the set until the victim reaches the distant RRPV, as if searching again after each step
+  int age = LLC_RRPV_MAX - llc_rrpv[set][victim];
+  for(way=0; way<LLC_WAYS; way++)
+    {
+      llc_rrpv[set][way] = (llc_rrpv[set][way] + age < LLC_RRPV_MAX) ? llc_rrpv[set][way] + age : LLC_RRPV_MAX;
+    }
+
+  return victim;
+}
+
+void llc_rrip_hit(int set, int way, int access_class, int fill_level, unsigned long long int ip)
+{
+  if(access_class == LLC_DEMAND)
+    {
+      llc_rrpv[set][way] = 0;
+    }
+}
+
+// sets the RRPV of a line just filled, rrpv being the one of a demand line
+void llc_rrip_set_rrpv(int set, int way, int line_class, int fill_level, int rrpv)
+{
+  if(llc_prefetch_only(line_class, fill_level) && (llc_prefetch_rrpv != -1))
+    {
+      rrpv = llc_prefetch_rrpv;
+    }
+  else if((line_class == LLC_WRITEBACK) && (llc_writeback_rrpv != -1))
+    {
+      rrpv = llc_writeback_rrpv;
+    }
+  llc_rrpv[set][way] = rrpv;
+}
+
+void llc_srrip_insert(int set, int way, int line_class, int fill_level, unsigned long long int ip)
+{
+  llc_rrip_set_rrpv(set, way, line_class, fill_level, LLC_RRPV_MAX-1);
+}
+
+// 1 for an SRRIP leader set, which is also one of Hawkeye's sampled sets, -1 for a BRRIP leader set
+// and 0 for the others.  The leaders are picked by comparing the top and bottom bits of the set
+// (complement select), so that each policy leads sets at every offset within a page.
+int llc_leader_set(int set)
+{
+  int low = set % LLC_SAMPLE_PERIOD;
+  int high = set / (LLC_SETS/LLC_SAMPLE_PERIOD);
+  if(high == low)
+    {
+      return 1;
+    }
+  if(high == LLC_SAMPLE_PERIOD-1-low)
+    {
+      return -1;
+    }
+
+  return 0;
+}
+
+int llc_brrip_rrpv()
+{
+  llc_brrip_count = (llc_brrip_count + 1) % LLC_BRRIP_PERIOD;
+  return (llc_brrip_count == 0) ? LLC_RRPV_MAX-1 : LLC_RRPV_MAX;
+}
+
+void llc_drrip_insert(int set, int way, int line_class, int fill_level, unsigned long long int ip)
+{
+  // the leader sets always use SRRIP or BRRIP, and their demand misses steer the others
+  int leader = llc_leader_set(set);
+  int brrip;
+  if(leader == 1)
+    {
+      if((line_class == LLC_DEMAND) && (llc_psel < LLC_PSEL_MAX))
+	{
+	  llc_psel++;
+	}
+      brrip = 0;
+    }
+  else if(leader == -1)
+    {
+      if((line_class == LLC_DEMAND) && (llc_psel > 0))
+	{
+	  llc_psel--;
+	}
+      brrip = 1;
+    }
+  else
+    {
+      brrip = (llc_psel > LLC_PSEL_MAX/2);
+    }
+
+  llc_rrip_set_rrpv(set, way, line_class, fill_level, brrip ? llc_brrip_rrpv() : LLC_RRPV_MAX-1);
+}
+
+// prefetches learn apart from demand reads, and the ones that only fill the LLC apart from
+// the ones the L2 also gets, which the L2 rather than the LLC keeps until they are used
+int llc_hawkeye_signature(unsigned long long int ip, int access_class, int fill_level)
+{
+  unsigned long long int hash = ip ^ (ip>>13) ^ (ip>>26);
+  int prefetch = (access_class == LLC_PREFETCH) + llc_prefetch_only(access_class, fill_level);
+  return ((hash<<2) | prefetch) % LLC_PREDICTOR_SIZE;
+}
+
+int llc_hawkeye_friendly(int signature)
+{
+  return llc_predictor[signature] >= LLC_PREDICTOR_FRIENDLY;
+}
+
+void llc_hawkeye_train(int signature, int hit)
+{
+  if(hit && (llc_predictor[signature] < LLC_PREDICTOR_MAX))
+    {
+      llc_predictor[signature]++;
+    }
+  else if(!hit && (llc_predictor[signature] > 0))
+    {
+      llc_predictor[signature]--;
+    }
+}
+
+int llc_hawkeye_victim(int set)
+{
+  int victim = -1;
+  int way;
+  for(way=0; way<LLC_WAYS; way++)
+    {
+      if(((victim == -1) || (llc_rrpv[set][way] > llc_rrpv[set][victim])) && !llc_mlc_holds(llc_cache[set][way].tag))
+	{
+	  victim = way;
+	}
+    }
+  if(victim == -1)
+    {
+      victim = 0;
+      for(way=1; way<LLC_WAYS; way++)
+	{
+	  if(llc_rrpv[set][way] > llc_rrpv[set][victim])
+	    {
+	      victim = way;
+	    }
+	}
+    }
+
+  // a line predicted to hit is evicted, so its prediction was wrong
+  if((llc_rrpv[set][victim] < LLC_HAWKEYE_RRPV_MAX) && (llc_line_class[set][victim] != LLC_WRITEBACK))
+    {
+      llc_hawkeye_train(llc_signature[set][victim], 0);
+    }
+
+  return victim;
+}
+
+void llc_hawkeye_hit(int set, int way, int access_class, int fill_level, unsigned long long int ip)
+{
+  if(access_class == LLC_WRITEBACK)
+    {
+      return;
+    }
+
+  int signature = llc_hawkeye_signature(ip, access_class, fill_level);
+  llc_signature[set][way] = signature;
+  llc_rrpv[set][way] = llc_hawkeye_friendly(signature) ? 0 : LLC_HAWKEYE_RRPV_MAX;
+}
+
+void llc_hawkeye_insert(int set, int way, int line_class, int fill_level, unsigned long long int ip)
+{
+  int signature = llc_hawkeye_signature(ip, line_class, fill_level);
+  llc_signature[set][way] = signature;
+  if((line_class == LLC_WRITEBACK) || !llc_hawkeye_friendly(signature))
+    {
+      llc_rrpv[set][way] = LLC_HAWKEYE_RRPV_MAX;
+      return;
+    }
+
+  int other;
+  for(other=0; other<LLC_WAYS; other++)
+    {
+      if((other != way) && (llc_rrpv[set][other] < LLC_HAWKEYE_RRPV_MAX-1))
+	{
+	  llc_rrpv[set][other]++;
+	}
+    }
+  llc_rrpv[set][way] = 0;
+}
+
+// OPTgen: the line would have hit under Belady's policy if the set had
+// room for it every time since its last access
+void llc_hawkeye_access(int set, unsigned long long int addr, int access_class, int fill_level, unsigned long long int ip)
+{
+  if(llc_leader_set(set) != 1)
+    {
+      return;
+    }
+
+  int sampled = set / LLC_SAMPLE_PERIOD;
+  unsigned int now = llc_optgen_time[sampled];
+  unsigned char *occupancy = llc_optgen_occupancy[sampled];
+  llc_sample_t *samples = llc_sampler[sampled];
+  unsigned long long int cl_addr = addr>>6;
+  int i;
+
+  occupancy[now % LLC_OPTGEN_SIZE] = 0;
+
+  llc_sample_t *sample = NULL;
+  for(i=0; i<LLC_SAMPLER_SIZE; i++)
+    {
+      if(samples[i].valid && (samples[i].addr == cl_addr))
+	{
+	  sample = &samples[i];
+	  break;
+	}
+    }
+
+  if(sample != NULL)
+    {
+      int hit = (now - sample->time < LLC_OPTGEN_SIZE);
+      unsigned int time;
+      for(time=sample->time; hit && (time != now); time++)
+	{
+	  if(occupancy[time % LLC_OPTGEN_SIZE] >= LLC_WAYS)
+	    {
+	      hit = 0;
+	    }
+	}
+      if(hit)
+	{
+	  for(time=sample->time; time != now; time++)
+	    {
+	      occupancy[time % LLC_OPTGEN_SIZE]++;
+	    }
+	}
+      llc_hawkeye_train(sample->signature, hit);
+    }
+  else
+    {
+      // the least recently accessed line leaves the history, without having been reused
+      sample = &samples[0];
+      for(i=0; i<LLC_SAMPLER_SIZE; i++)
+	{
+	  if(!samples[i].valid)
+	    {
+	      sample = &samples[i];
+	      break;
+	    }
+	  if(samples[i].time < sample->time)
+	    {
+	      sample = &samples[i];
+	    }
+	}
+      if(sample->valid)
+	{
+	  llc_hawkeye_train(sample->signature, 0);
+	}
+      sample->valid = 1;
+      sample->addr = cl_addr;
+    }
+
+  sample->time = now;
+  sample->signature = llc_hawkeye_signature(ip, access_class, fill_level);
+  llc_optgen_time[sampled]++;
+}
+
+llc_replacement_t llc_replacements[] =
+  {
+    { "lru", llc_lru_victim, llc_lru_hit, llc_lru_insert, llc_no_access, 0 },
+    { "srrip", llc_rrip_victim, llc_rrip_hit, llc_srrip_insert, llc_no_access, 0 },
+    { "drrip", llc_rrip_victim, llc_rrip_hit, llc_drrip_insert, llc_no_access, 1 },
+    { "hawkeye", llc_hawkeye_victim, llc_hawkeye_hit, llc_hawkeye_insert, llc_hawkeye_access, 1 },
+  };
+
+#define LLC_REPLACEMENT_COUNT (sizeof(llc_replacements)/sizeof(llc_replacement_t))
+
+llc_replacement_t *llc_replacement = &llc_replacements[0];
+
+int llc_parse_rrpv(const char *name)
+{
+  const char *rrpv = getenv(name);
+  if(rrpv == NULL)
+    {
+      return -1;
+    }
+
+  char *end;
+  int value = strtol(rrpv, &end, 10);
+  if((*rrpv == '\0') || (*end != '\0') || (value < 0) || (value > LLC_RRPV_MAX))
+    {
+      printf("%s must be between 0 and %d. Exiting.\n", name, LLC_RRPV_MAX);
+      exit(1);
+    }
+
+  return value;
+}
+
+void llc_replacement_initialize()
+{
+  const char *name = getenv("LLC_REPLACEMENT");
+  if(name != NULL)
+    {
+      unsigned int i;
+      for(i=0; i<LLC_REPLACEMENT_COUNT; i++)
+	{
+	  if(strcmp(name, llc_replacements[i].name) == 0)
+	    {
+	      break;
+	    }
+	}
+      if(i == LLC_REPLACEMENT_COUNT)
+	{
+	  printf("Unknown LLC replacement policy %s, choose from lru, srrip, drrip and hawkeye. Exiting.\n", name);
+	  exit(1);
+	}
+      llc_replacement = &llc_replacements[i];
+    }
+
+  llc_prefetch_rrpv = llc_parse_rrpv("LLC_PREFETCH_RRPV");
+  llc_writeback_rrpv = llc_parse_rrpv("LLC_WRITEBACK_RRPV");
+  llc_keep_mlc_lines = llc_replacement->keep_mlc_lines;
+  const char *keep = getenv("LLC_KEEP_MLC_LINES");
+  if(keep != NULL)
+    {
+      if((strcmp(keep, "0") != 0) && (strcmp(keep, "1") != 0))
+	{
+	  printf("LLC_KEEP_MLC_LINES must be 0 or 1. Exiting.\n");
+	  exit(1);
+	}
+      llc_keep_mlc_lines = (keep[0] == '1');
+    }
+
+  memset(llc_rrpv, LLC_RRPV_MAX, sizeof(llc_rrpv));
+  memset(llc_signature, 0, sizeof(llc_signature));
+  llc_psel = LLC_PSEL_MAX/2;
+  llc_brrip_count = 0;
+  memset(llc_predictor, LLC_PREDICTOR_FRIENDLY, sizeof(llc_predictor));
+  memset(llc_optgen_time, 0, sizeof(llc_optgen_time));
+  memset(llc_optgen_occupancy, 0, sizeof(llc_optgen_occupancy));
+  memset(llc_sampler, 0, sizeof(llc_sampler));
+
+  if((llc_replacement != &llc_replacements[0]) || (llc_prefetch_rrpv != -1) || (llc_writeback_rrpv != -1) ||
+     (llc_keep_mlc_lines != llc_replacement->keep_mlc_lines))
+    {
+      printf("LLC replacement policy: %s", llc_replacement->name);
+      if(llc_prefetch_rrpv != -1)
+	{
+	  printf(", prefetches inserted at RRPV %d", llc_prefetch_rrpv);
+	}
+      if(llc_writeback_rrpv != -1)
+	{
+	  printf(", write backs inserted at RRPV %d", llc_writeback_rrpv);
+	}
+      if(llc_keep_mlc_lines != llc_replacement->keep_mlc_lines)
+	{
+	  printf(llc_keep_mlc_lines ? ", keeping lines the L2 holds" : ", evicting lines the L2 holds");
+	}
+      printf("\n");
+    }
+}
+
+// called by tools/checkpoint.c, if it is linked in
+void llc_checkpoint(void (*region)(void *data, unsigned long long int size))
+{
+  region(llc_line_class, sizeof(llc_line_class));
+  region(llc_line_used, sizeof(llc_line_used));
+  region(llc_pending, sizeof(llc_pending));
+  region(llc_rrpv, sizeof(llc_rrpv));
+  region(llc_signature, sizeof(llc_signature));
+  region(&llc_psel, sizeof(llc_psel));
+  region(&llc_brrip_count, sizeof(llc_brrip_count));
+  region(llc_predictor, sizeof(llc_predictor));
+  region(llc_optgen_time, sizeof(llc_optgen_time));
+  region(llc_optgen_occupancy, sizeof(llc_optgen_occupancy));
+  region(llc_sampler, sizeof(llc_sampler));
+}
+
+/*
+  Counters
+*/
+
+// the counters start over once every core is done with its warmup
+void llc_count_warmup()
+{
+  if(llc_warmup_complete)
+    {
+      return;
+    }
+
+  int cpu;
+  for(cpu=0; cpu<llc_cpus; cpu++)
+    {
+      if(llc_core_retired(cpu) <= warmup_instructions)
+	{
+	  return;
+	}
+    }
+  memset(&llc_counters, 0, sizeof(llc_counters));
+  llc_warmup_complete = 1;
+}
+
+// the simulator exits without telling the LLC, so the counters are printed on exit
+void llc_print_counters()
+{
+  int i;
+  for(i=0; i<LLC_CLASS_COUNT; i++)
+    {
+      printf("LLC %s Hits: %llu Misses: %llu Fills: %llu Evictions: %llu Unused evictions: %llu\n", llc_class_names[i],
+	     llc_counters.hits[i], llc_counters.misses[i], llc_counters.fills[i],
+	     llc_counters.evictions[i], llc_counters.unused_evictions[i]);
+    }
+}
+
+/*
+  Misses on their way back from DRAM
+*/
+
+void llc_pending_add(int cpu_num, unsigned long long int addr, int fill_level, int line_class, unsigned long long int ip)
+{
+  unsigned long long int cl_addr = addr>>6;
+  int i;
+
+  // a demand read of a line already missing makes it a demand line
+  for(i=0; i<LLC_PENDING_COUNT; i++)
+    {
+      if(llc_pending[i].addr == cl_addr)
+	{
+	  if(line_class == LLC_DEMAND)
+	    {
+	      llc_pending[i].line_class = LLC_DEMAND;
+	      llc_pending[i].ip = ip;
+	    }
+	  llc_pending[i].fill_level[cpu_num] |= fill_level;
+	  return;
+	}
+    }
+
+  // with no room left, the line is filled as a demand line
+  for(i=0; i<LLC_PENDING_COUNT; i++)
+    {
+      if(llc_pending[i].addr == 0)
+	{
+	  memset(&llc_pending[i], 0, sizeof(llc_pending_t));
+	  llc_pending[i].addr = cl_addr;
+	  llc_pending[i].line_class = line_class;
+	  llc_pending[i].ip = ip;
+	  llc_pending[i].fill_level[cpu_num] = fill_level;
+	  return;
+	}
+    }
+}
+
+llc_pending_t *llc_pending_find(unsigned long long int addr)
+{
+  unsigned long long int cl_addr = addr>>6;
+  int i;
+  for(i=0; i<LLC_PENDING_COUNT; i++)
+    {
+      if(llc_pending[i].addr == cl_addr)
+	{
+	  return &llc_pending[i];
+	}
+    }
+
+  return NULL;
+}
+
+/*
+  The cache
+*/
+
+void initialize_llc()
+{
+  llc_queues_t *queues = llc_queues();
+  int i, j;
+
+  queues->read_count = 0;
+  queues->write_count = 0;
+  queues->fill_count = 0;
+  for(i=0; i<LLC_READ_QUEUE_SIZE; i++)
+    {
+      queues->read[i].cpu_num = -1;
+      queues->read[i].addr = 0;
+      queues->read[i].cycle = 0;
+      queues->read[i].prefetch = 0;
+      queues->read[i].fill_level = -1;
+    }
+  for(i=0; i<LLC_WRITE_QUEUE_SIZE; i++)
+    {
+      queues->write[i].cpu_num = -1;
+      queues->write[i].addr = 0;
+      queues->write[i].cycle = 0;
+      queues->write[i].missed = 0;
+    }
+  for(i=0; i<LLC_FILL_QUEUE_SIZE; i++)
+    {
+      queues->fill[i].cpu_num = -1;
+      queues->fill[i].addr = 0;
+      queues->fill[i].cycle = 0;
+      queues->fill[i].fill_level = -1;
+    }
+
+  for(i=0; i<LLC_SETS; i++)
+    {
+      for(j=0; j<LLC_WAYS; j++)
+	{
+	  llc_cache[i][j].valid = 0;
+	  llc_cache[i][j].tag = 0;
+	  llc_cache[i][j].dirty = 0;
+	  llc_cache[i][j].lru = 0;
+	}
+    }
+
+  memset(llc_line_class, LLC_DEMAND, sizeof(llc_line_class));
+  memset(llc_line_used, 0, sizeof(llc_line_used));
+  memset(llc_pending, 0, sizeof(llc_pending));
+  memset(&llc_counters, 0, sizeof(llc_counters));
+  llc_warmup_complete = 0;
+
+  llc_replacement_initialize();
+
+  atexit(llc_print_counters);
+}
+
+void llc_queue_read(int cpu_num, unsigned long long int addr, int fill_level, int prefetch)
+{
+  llc_queues_t *queues = llc_queues();
+  unsigned long long int cl_addr = (addr>>6)<<6;
+  int i;
+
+  // a read of a line the same core already has in the queue is merged into it
+  for(i=0; i<LLC_READ_QUEUE_SIZE; i++)
+    {
+      if((queues->read[i].addr == cl_addr) && (queues->read[i].cpu_num == cpu_num))
+	{
+	  queues->read[i].fill_level |= fill_level;
+	  if(!prefetch)
+	    {
+	      queues->read[i].prefetch = 0;
+	    }
+	  return;
+	}
+    }
+
+  for(i=0; i<LLC_READ_QUEUE_SIZE; i++)
+    {
+      if(queues->read[i].addr == 0)
+	{
+	  queues->read[i].cpu_num = cpu_num;
+	  queues->read[i].addr = addr;
+	  queues->read[i].ip = 0;
+	  queues->read[i].cycle = llc_cycle();
+	  queues->read[i].prefetch = prefetch;
+	  queues->read[i].fill_level = fill_level;
+	  queues->read_count++;
+	  return;
+	}
+    }
+
+  printf("*** L3 LLC Read Queue full. Exiting.\n");
+  fflush(stdout);
+  exit(0);
+}
+
+void llc_queue_read_ip(int cpu_num, unsigned long long int addr, unsigned long long int ip)
+{
+  llc_queues_t *queues = llc_queues();
+  int i;
+  for(i=0; i<LLC_READ_QUEUE_SIZE; i++)
+    {
+      if((queues->read[i].addr != 0) && ((queues->read[i].addr>>6) == (addr>>6)) &&
+	 (queues->read[i].cpu_num == cpu_num) && !queues->read[i].prefetch)
+	{
+	  queues->read[i].ip = ip;
+	}
+    }
+}
+
+void llc_queue_write(int cpu_num, unsigned long long int addr, long long int cycle)
+{
+  llc_queues_t *queues = llc_queues();
+  int i;
+
+  // a full queue drops the write
+  if(queues->write_count >= LLC_WRITE_QUEUE_SIZE)
+    {
+      return;
+    }
+
+  for(i=0; i<LLC_WRITE_QUEUE_SIZE; i++)
+    {
+      if(queues->write[i].addr == addr)
+	{
+	  return;
+	}
+    }
+
+  for(i=0; i<LLC_WRITE_QUEUE_SIZE; i++)
+    {
+      if(queues->write[i].addr == 0)
+	{
+	  queues->write[i].cpu_num = cpu_num;
+	  queues->write[i].addr = addr;
+	  queues->write[i].cycle = cycle;
+	  queues->write[i].missed = 0;
+	  queues->write_count++;
+	  return;
+	}
+    }
+
+  printf("*** LLC WRITE Queue full. Exiting.\n");
+  fflush(stdout);
+  exit(0);
+}
+
+// the reads the core sent that the LLC did not take yet
+unsigned int llc_deferred_reads(int cpu_num)
+{
+  llc_deferred_queue_t *queue = &llc_deferred[cpu_num];
+  return queue->reads_sent - __atomic_load_n(&queue->reads_committed, __ATOMIC_ACQUIRE);
+}
+
+// the next slot of the core's ring, NULL if it is full
+llc_deferred_t *llc_defer(int cpu_num, int type, unsigned long long int addr)
+{
+  llc_deferred_queue_t *queue = &llc_deferred[cpu_num];
+  if(queue->next - __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) >= LLC_DEFERRED_COUNT)
+    {
+      return NULL;
+    }
+
+  llc_deferred_t *request = &queue->request[queue->next++ % LLC_DEFERRED_COUNT];
+  memset(request, 0, sizeof(llc_deferred_t));
+  request->type = type;
+  request->addr = addr;
+  request->cycle = llc_core_cycle(cpu_num);
+
+  return request;
+}
+
+void llc_add_to_read_queue(int cpu_num, unsigned long long int addr, int fill_level, int prefetch)
+{
+  if(llc_cpus > 1)
+    {
+      llc_deferred_t *request = llc_defer(cpu_num, LLC_DEFERRED_READ, addr);
+      if(request == NULL)
+	{
+	  printf("*** LLC deferred requests full. Exiting.\n");
+	  fflush(stdout);
+	  exit(0);
+	}
+      request->fill_level = fill_level;
+      request->prefetch = prefetch;
+      llc_deferred[cpu_num].reads_sent++;
+      return;
+    }
+
+  llc_queue_read(cpu_num, addr, fill_level, prefetch);
+}
+
+// called by tools/mlc.c, if it is linked in, right after it sent a read to the LLC
+void llc_set_read_ip(int cpu_num, unsigned long long int addr, unsigned long long int ip)
+{
+  if(llc_cpus > 1)
+    {
+      // not published yet, so the LLC cannot be reading it
+      llc_deferred_t *request = &llc_deferred[cpu_num].request[(llc_deferred[cpu_num].next - 1) % LLC_DEFERRED_COUNT];
+      request->has_ip = 1;
+      request->ip = ip;
+      return;
+    }
+
+  llc_queue_read_ip(cpu_num, addr, ip);
+}
+
+void llc_add_to_write_queue(int cpu_num, unsigned long long int addr)
+{
+  // the core's cycle, not the uncore's
+  long long int cycle = llc_core_cycle(cpu_num);
+
+  if(llc_cpus > 1)
+    {
+      // a full ring drops the write, like a full write queue
+      llc_defer(cpu_num, LLC_DEFERRED_WRITE, addr);
+      return;
+    }
+
+  llc_queue_write(cpu_num, addr, cycle);
+}
+
+// called by tools/mlc.c, if it is linked in, before it sends a read to the LLC
+int llc_read_queue_full(int cpu_num)
+{
+  llc_deferred_queue_t *queue = &llc_deferred[cpu_num];
+  if(llc_quantum == 1)
+    {
+      // every core may still add a read this cycle
+      return llc_queues()->read_count + llc_cpus*(llc_deferred_reads(cpu_num) + 1) > LLC_READ_QUEUE_SIZE;
+    }
+
+  // the LLC's queue is out of date while the cores run ahead, so each core gets a read queue of its own
+  return (llc_deferred_reads(cpu_num) >= LLC_READ_QUEUE_SIZE) ||
+    (queue->next - __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) >= LLC_DEFERRED_COUNT);
+}
+
+// called by tools/multicore.c on the core's thread once its L2 is done for the cycle
+void llc_publish_requests(int cpu_num)
+{
+  __atomic_store_n(&llc_deferred[cpu_num].tail, llc_deferred[cpu_num].next, __ATOMIC_RELEASE);
+}
+
+// called by tools/multicore.c after the LLC ran, takes the requests the cores sent before the cycle, a core's in order until the read queue is full
+void llc_commit_requests(long long int cycle)
+{
+  int cpu;
+  for(cpu=0; cpu<llc_cpus; cpu++)
+    {
+      llc_deferred_queue_t *queue = &llc_deferred[cpu];
+      unsigned int tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+      unsigned int head = queue->head;
+      unsigned int reads = queue->reads_committed;
+      while(head != tail)
+	{
+	  llc_deferred_t *request = &queue->request[head % LLC_DEFERRED_COUNT];
+	  if(request->cycle >= cycle)
+	    {
+	      break;
+	    }
+	  if(request->type == LLC_DEFERRED_WRITE)
+	    {
+	      llc_queue_write(cpu, request->addr, request->cycle);
+	    }
+	  else
+	    {
+	      if(llc_queues()->read_count >= LLC_READ_QUEUE_SIZE)
+		{
+		  break;
+		}
+	      llc_queue_read(cpu, request->addr, request->fill_level, request->prefetch);
+	      if(request->has_ip)
+		{
+		  llc_queue_read_ip(cpu, request->addr, request->ip);
+		}
+	      reads++;
+	    }
+	  head++;
+	}
+      __atomic_store_n(&queue->reads_committed, reads, __ATOMIC_RELEASE);
+      __atomic_store_n(&queue->head, head, __ATOMIC_RELEASE);
+    }
+}
+
+void llc_add_to_fill_queue(int cpu_num, unsigned long long int addr, int fill_level)
+{
+  llc_queues_t *queues = llc_queues();
+  int i;
+
+  for(i=0; i<LLC_FILL_QUEUE_SIZE; i++)
+    {
+      if(queues->fill[i].addr == 0)
+	{
+	  queues->fill[i].cpu_num = cpu_num;
+	  queues->fill[i].addr = addr;
+	  queues->fill[i].cycle = llc_cycle();
+	  queues->fill[i].fill_level = fill_level;
+	  queues->fill_count++;
+	  return;
+	}
+    }
+
+  printf("*** L3 LLC Fill Queue full. Exiting.\n");
+  fflush(stdout);
+  exit(0);
+}
+
+int llc_get_set(unsigned long long int addr)
+{
+  return (addr>>6)&(LLC_SETS-1);
+}
+
+int llc_get_way(unsigned long long int addr, int set)
+{
+  int way;
+  for(way=0; way<LLC_WAYS; way++)
+    {
+      if(llc_cache[set][way].tag == addr)
+	{
+	  return way;
+	}
+    }
+
+  return -1;
+}
+
+int llc_check_hit(unsigned long long int addr)
+{
+  int set = llc_get_set(addr);
+  int way = llc_get_way(addr, set);
+  if(way == -1)
+    {
+      return 0;
+    }
+
+  return llc_cache[set][way].valid != 0;
+}
+
+void llc_fill(unsigned long long int addr, int set, int way)
+{
+  llc_cache[set][way].valid = 1;
+  llc_cache[set][way].tag = addr;
+  llc_cache[set][way].dirty = 0;
+  llc_cache[set][way].lru = 0;
+}
+
+// places a line just filled by llc_fill() in the replacement order, prefetch is 1 for a prefetched line
+// and fill_level the levels it fills
+void llc_insert(int set, int way, int prefetch, int fill_level, unsigned long long int ip)
+{
+  int line_class = prefetch ? LLC_PREFETCH : LLC_DEMAND;
+  llc_line_class[set][way] = line_class;
+  llc_line_used[set][way] = 0;
+  llc_replacement->insert(set, way, line_class, fill_level, ip);
+}
+
+void llc_update_lru(int set, int way)
+{
+  llc_replacement->hit(set, way, LLC_DEMAND, FILL_L2, 0);
+}
+
+void llc_mark_dirty(int set, int way)
+{
+  llc_cache[set][way].dirty = 1;
+}
+
+int llc_check_dirty(int set, int way)
+{
+  return llc_cache[set][way].dirty == 1;
+}
+
+int llc_get_eviction_way(int set)
+{
+  int way;
+  for(way=0; way<LLC_WAYS; way++)
+    {
+      if(!llc_cache[set][way].valid)
+	{
+	  return way;
+	}
+    }
+
+  return llc_replacement->victim(set);
+}
+
+/*
+  Each cycle
+*/
+
+// fills the line into the L2 of every core that missed on it, or none until all of them can take it
+int llc_fill_cores(unsigned long long int addr, llc_pending_t *pending)
+{
+  int cpu;
+  if(pending == NULL)
+    {
+      return 1;
+    }
+
+  for(cpu=0; cpu<llc_cpus; cpu++)
+    {
+      if((pending->fill_level[cpu] & (FILL_L1 | FILL_L2)) && (llc_mlc_fill_count(cpu) >= MLC_FILL_QUEUE_SIZE))
+	{
+	  return 0;
+	}
+    }
+  for(cpu=0; cpu<llc_cpus; cpu++)
+    {
+      if(pending->fill_level[cpu] & (FILL_L1 | FILL_L2))
+	{
+	  mlc_add_to_fill_queue(cpu, addr, pending->fill_level[cpu]);
+	}
+    }
+
+  return 1;
+}
+
+// fills a line back from DRAM into the LLC, and into the L2 if it asked for it
+void llc_handle_fill(int index)
+{
+  llc_queues_t *queues = llc_queues();
+  llc_fill_request_t *fill = &queues->fill[index];
+  unsigned long long int addr = fill->addr;
+  int set = llc_get_set(addr);
+  int way = llc_get_eviction_way(set);
+  llc_line_t *line = &llc_cache[set][way];
+  int i;
+
+  // the LLC is inclusive of every core's L2 and DCU
+  if((line->tag != 0) && (line->valid == 1))
+    {
+      if(line->dirty == 1)
+	{
+	  mc_add_to_write_queue(line->tag);
+	}
+      int cpu;
+      for(cpu=0; cpu<llc_cpus; cpu++)
+	{
+	  if(mlc_check_invalidate_write_back(cpu, line->tag))
+	    {
+	      mc_add_to_write_queue(line->tag);
+	    }
+	  mlc_invalidate(cpu, line->tag);
+	  if(dcu_check_invalidate_write_back(cpu, line->tag))
+	    {
+	      mc_add_to_write_queue(line->tag);
+	    }
+	  dcu_invalidate(cpu, line->tag);
+	}
+    }
+
+  if(line->valid)
+    {
+      int victim_class = llc_line_class[set][way];
+      llc_counters.evictions[victim_class]++;
+      if(!llc_line_used[set][way])
+	{
+	  llc_counters.unused_evictions[victim_class]++;
+	}
+    }
+
+  // the miss that is being filled says what brought the line in
+  int line_class = LLC_DEMAND;
+  int fill_level = fill->fill_level;
+  unsigned long long int ip = 0;
+  llc_pending_t *pending = llc_pending_find(addr);
+  if(pending != NULL)
+    {
+      line_class = pending->line_class;
+      ip = pending->ip;
+      for(i=0; i<llc_cpus; i++)
+	{
+	  fill_level |= pending->fill_level[i];
+	}
+    }
+
+  llc_fill(addr, set, way);
+  llc_line_class[set][way] = line_class;
+  llc_line_used[set][way] = 0;
+  llc_replacement->insert(set, way, line_class, fill_level, ip);
+  llc_counters.fills[line_class]++;
+
+  // writes that missed were waiting for this line
+  for(i=0; i<LLC_WRITE_QUEUE_SIZE; i++)
+    {
+      if((queues->write[i].addr != 0) && (queues->write[i].missed == 1) && (queues->write[i].addr == addr))
+	{
+	  queues->write[i].addr = 0;
+	  queues->write_count--;
+	  llc_mark_dirty(set, way);
+	}
+    }
+
+  if(llc_cpus > 1)
+    {
+      if(!llc_fill_cores(addr, pending))
+	{
+	  return;
+	}
+    }
+  else if(fill->fill_level & (FILL_L1 | FILL_L2))
+    {
+      // the fill is done again next cycle, once the L2 can take it
+      if(llc_mlc_fill_count(fill->cpu_num) >= MLC_FILL_QUEUE_SIZE)
+	{
+	  return;
+	}
+      mlc_add_to_fill_queue(fill->cpu_num, addr, fill->fill_level);
+    }
+
+  if(pending != NULL)
+    {
+      pending->addr = 0;
+    }
+  fill->addr = 0;
+  queues->fill_count--;
+}
+
+void llc_handle_write(int index)
+{
+  llc_queues_t *queues = llc_queues();
+  llc_write_t *write = &queues->write[index];
+  unsigned long long int addr = write->addr;
+  int set = llc_get_set(addr);
+  int way = llc_get_way(addr, set);
+
+  if((way != -1) && llc_cache[set][way].valid)
+    {
+      llc_replacement->hit(set, way, LLC_WRITEBACK, FILL_LLC, 0);
+      llc_counters.hits[LLC_WRITEBACK]++;
+      write->addr = 0;
+      queues->write_count--;
+      llc_mark_dirty(set, way);
+      return;
+    }
+
+  // a write miss reads the line from DRAM, and waits for it in the queue
+  if((llc_cpus > 1) && (llc_pending_find(addr) != NULL))
+    {
+      write->missed = 1;
+      llc_counters.misses[LLC_WRITEBACK]++;
+      return;
+    }
+  if(llc_mc_read_count() >= MC_READ_QUEUE_SIZE)
+    {
+      return;
+    }
+  mc_add_to_read_queue(0, addr, FILL_LLC, 0);
+  llc_pending_add(0, addr, FILL_LLC, LLC_WRITEBACK, 0);
+  llc_counters.misses[LLC_WRITEBACK]++;
+  write->missed = 1;
+}
+
+void llc_handle_read(int index)
+{
+  llc_queues_t *queues = llc_queues();
+  llc_read_t *read = &queues->read[index];
+  unsigned long long int addr = read->addr;
+  int access_class = read->prefetch ? LLC_PREFETCH : LLC_DEMAND;
+  int set = llc_get_set(addr);
+  int way = llc_get_way(addr, set);
+
+  if((way != -1) && llc_cache[set][way].valid)
+    {
+      llc_replacement->hit(set, way, access_class, read->fill_level, read->ip);
+      if(read->fill_level & (FILL_L1 | FILL_L2))
+	{
+	  if(llc_mlc_fill_count(read->cpu_num) >= MLC_FILL_QUEUE_SIZE)
+	    {
+	      return;
+	    }
+	  mlc_add_to_fill_queue(read->cpu_num, addr, read->fill_level);
+	}
+      llc_replacement->access(set, addr, access_class, read->fill_level, read->ip);
+      llc_counters.hits[access_class]++;
+      if(access_class == LLC_DEMAND)
+	{
+	  llc_line_used[set][way] = 1;
+	}
+      read->addr = 0;
+      queues->read_count--;
+      return;
+    }
+
+  // with more than one core, a line already missing is only read from DRAM once
+  if((llc_cpus == 1) || (llc_pending_find(addr) == NULL))
+    {
+      if(llc_mc_read_count() >= MC_READ_QUEUE_SIZE)
+	{
+	  return;
+	}
+      mc_add_to_read_queue(read->cpu_num, addr, read->fill_level, read->prefetch);
+    }
+  llc_pending_add(read->cpu_num, addr, read->fill_level, access_class, read->ip);
+  llc_replacement->access(set, addr, access_class, read->fill_level, read->ip);
+  llc_counters.misses[access_class]++;
+  read->addr = 0;
+  queues->read_count--;
+}
+
+void llc_operate()
+{
+  llc_queues_t *queues = llc_queues();
+  long long int cycle = llc_cycle();
+  long long int oldest_cycle;
+  int oldest;
+  int i;
+
+  llc_count_warmup();
+
+  if(queues->fill_count > 0)
+    {
+      oldest = -1;
+      oldest_cycle = cycle;
+      for(i=0; i<LLC_FILL_QUEUE_SIZE; i++)
+	{
+	  if((queues->fill[i].addr != 0) && (queues->fill[i].cycle < oldest_cycle))
+	    {
+	      oldest_cycle = queues->fill[i].cycle;
+	      oldest = i;
+	    }
+	}
+      if(oldest != -1)
+	{
+	  llc_handle_fill(oldest);
+	}
+    }
+
+  // writes waiting for their line are skipped
+  if(queues->write_count > 0)
+    {
+      oldest = -1;
+      oldest_cycle = cycle;
+      for(i=0; i<LLC_WRITE_QUEUE_SIZE; i++)
+	{
+	  if((queues->write[i].addr != 0) && (queues->write[i].missed != 1) &&
+	     (cycle - queues->write[i].cycle >= LLC_LATENCY) && (queues->write[i].cycle < oldest_cycle))
+	    {
+	      oldest_cycle = queues->write[i].cycle;
+	      oldest = i;
+	    }
+	}
+      if(oldest != -1)
+	{
+	  llc_handle_write(oldest);
+	}
+    }
+
+  if(queues->read_count > 0)
+    {
+      oldest = -1;
+      oldest_cycle = cycle;
+      for(i=0; i<LLC_READ_QUEUE_SIZE; i++)
+	{
+	  if((queues->read[i].addr != 0) && (queues->read[i].cycle < oldest_cycle))
+	    {
+	      oldest_cycle = queues->read[i].cycle;
+	      oldest = i;
+	    }
+	}
+      if(oldest == -1)
+	{
+	  printf("Couldn't find an oldest LLC read in the queue\n");
+	  exit(0);
+	}
+      if(cycle - oldest_cycle >= LLC_LATENCY)
+	{
+	  llc_handle_read(oldest);
+	}
+    }
+}
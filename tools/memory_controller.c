@@ -0,0 +1,1122 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  The memory controller of lib/dpc2sim.a as source, with a choice of a
+  detailed DDR model next to the library's own.  Linked in next to the
+  prefetcher, it defines every function and variable of the library's
+  memory_controller.o, so the linker never pulls memory_controller.o out
+  of lib/dpc2sim.a.  With the default library model the simulation is the
+  same as the library's, cycle for cycle.
+
+  Both models share the library's queues in the uncore: 32 reads from the
+  LLC, to which a read of a line already in the queue is merged, and 32
+  write backs, to which a write back of a line already in the queue adds
+  nothing and which drop write backs once they are full.  A read is sent
+  back to the LLC's fill queue once its data is read, but only while the
+  LLC's fill queue holds at most 7 lines.
+
+  library: one channel with one rank of 8 banks, which keep the row they
+  last accessed open.  A line is 64 bytes, a row 8KB, and the address
+  bits above the column are the bank (3 bits) and then the row.  Each
+  cycle the data bus is free, at most one read or write is sent: a read
+  or a write back to the open row once it waited DRAM_DBUS_TRANSFER_TIME
+  + 43 cycles and its bank was last accessed more than 43 cycles ago,
+  any other once it waited DRAM_DBUS_TRANSFER_TIME + 129 cycles and its
+  bank was last accessed more than 129 cycles ago.  The data bus is then
+  busy for DRAM_DBUS_TRANSFER_TIME cycles.  Demand reads to the open row
+  go first, then prefetches to the open row, then the oldest demand read
+  and then the oldest prefetch, but only the oldest of each kind is
+  tried.  Write backs are only sent while
+  draining, which starts once the write queue is full and stops once it
+  holds 24 write backs or fewer, and each switch costs 24 bus cycles.
+
+  ddr: DRAM_CHANNELS channels, each with DRAM_RANKS ranks of DRAM_BANKS
+  banks, with an open page policy.  The address bits above the column
+  are the channel, the bank, the rank and then the row, so consecutive
+  8KB blocks go to different channels, and then to different banks.
+  Each channel sends at most one command per cycle, a PRECHARGE, an
+  ACTIVATE, or the READ or WRITE of a read or write back, timed by tRP,
+  tRCD and tCAS, tRAS (ACTIVATE to PRECHARGE), tFAW (at most four
+  ACTIVATEs to a rank in any tFAW cycles), tRRD, tWR, tWTR and tRTP.  A
+  READ or WRITE is only sent if the channel's data bus is free when its
+  data comes, tCAS later, and its data then takes the bus for
+  DRAM_DBUS_TRANSFER_TIME cycles.  Until then the access stays queued
+  and is ranked again every cycle.  The default timings are DDR3-1600
+  11-11-11 at the simulator's 3.2 GHz.  Of the accesses whose next
+  command the banks and the data bus take this cycle, the scheduler
+  sends the command of:
+   - demand_first: demand reads before prefetches, and of either a READ
+     to an open row first, and then the oldest
+   - frfcfs: a READ or WRITE to an open row first, and then the oldest,
+     first ready first come first served
+   - fcfs: the oldest
+  A row is not closed while an access to it that goes first waits.
+  A channel drains write backs, and sends no reads, once the write queue
+  holds DRAM_WRITE_HIGH write backs or it has no reads to send, until the
+  write queue holds DRAM_WRITE_LOW write backs or fewer and it has reads
+  to send, or it has no write backs left.
+
+  With either model the first eight banks of each channel's first rank
+  are also kept in dram_channel, as lib/dpc2sim.a lays it out, which is
+  where tools/stats.c counts the row buffer hits it reports.
+
+  At the end of the simulation, for demand reads, prefetches and write
+  backs, the accesses, those to the open row, to a bank with no open row
+  and to a bank with another row open, as found by their first command,
+  and their average latency, in cycles from the memory controller's
+  queue to the end of their data transfer, are printed, counted after
+  the warmup.
+
+  How to compile:
+
+  gcc -Wall -o dpc2sim example_prefetchers/ampmE__prefetcher.c tools/memory_controller.c lib/dpc2sim.a
+
+  It can be linked together with the other files in tools/.
+
+  How to run:
+
+  zcat traces/lbm_trace2.dpc.gz | DRAM_MODEL=ddr DRAM_CHANNELS=2 ./dpc2sim
+
+  Options:
+
+  DRAM_MODEL=<library|ddr>
+  The DRAM model.  Default is library.
+
+  The rest only apply to ddr.
+
+  DRAM_CHANNELS=<1-8>
+  DRAM_RANKS=<1-8>
+  DRAM_BANKS=<1-16>
+  Channels, ranks per channel and banks per rank, each a power of two.
+  -low_bandwidth slows every channel down.  Default is 1 channel of 1 rank
+  of 8 banks, like library.
+
+  DRAM_TRCD=<cycles>
+  DRAM_TRP=<cycles>
+  DRAM_TCAS=<cycles>
+  DRAM_TRAS=<cycles>
+  DRAM_TFAW=<cycles>
+  Timings in core cycles.  Default is 44, 44, 44, 112 and 128.
+
+  DRAM_SCHEDULER=<demand_first|frfcfs|fcfs>
+  The scheduler.  Default is demand_first.
+
+  DRAM_WRITE_HIGH=<1-32>
+  DRAM_WRITE_LOW=<0-31>
+  The write queue lengths at which draining starts and may stop.
+  Default is 24 and 8.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// where the uncore keeps its cycle count and the memory controller its queues, and the LLC its fill queue's length
+#define UNCORE_CYCLE_OFFSET 0
+#define UNCORE_MC_QUEUES_OFFSET 8
+#define UNCORE_LLC_FILL_COUNT_OFFSET 0x1428
+
+// where a core keeps its retired instruction count
+#define OOO_CPU_SIZE 0x9c270
+#define OOO_CPU_RETIRED_OFFSET 16
+
+#define MC_READ_QUEUE_SIZE 32
+#define MC_WRITE_QUEUE_SIZE 32
+#define MC_MAX_LLC_FILLS 7
+
+// lib/dpc2sim.a's DRAM
+#define DRAM_LIBRARY_BANKS 8
+#define DRAM_COLUMN_BITS 7
+#define DRAM_ROW_BITS 15
+#define DRAM_ROW_HIT_LATENCY 43
+#define DRAM_ROW_MISS_LATENCY 129
+#define DRAM_WRITE_DRAIN_LOW 24
+#define DRAM_TURNAROUND 24
+
+#define DRAM_MAX_CHANNELS 8
+#define DRAM_MAX_RANKS 8
+#define DRAM_MAX_BANKS 16
+#define DRAM_FAW_ACTIVATES 4
+
+// the rest of DDR3-1600's timings, in core cycles
+#define DRAM_TRRD 24
+#define DRAM_TWR 48
+#define DRAM_TWTR 24
+#define DRAM_TRTP 24
+#define DRAM_TCWL 32
+#define DRAM_TRTW 8
+
+// the access classes
+#define MC_DEMAND 0
+#define MC_PREFETCH 1
+#define MC_WRITE 2
+#define MC_CLASS_COUNT 3
+
+// how an access found its bank
+#define DRAM_ROW_HIT 0
+#define DRAM_ROW_CLOSED 1
+#define DRAM_ROW_CONFLICT 2
+
+// the next command of an access
+#define DRAM_COMMAND_NONE 0
+#define DRAM_COMMAND_PRECHARGE 1
+#define DRAM_COMMAND_ACTIVATE 2
+#define DRAM_COMMAND_COLUMN 3
+
+#define DRAM_SCHEDULER_DEMAND_FIRST 0
+#define DRAM_SCHEDULER_FRFCFS 1
+#define DRAM_SCHEDULER_FCFS 2
+
+// a read from the LLC
+typedef struct mc_read
+{
+  int cpu_num;
+  unsigned long long int addr;
+  unsigned long long int reserved;
+  long long int cycle;
+  int prefetch;
+  int fill_level;
+} mc_read_t;
+
+// a dirty line written back from the LLC
+typedef struct mc_write
+{
+  int cpu_num;
+  unsigned long long int addr;
+  unsigned long long int reserved;
+  long long int cycle;
+  int reserved2;
+} mc_write_t;
+
+typedef struct mc_queues
+{
+  int read_count;
+  mc_read_t read[MC_READ_QUEUE_SIZE];
+  int write_count;
+  mc_write_t write[MC_WRITE_QUEUE_SIZE];
+} mc_queues_t;
+
+// a channel, as lib/dpc2sim.a lays it out
+typedef struct dram_channel
+{
+  // the first cycle the data bus is free
+  long long int bus_cycle;
+  int write_mode;
+  // library: the cycle the bank was last accessed, less DRAM_DBUS_TRANSFER_TIME, ddr: the cycle of its last READ or WRITE
+  long long int bank_cycle[DRAM_LIBRARY_BANKS];
+  // -1 if closed
+  int open_row[DRAM_LIBRARY_BANKS];
+} dram_channel_t;
+
+// the ddr model's banks and ranks
+typedef struct dram_bank
+{
+  // -1 if closed
+  int open_row;
+  // the first cycles it takes an ACTIVATE, a READ or WRITE, and a PRECHARGE
+  long long int activate_cycle;
+  long long int column_cycle;
+  long long int precharge_cycle;
+} dram_bank_t;
+
+typedef struct dram_rank
+{
+  // the first cycle it takes an ACTIVATE, and the cycles of its last DRAM_FAW_ACTIVATES ACTIVATEs
+  long long int activate_cycle;
+  long long int faw[DRAM_FAW_ACTIVATES];
+  int faw_next;
+} dram_rank_t;
+
+typedef struct dram_ddr_channel
+{
+  dram_bank_t bank[DRAM_MAX_RANKS][DRAM_MAX_BANKS];
+  dram_rank_t rank[DRAM_MAX_RANKS];
+  // the end of the last write back's data, and 1 if the last data on the bus was written
+  long long int write_end;
+  int bus_written;
+} dram_ddr_channel_t;
+
+typedef struct mc_counters
+{
+  unsigned long long int accesses[MC_CLASS_COUNT];
+  unsigned long long int rows[MC_CLASS_COUNT][3];
+  unsigned long long int latency[MC_CLASS_COUNT];
+} mc_counters_t;
+
+typedef struct mc_model
+{
+  const char *name;
+  void (*operate)();
+} mc_model_t;
+
+extern unsigned char ooo_cpu[];
+extern unsigned char uncore[];
+extern int DRAM_DBUS_TRANSFER_TIME;
+extern long long int warmup_instructions;
+
+// the number of cores sharing the LLC, if tools/llc.c is linked in
+extern int llc_cpus __attribute__((weak));
+
+void llc_add_to_fill_queue(int cpu_num, unsigned long long int addr, int fill_level);
+
+dram_channel_t dram_channel[DRAM_MAX_CHANNELS];
+dram_ddr_channel_t dram_ddr_channel[DRAM_MAX_CHANNELS];
+
+// the cycle each read's data is back, 0 until ddr sent it
+long long int mc_read_done[MC_READ_QUEUE_SIZE];
+
+// how each read and write back found its bank in ddr, as of the first command sent for it
+int mc_read_row[MC_READ_QUEUE_SIZE];
+int mc_write_row[MC_WRITE_QUEUE_SIZE];
+
+int dram_channels = 1;
+int dram_ranks = 1;
+int dram_banks = DRAM_LIBRARY_BANKS;
+int dram_channel_bits;
+int dram_rank_bits;
+int dram_bank_bits = 3;
+
+int dram_trcd;
+int dram_trp;
+int dram_tcas;
+int dram_tras;
+int dram_tfaw;
+int dram_scheduler;
+int dram_write_high;
+int dram_write_low;
+
+mc_counters_t mc_counters;
+int mc_warmup_complete;
+
+const char *mc_class_names[MC_CLASS_COUNT] = { "demand", "prefetch", "write" };
+
+mc_queues_t *mc_queues()
+{
+  return (mc_queues_t *)(uncore + UNCORE_MC_QUEUES_OFFSET);
+}
+
+long long int mc_cycle()
+{
+  return *(long long int *)(uncore + UNCORE_CYCLE_OFFSET);
+}
+
+int mc_llc_fill_count()
+{
+  return *(int *)(uncore + UNCORE_LLC_FILL_COUNT_OFFSET);
+}
+
+/*
+  Address mapping
+*/
+
+int dram_get_channel(unsigned long long int address)
+{
+  return (address >> (6 + DRAM_COLUMN_BITS)) & (dram_channels - 1);
+}
+
+int dram_get_bank(unsigned long long int address)
+{
+  return (address >> (6 + DRAM_COLUMN_BITS + dram_channel_bits)) & (dram_banks - 1);
+}
+
+int dram_get_rank(unsigned long long int address)
+{
+  return (address >> (6 + DRAM_COLUMN_BITS + dram_channel_bits + dram_bank_bits)) & (dram_ranks - 1);
+}
+
+int dram_get_row(unsigned long long int address)
+{
+  return (address >> (6 + DRAM_COLUMN_BITS + dram_channel_bits + dram_bank_bits + dram_rank_bits)) & ((1<<DRAM_ROW_BITS) - 1);
+}
+
+int dram_get_column(unsigned long long int address)
+{
+  return (address >> 6) & ((1<<DRAM_COLUMN_BITS) - 1);
+}
+
+/*
+  Counters
+*/
+
+// the counters start over once every core is done with its warmup
+void mc_count_warmup()
+{
+  if(mc_warmup_complete)
+    {
+      return;
+    }
+
+  int cpus = (&llc_cpus != NULL) ? llc_cpus : 1;
+  int cpu;
+  for(cpu=0; cpu<cpus; cpu++)
+    {
+      if(*(long long int *)(ooo_cpu + cpu*OOO_CPU_SIZE + OOO_CPU_RETIRED_OFFSET) <= warmup_instructions)
+	{
+	  return;
+	}
+    }
+  memset(&mc_counters, 0, sizeof(mc_counters));
+  mc_warmup_complete = 1;
+}
+
+void mc_count(int access_class, int row, long long int latency)
+{
+  mc_counters.accesses[access_class]++;
+  mc_counters.rows[access_class][row]++;
+  mc_counters.latency[access_class] += latency;
+}
+
+// the simulator exits without telling the memory controller, so the counters are printed on exit
+void mc_print_counters()
+{
+  int i;
+  for(i=0; i<MC_CLASS_COUNT; i++)
+    {
+      printf("DRAM %s Accesses: %llu Row hits: %llu Closed rows: %llu Row conflicts: %llu Average latency: %f\n", mc_class_names[i],
+	     mc_counters.accesses[i], mc_counters.rows[i][DRAM_ROW_HIT], mc_counters.rows[i][DRAM_ROW_CLOSED],
+	     mc_counters.rows[i][DRAM_ROW_CONFLICT],
+	     mc_counters.accesses[i] ? (double)mc_counters.latency[i]/mc_counters.accesses[i] : 0.0);
+    }
+}
+
+// called by tools/checkpoint.c, if it is linked in
+void mc_checkpoint(void (*region)(void *data, unsigned long long int size))
+{
+  region(dram_channel, sizeof(dram_channel));
+  region(dram_ddr_channel, sizeof(dram_ddr_channel));
+  region(mc_read_done, sizeof(mc_read_done));
+  region(mc_read_row, sizeof(mc_read_row));
+  region(mc_write_row, sizeof(mc_write_row));
+}
+
+/*
+  The queues
+*/
+
+// the read's data is back, and it goes to the LLC
+void mc_return_data(int cpu_num, unsigned long long int addr, int fill_level)
+{
+  llc_add_to_fill_queue(cpu_num, addr, fill_level);
+  mc_queues()->read_count--;
+}
+
+void mc_add_to_write_queue(unsigned long long int addr)
+{
+  mc_queues_t *queues = mc_queues();
+  unsigned long long int cl_addr = (addr>>6)<<6;
+  int i;
+
+  // a full queue drops the write
+  if(queues->write_count >= MC_WRITE_QUEUE_SIZE)
+    {
+      return;
+    }
+
+  for(i=0; i<MC_WRITE_QUEUE_SIZE; i++)
+    {
+      if(queues->write[i].addr == cl_addr)
+	{
+	  return;
+	}
+    }
+
+  for(i=0; i<MC_WRITE_QUEUE_SIZE; i++)
+    {
+      if(queues->write[i].addr == 0)
+	{
+	  queues->write[i].cpu_num = -1;
+	  queues->write[i].addr = cl_addr;
+	  queues->write[i].cycle = mc_cycle();
+	  queues->write[i].reserved2 = 0;
+	  queues->write_count++;
+	  return;
+	}
+    }
+}
+
+void mc_add_to_read_queue(int cpu_num, unsigned long long int addr, int fill_level, int prefetch)
+{
+  mc_queues_t *queues = mc_queues();
+  unsigned long long int cl_addr = (addr>>6)<<6;
+  int i;
+
+  // a read of a line already in the queue is merged into it, and keeps its core
+  for(i=0; i<MC_READ_QUEUE_SIZE; i++)
+    {
+      if(queues->read[i].addr == cl_addr)
+	{
+	  queues->read[i].fill_level |= fill_level;
+	  if(!prefetch)
+	    {
+	      queues->read[i].prefetch = 0;
+	    }
+	  return;
+	}
+    }
+
+  if(queues->read_count >= MC_READ_QUEUE_SIZE)
+    {
+      printf("ERROR: The MC read queue got too full.\n");
+      fflush(stdout);
+      exit(0);
+    }
+
+  for(i=0; i<MC_READ_QUEUE_SIZE; i++)
+    {
+      if(queues->read[i].addr == 0)
+	{
+	  queues->read[i].cpu_num = cpu_num;
+	  queues->read[i].addr = cl_addr;
+	  queues->read[i].cycle = mc_cycle();
+	  queues->read[i].prefetch = prefetch;
+	  queues->read[i].fill_level = fill_level;
+	  mc_read_done[i] = 0;
+	  queues->read_count++;
+	  return;
+	}
+    }
+}
+
+/*
+  library
+*/
+
+int mc_library_row_hit(unsigned long long int addr)
+{
+  return dram_channel[0].open_row[dram_get_bank(addr)] == dram_get_row(addr);
+}
+
+// sends the access if it waited long enough and its bank was idle long enough, returns 1 if it did
+int mc_library_send(unsigned long long int addr, long long int queued, int latency)
+{
+  dram_channel_t *channel = &dram_channel[0];
+  long long int cycle = mc_cycle();
+  long long int ready = cycle - (DRAM_DBUS_TRANSFER_TIME + latency);
+  int bank = dram_get_bank(addr);
+  if((queued > ready) || (ready <= channel->bank_cycle[bank]))
+    {
+      return 0;
+    }
+
+  channel->bank_cycle[bank] = cycle - DRAM_DBUS_TRANSFER_TIME;
+  channel->bus_cycle = cycle + DRAM_DBUS_TRANSFER_TIME;
+  channel->open_row[bank] = dram_get_row(addr);
+
+  return 1;
+}
+
+// the oldest write back, to the open row or not, -1 if there is none
+int mc_library_oldest_write(int row_hit)
+{
+  mc_queues_t *queues = mc_queues();
+  int oldest_cycle = mc_cycle();
+  int oldest = -1;
+  int i;
+  for(i=0; i<MC_WRITE_QUEUE_SIZE; i++)
+    {
+      if((queues->write[i].addr != 0) && (!row_hit || mc_library_row_hit(queues->write[i].addr)) &&
+	 (queues->write[i].cycle < oldest_cycle))
+	{
+	  oldest_cycle = queues->write[i].cycle;
+	  oldest = i;
+	}
+    }
+
+  return oldest;
+}
+
+// the oldest demand read or prefetch, to the open row or not, -1 if there is none
+int mc_library_oldest_read(int prefetch, int row_hit)
+{
+  mc_queues_t *queues = mc_queues();
+  int oldest_cycle = mc_cycle();
+  int oldest = -1;
+  int i;
+  for(i=0; i<MC_READ_QUEUE_SIZE; i++)
+    {
+      if((queues->read[i].addr != 0) && ((queues->read[i].prefetch != 0) == prefetch) &&
+	 (!row_hit || mc_library_row_hit(queues->read[i].addr)) && (queues->read[i].cycle < oldest_cycle))
+	{
+	  oldest_cycle = queues->read[i].cycle;
+	  oldest = i;
+	}
+    }
+
+  return oldest;
+}
+
+int mc_library_write(int row_hit)
+{
+  mc_queues_t *queues = mc_queues();
+  int i = mc_library_oldest_write(row_hit);
+  if(i == -1)
+    {
+      return 0;
+    }
+
+  mc_write_t *write = &queues->write[i];
+  int row = mc_library_row_hit(write->addr) ? DRAM_ROW_HIT :
+    ((dram_channel[0].open_row[dram_get_bank(write->addr)] == -1) ? DRAM_ROW_CLOSED : DRAM_ROW_CONFLICT);
+  if(!mc_library_send(write->addr, write->cycle, row_hit ? DRAM_ROW_HIT_LATENCY : DRAM_ROW_MISS_LATENCY))
+    {
+      return 0;
+    }
+
+  mc_count(MC_WRITE, row, mc_cycle() + DRAM_DBUS_TRANSFER_TIME - write->cycle);
+  write->addr = 0;
+  queues->write_count--;
+
+  return 1;
+}
+
+int mc_library_read(int prefetch, int row_hit)
+{
+  mc_queues_t *queues = mc_queues();
+  int i = mc_library_oldest_read(prefetch, row_hit);
+  if(i == -1)
+    {
+      return 0;
+    }
+
+  mc_read_t *read = &queues->read[i];
+  unsigned long long int addr = read->addr;
+  int row = mc_library_row_hit(addr) ? DRAM_ROW_HIT :
+    ((dram_channel[0].open_row[dram_get_bank(addr)] == -1) ? DRAM_ROW_CLOSED : DRAM_ROW_CONFLICT);
+  if(!mc_library_send(addr, read->cycle, row_hit ? DRAM_ROW_HIT_LATENCY : DRAM_ROW_MISS_LATENCY))
+    {
+      return 0;
+    }
+
+  mc_count(prefetch ? MC_PREFETCH : MC_DEMAND, row, mc_cycle() + DRAM_DBUS_TRANSFER_TIME - read->cycle);
+  mc_return_data(read->cpu_num, addr, read->fill_level);
+  read->addr = 0;
+
+  return 1;
+}
+
+void mc_library_operate()
+{
+  mc_queues_t *queues = mc_queues();
+  dram_channel_t *channel = &dram_channel[0];
+  int write_count = queues->write_count;
+
+  // an empty write queue costs the turnaround twice, as in lib/dpc2sim.a
+  if(!channel->write_mode)
+    {
+      if(write_count >= MC_WRITE_QUEUE_SIZE)
+	{
+	  channel->bus_cycle += DRAM_TURNAROUND;
+	  channel->write_mode = 1;
+	}
+    }
+  else
+    {
+      if(write_count == 0)
+	{
+	  channel->bus_cycle += DRAM_TURNAROUND;
+	  channel->write_mode = 0;
+	}
+      if(write_count <= DRAM_WRITE_DRAIN_LOW)
+	{
+	  channel->bus_cycle += DRAM_TURNAROUND;
+	  channel->write_mode = 0;
+	}
+    }
+
+  if(channel->write_mode && (write_count > 0) && (mc_cycle() >= channel->bus_cycle))
+    {
+      if(mc_library_write(1) || mc_library_write(0))
+	{
+	  return;
+	}
+    }
+
+  if((queues->read_count <= 0) || (mc_llc_fill_count() > MC_MAX_LLC_FILLS) || (mc_cycle() < channel->bus_cycle) ||
+     channel->write_mode)
+    {
+      return;
+    }
+
+  if(!mc_library_read(0, 1) && !mc_library_read(1, 1) && !mc_library_read(0, 0))
+    {
+      mc_library_read(1, 0);
+    }
+}
+
+/*
+  ddr
+*/
+
+long long int dram_max(long long int a, long long int b)
+{
+  return (a > b) ? a : b;
+}
+
+// the bank's state for the line
+int dram_row_state(dram_bank_t *bank, unsigned long long int addr)
+{
+  if(bank->open_row == -1)
+    {
+      return DRAM_ROW_CLOSED;
+    }
+
+  return (bank->open_row == dram_get_row(addr)) ? DRAM_ROW_HIT : DRAM_ROW_CONFLICT;
+}
+
+// the first cycle the rank takes another ACTIVATE, at or after the given one
+long long int dram_activate_cycle(dram_rank_t *rank, long long int cycle)
+{
+  cycle = dram_max(cycle, rank->activate_cycle);
+
+  return dram_max(cycle, rank->faw[rank->faw_next] + dram_tfaw);
+}
+
+// the access's next command, if its bank, its rank and the data bus take it this cycle
+int dram_command(unsigned long long int addr, int write)
+{
+  dram_channel_t *library_channel = &dram_channel[dram_get_channel(addr)];
+  dram_ddr_channel_t *channel = &dram_ddr_channel[dram_get_channel(addr)];
+  dram_rank_t *rank = &channel->rank[dram_get_rank(addr)];
+  dram_bank_t *bank = &channel->bank[dram_get_rank(addr)][dram_get_bank(addr)];
+  long long int cycle = mc_cycle();
+
+  switch(dram_row_state(bank, addr))
+    {
+    case DRAM_ROW_HIT:
+      // the READ or WRITE waits until the data bus is free when its data comes, after the turnaround from a write to a read or back
+      if((bank->column_cycle > cycle) ||
+	 (cycle + (write ? DRAM_TCWL : dram_tcas) < library_channel->bus_cycle + ((channel->bus_written != write) ? DRAM_TRTW : 0)) ||
+	 (!write && (cycle < channel->write_end + DRAM_TWTR)))
+	{
+	  return DRAM_COMMAND_NONE;
+	}
+      return DRAM_COMMAND_COLUMN;
+    case DRAM_ROW_CLOSED:
+      return ((bank->activate_cycle <= cycle) && (dram_activate_cycle(rank, cycle) <= cycle)) ? DRAM_COMMAND_ACTIVATE : DRAM_COMMAND_NONE;
+    default:
+      return (bank->precharge_cycle <= cycle) ? DRAM_COMMAND_PRECHARGE : DRAM_COMMAND_NONE;
+    }
+}
+
+// sends a PRECHARGE or an ACTIVATE for the access
+void dram_send_row(unsigned long long int addr, int command)
+{
+  dram_channel_t *library_channel = &dram_channel[dram_get_channel(addr)];
+  dram_ddr_channel_t *channel = &dram_ddr_channel[dram_get_channel(addr)];
+  dram_rank_t *rank = &channel->rank[dram_get_rank(addr)];
+  dram_bank_t *bank = &channel->bank[dram_get_rank(addr)][dram_get_bank(addr)];
+  long long int cycle = mc_cycle();
+
+  if(command == DRAM_COMMAND_PRECHARGE)
+    {
+      bank->open_row = -1;
+      bank->activate_cycle = cycle + dram_trp;
+    }
+  else
+    {
+      rank->activate_cycle = cycle + DRAM_TRRD;
+      rank->faw[rank->faw_next] = cycle;
+      rank->faw_next = (rank->faw_next + 1) % DRAM_FAW_ACTIVATES;
+      bank->open_row = dram_get_row(addr);
+      bank->column_cycle = cycle + dram_trcd;
+      bank->precharge_cycle = cycle + dram_tras;
+    }
+
+  if((dram_get_rank(addr) == 0) && (dram_get_bank(addr) < DRAM_LIBRARY_BANKS))
+    {
+      library_channel->open_row[dram_get_bank(addr)] = bank->open_row;
+    }
+}
+
+// sends the READ or WRITE of the access, and returns the cycle its data transfer ends
+long long int dram_send_column(unsigned long long int addr, int write)
+{
+  dram_channel_t *library_channel = &dram_channel[dram_get_channel(addr)];
+  dram_ddr_channel_t *channel = &dram_ddr_channel[dram_get_channel(addr)];
+  dram_bank_t *bank = &channel->bank[dram_get_rank(addr)][dram_get_bank(addr)];
+  long long int cycle = mc_cycle();
+  long long int end = cycle + (write ? DRAM_TCWL : dram_tcas) + DRAM_DBUS_TRANSFER_TIME;
+
+  bank->column_cycle = cycle + DRAM_DBUS_TRANSFER_TIME;
+  bank->precharge_cycle = dram_max(bank->precharge_cycle, write ? end + DRAM_TWR : cycle + DRAM_TRTP);
+  library_channel->bus_cycle = end;
+  channel->bus_written = write;
+  if(write)
+    {
+      channel->write_end = end;
+    }
+
+  if((dram_get_rank(addr) == 0) && (dram_get_bank(addr) < DRAM_LIBRARY_BANKS))
+    {
+      library_channel->bank_cycle[dram_get_bank(addr)] = cycle;
+    }
+
+  return end;
+}
+
+// how the scheduler ranks the access, lower first, row_hit being 1 for a READ or WRITE to the open row
+int dram_priority(int prefetch, int row_hit)
+{
+  switch(dram_scheduler)
+    {
+    case DRAM_SCHEDULER_DEMAND_FIRST:
+      return 2*(prefetch != 0) + !row_hit;
+    case DRAM_SCHEDULER_FRFCFS:
+      return !row_hit;
+    default:
+      return 0;
+    }
+}
+
+// 1 if a write back or a read not sent yet to the open row of the line's bank goes before an access ranked priority and queued at cycle
+int dram_row_wanted(unsigned long long int addr, int write, int priority, long long int cycle)
+{
+  mc_queues_t *queues = mc_queues();
+  dram_bank_t *bank = &dram_ddr_channel[dram_get_channel(addr)].bank[dram_get_rank(addr)][dram_get_bank(addr)];
+  int count = write ? MC_WRITE_QUEUE_SIZE : MC_READ_QUEUE_SIZE;
+  int i;
+
+  for(i=0; i<count; i++)
+    {
+      unsigned long long int other = write ? queues->write[i].addr : queues->read[i].addr;
+      if((other == 0) || (!write && (mc_read_done[i] != 0)) || (dram_get_channel(other) != dram_get_channel(addr)) ||
+	 (dram_get_rank(other) != dram_get_rank(addr)) || (dram_get_bank(other) != dram_get_bank(addr)) ||
+	 (dram_row_state(bank, other) != DRAM_ROW_HIT))
+	{
+	  continue;
+	}
+
+      int other_priority = dram_priority(write ? 0 : queues->read[i].prefetch, 1);
+      long long int other_cycle = write ? queues->write[i].cycle : queues->read[i].cycle;
+      if((other_priority < priority) || ((other_priority == priority) && (other_cycle <= cycle)))
+	{
+	  return 1;
+	}
+    }
+
+  return 0;
+}
+
+// the write back or read of the channel with the best command this cycle, -1 if there is none
+int dram_pick(int channel_num, int write, int *command)
+{
+  mc_queues_t *queues = mc_queues();
+  int best = -1;
+  int best_priority = 0;
+  long long int best_cycle = 0;
+  int count = write ? MC_WRITE_QUEUE_SIZE : MC_READ_QUEUE_SIZE;
+  int i;
+
+  for(i=0; i<count; i++)
+    {
+      unsigned long long int addr = write ? queues->write[i].addr : queues->read[i].addr;
+      if((addr == 0) || (!write && (mc_read_done[i] != 0)) || (dram_get_channel(addr) != channel_num))
+	{
+	  continue;
+	}
+      int next = dram_command(addr, write);
+      if(next == DRAM_COMMAND_NONE)
+	{
+	  continue;
+	}
+
+      int priority = dram_priority(write ? 0 : queues->read[i].prefetch, next == DRAM_COMMAND_COLUMN);
+      long long int queued = write ? queues->write[i].cycle : queues->read[i].cycle;
+      // a row is not closed while an access that goes first waits for it
+      if((next == DRAM_COMMAND_PRECHARGE) && dram_row_wanted(addr, write, priority, queued))
+	{
+	  continue;
+	}
+
+      if((best == -1) || (priority < best_priority) || ((priority == best_priority) && (queued < best_cycle)))
+	{
+	  best = i;
+	  best_priority = priority;
+	  best_cycle = queued;
+	  *command = next;
+	}
+    }
+
+  return best;
+}
+
+// the channel's write backs and the reads it has not sent yet
+void dram_count(int channel_num, int *reads, int *writes)
+{
+  mc_queues_t *queues = mc_queues();
+  int i;
+
+  *reads = 0;
+  *writes = 0;
+  for(i=0; i<MC_READ_QUEUE_SIZE; i++)
+    {
+      if((queues->read[i].addr != 0) && (mc_read_done[i] == 0) && (dram_get_channel(queues->read[i].addr) == channel_num))
+	{
+	  (*reads)++;
+	}
+    }
+  for(i=0; i<MC_WRITE_QUEUE_SIZE; i++)
+    {
+      if((queues->write[i].addr != 0) && (dram_get_channel(queues->write[i].addr) == channel_num))
+	{
+	  (*writes)++;
+	}
+    }
+}
+
+void dram_channel_operate(int channel_num)
+{
+  mc_queues_t *queues = mc_queues();
+  dram_channel_t *channel = &dram_channel[channel_num];
+  int reads, writes;
+
+  dram_count(channel_num, &reads, &writes);
+  if(!channel->write_mode && (writes > 0) && ((queues->write_count >= dram_write_high) || (reads == 0)))
+    {
+      channel->write_mode = 1;
+    }
+  else if(channel->write_mode && ((writes == 0) || ((queues->write_count <= dram_write_low) && (reads > 0))))
+    {
+      channel->write_mode = 0;
+    }
+
+  int command;
+  int i = dram_pick(channel_num, channel->write_mode, &command);
+  if(i == -1)
+    {
+      return;
+    }
+
+  int write = channel->write_mode;
+  unsigned long long int addr = write ? queues->write[i].addr : queues->read[i].addr;
+  int *row = write ? &mc_write_row[i] : &mc_read_row[i];
+  if(command != DRAM_COMMAND_COLUMN)
+    {
+      // the access found its bank with the row closed or another one open, unless a command was sent for it before
+      if(*row == DRAM_ROW_HIT)
+	{
+	  *row = (command == DRAM_COMMAND_PRECHARGE) ? DRAM_ROW_CONFLICT : DRAM_ROW_CLOSED;
+	}
+      dram_send_row(addr, command);
+      return;
+    }
+
+  long long int end = dram_send_column(addr, write);
+  if(write)
+    {
+      mc_count(MC_WRITE, *row, end - queues->write[i].cycle);
+      queues->write[i].addr = 0;
+      queues->write_count--;
+    }
+  else
+    {
+      mc_read_done[i] = end;
+      mc_count(queues->read[i].prefetch ? MC_PREFETCH : MC_DEMAND, *row, end - queues->read[i].cycle);
+    }
+  *row = DRAM_ROW_HIT;
+}
+
+void mc_ddr_operate()
+{
+  mc_queues_t *queues = mc_queues();
+  long long int cycle = mc_cycle();
+  int i;
+
+  // the reads whose data is back go to the LLC, while it has room
+  for(i=0; i<MC_READ_QUEUE_SIZE; i++)
+    {
+      if((queues->read[i].addr != 0) && (mc_read_done[i] != 0) && (mc_read_done[i] <= cycle))
+	{
+	  if(mc_llc_fill_count() > MC_MAX_LLC_FILLS)
+	    {
+	      break;
+	    }
+	  mc_return_data(queues->read[i].cpu_num, queues->read[i].addr, queues->read[i].fill_level);
+	  queues->read[i].addr = 0;
+	  mc_read_done[i] = 0;
+	}
+    }
+
+  int channel_num;
+  for(channel_num=0; channel_num<dram_channels; channel_num++)
+    {
+      dram_channel_operate(channel_num);
+    }
+}
+
+/*
+  The memory controller
+*/
+
+mc_model_t mc_models[] =
+  {
+    { "library", mc_library_operate },
+    { "ddr", mc_ddr_operate },
+  };
+
+#define MC_MODEL_COUNT (sizeof(mc_models)/sizeof(mc_model_t))
+
+mc_model_t *mc_model = &mc_models[0];
+
+int mc_parse(const char *name, int value, int min, int max)
+{
+  const char *text = getenv(name);
+  if(text == NULL)
+    {
+      return value;
+    }
+
+  char *end;
+  value = strtol(text, &end, 10);
+  if((*text == '\0') || (*end != '\0') || (value < min) || (value > max))
+    {
+      printf("%s must be between %d and %d. Exiting.\n", name, min, max);
+      exit(1);
+    }
+
+  return value;
+}
+
+// the log2 of a power of two between 1 and max
+int mc_parse_bits(const char *name, int value, int max)
+{
+  value = mc_parse(name, value, 1, max);
+  if(value & (value - 1))
+    {
+      printf("%s must be a power of two. Exiting.\n", name);
+      exit(1);
+    }
+
+  int bits = 0;
+  while((1<<bits) < value)
+    {
+      bits++;
+    }
+
+  return bits;
+}
+
+void mc_model_initialize()
+{
+  const char *name = getenv("DRAM_MODEL");
+  if(name != NULL)
+    {
+      unsigned int i;
+      for(i=0; i<MC_MODEL_COUNT; i++)
+	{
+	  if(strcmp(name, mc_models[i].name) == 0)
+	    {
+	      break;
+	    }
+	}
+      if(i == MC_MODEL_COUNT)
+	{
+	  printf("Unknown DRAM model %s, choose from library and ddr. Exiting.\n", name);
+	  exit(1);
+	}
+      mc_model = &mc_models[i];
+    }
+
+  if(mc_model == &mc_models[0])
+    {
+      return;
+    }
+
+  dram_channel_bits = mc_parse_bits("DRAM_CHANNELS", 1, DRAM_MAX_CHANNELS);
+  dram_rank_bits = mc_parse_bits("DRAM_RANKS", 1, DRAM_MAX_RANKS);
+  dram_bank_bits = mc_parse_bits("DRAM_BANKS", DRAM_LIBRARY_BANKS, DRAM_MAX_BANKS);
+  dram_channels = 1<<dram_channel_bits;
+  dram_ranks = 1<<dram_rank_bits;
+  dram_banks = 1<<dram_bank_bits;
+
+  dram_trcd = mc_parse("DRAM_TRCD", 44, 1, 10000);
+  dram_trp = mc_parse("DRAM_TRP", 44, 1, 10000);
+  dram_tcas = mc_parse("DRAM_TCAS", 44, 1, 10000);
+  dram_tras = mc_parse("DRAM_TRAS", 112, 1, 10000);
+  dram_tfaw = mc_parse("DRAM_TFAW", 128, 0, 10000);
+  dram_write_high = mc_parse("DRAM_WRITE_HIGH", 24, 1, MC_WRITE_QUEUE_SIZE);
+  dram_write_low = mc_parse("DRAM_WRITE_LOW", 8, 0, MC_WRITE_QUEUE_SIZE - 1);
+
+  const char *scheduler = getenv("DRAM_SCHEDULER");
+  const char *scheduler_names[] = { "demand_first", "frfcfs", "fcfs" };
+  dram_scheduler = DRAM_SCHEDULER_DEMAND_FIRST;
+  if(scheduler != NULL)
+    {
+      for(dram_scheduler=0; dram_scheduler<3; dram_scheduler++)
+	{
+	  if(strcmp(scheduler, scheduler_names[dram_scheduler]) == 0)
+	    {
+	      break;
+	    }
+	}
+      if(dram_scheduler == 3)
+	{
+	  printf("Unknown DRAM scheduler %s, choose from demand_first, frfcfs and fcfs. Exiting.\n", scheduler);
+	  exit(1);
+	}
+    }
+
+  printf("DRAM model: ddr, %d channels of %d ranks of %d banks, tRCD %d tRP %d tCAS %d tRAS %d tFAW %d cycles, %s scheduler, "
+	 "write drain from %d to %d\n", dram_channels, dram_ranks, dram_banks, dram_trcd, dram_trp, dram_tcas, dram_tras, dram_tfaw,
+	 scheduler_names[dram_scheduler], dram_write_high, dram_write_low);
+}
+
+void initialize_memory_controller()
+{
+  mc_queues_t *queues = mc_queues();
+  int i, j, k;
+
+  queues->read_count = 0;
+  for(i=0; i<MC_READ_QUEUE_SIZE; i++)
+    {
+      queues->read[i].cpu_num = -1;
+      queues->read[i].addr = 0;
+      queues->read[i].prefetch = 0;
+      queues->read[i].cycle = 0;
+      queues->read[i].fill_level = -1;
+    }
+  queues->write_count = 0;
+  for(i=0; i<MC_WRITE_QUEUE_SIZE; i++)
+    {
+      queues->write[i].cpu_num = -1;
+      queues->write[i].addr = 0;
+      queues->write[i].cycle = 0;
+      queues->write[i].reserved2 = 0;
+    }
+
+  memset(dram_channel, 0, sizeof(dram_channel));
+  memset(dram_ddr_channel, 0, sizeof(dram_ddr_channel));
+  for(i=0; i<DRAM_MAX_CHANNELS; i++)
+    {
+      for(j=0; j<DRAM_LIBRARY_BANKS; j++)
+	{
+	  dram_channel[i].open_row[j] = -1;
+	}
+      for(j=0; j<DRAM_MAX_RANKS; j++)
+	{
+	  for(k=0; k<DRAM_MAX_BANKS; k++)
+	    {
+	      dram_ddr_channel[i].bank[j][k].open_row = -1;
+	    }
+	}
+    }
+  memset(mc_read_done, 0, sizeof(mc_read_done));
+  memset(mc_read_row, 0, sizeof(mc_read_row));
+  memset(mc_write_row, 0, sizeof(mc_write_row));
+  memset(&mc_counters, 0, sizeof(mc_counters));
+  mc_warmup_complete = 0;
+
+  mc_model_initialize();
+
+  atexit(mc_print_counters);
+}
+
+void memory_controller_operate()
+{
+  mc_model->operate();
+  mc_count_warmup();
+}
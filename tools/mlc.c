@@ -0,0 +1,1137 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  The L2 (mid level cache, MLC) of lib/dpc2sim.a as source, with a choice
+  of replacement policies.  Linked in next to the prefetcher, it defines
+  every function and variable of the library's mlc.o, so the linker never
+  pulls mlc.o out of lib/dpc2sim.a.  With the default LRU policy the
+  simulation is the same as the library's, cycle for cycle.
+
+  The L2 is 256 sets of 8 ways.  Each cycle mlc_operate() handles at most
+  one fill from the LLC, one write back from the DCU and one read from the
+  DCU or the prefetcher, in that order and oldest first.  A miss takes an
+  MSHR, except for a prefetch that only fills the LLC.  The queues live in
+  ooo_cpu, next to the core's, at the offsets lib/dpc2sim.a gives them.
+  Built with -DNUM_CPUS=<n> for tools/multicore.c, each of the n cores has
+  its own L2, MSHRs and replacement state.
+
+  The replacement policy decides which valid line a fill evicts, and how
+  fills and hits update its state.  A fill goes to the first invalid way
+  whatever the policy.
+   - lru: the least recently filled or read line, the library's policy
+   - srrip: static re-reference interval prediction, with 2 bit RRPVs.
+     Lines are inserted at RRPV 2 and promoted to 0 on a demand hit.
+   - drrip: dynamic RRIP, set dueling between srrip and bimodal RRIP,
+     which inserts at RRPV 3 and only every 32nd line at 2
+   - ship: RRIP with insertion by signature based hit prediction (SHiP),
+     where the signature is the load's ip, kept apart for prefetches and
+     for the L2's own write misses.  A line whose signature's lines were
+     not hit again is inserted at RRPV 3, otherwise at 2.
+  With the RRIP policies, a prefetch that hits the L2 does not promote
+  the line.
+
+  Prefetched lines can be given their own insertion priority with
+  MLC_PREFETCH_RRPV, so that a prefetch that is never used leaves the
+  L2 before the demand lines it would otherwise push out.
+
+  How to compile:
+
+  gcc -Wall -o dpc2sim example_prefetchers/ampmE__prefetcher.c tools/mlc.c lib/dpc2sim.a
+
+  It can be linked together with the other files in tools/.
+
+  How to run:
+
+  zcat traces/lbm_trace2.dpc.gz | MLC_REPLACEMENT=ship MLC_PREFETCH_RRPV=3 ./dpc2sim
+
+  Options:
+
+  MLC_REPLACEMENT=<lru|srrip|drrip|ship>
+  The L2 replacement policy.  Default is lru.
+
+  MLC_PREFETCH_RRPV=<0-3>
+  The RRPV prefetched lines are inserted at.  With lru, 3 inserts them
+  at the LRU position and anything else at the MRU position.  Default is
+  to insert them like demand lines.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../inc/prefetcher.h"
+
+// lib/dpc2sim.a simulates one core, tools/multicore.c is built with -DNUM_CPUS for more
+#ifndef NUM_CPUS
+#define NUM_CPUS 1
+#endif
+#define MLC_CPUS NUM_CPUS
+
+// where the core keeps its cycle count and its DCU fill queue's length, and the LLC its read queue's length
+#define OOO_CPU_SIZE 0x9c270
+#define OOO_CPU_CYCLE_OFFSET 8
+#define OOO_CPU_DCU_FILL_COUNT_OFFSET 0x9b350
+#define OOO_CPU_MLC_QUEUES_OFFSET 0x9b458
+#define UNCORE_LLC_READ_COUNT_OFFSET 0xa18
+
+#define MLC_LATENCY 10
+#define MLC_READ_QUEUE_SIZE L2_READ_QUEUE_SIZE
+#define MLC_WRITE_QUEUE_SIZE 32
+#define MLC_FILL_QUEUE_SIZE 32
+#define DCU_FILL_QUEUE_SIZE 8
+#define LLC_READ_QUEUE_SIZE 32
+
+// a read that fills the DCU, next to FILL_L2 and FILL_LLC
+#define FILL_L1 (1<<0)
+
+typedef struct mlc_line
+{
+  int valid;
+  unsigned long long int tag;
+  int dirty;
+  long long int lru;
+  unsigned long long int reserved;
+} mlc_line_t;
+
+typedef struct mlc_mshr
+{
+  unsigned long long int addr;
+  int prefetch;
+} mlc_mshr_t;
+
+// a read from the DCU or the prefetcher
+typedef struct mlc_read
+{
+  int cpu_num;
+  unsigned long long int addr;
+  unsigned long long int ip;
+  long long int cycle;
+  int prefetch;
+  int fill_level;
+} mlc_read_t;
+
+// a dirty line written back from the DCU
+typedef struct mlc_write
+{
+  int cpu_num;
+  unsigned long long int addr;
+  unsigned long long int reserved;
+  long long int cycle;
+  // 1 once the line missed, and the write waits for it in an MSHR
+  int missed;
+} mlc_write_t;
+
+// a line coming back from the LLC
+typedef struct mlc_fill_request
+{
+  int cpu_num;
+  unsigned long long int addr;
+  long long int cycle;
+  int fill_level;
+} mlc_fill_request_t;
+
+typedef struct mlc_queues
+{
+  int read_count;
+  mlc_read_t read[MLC_READ_QUEUE_SIZE];
+  int write_count;
+  mlc_write_t write[MLC_WRITE_QUEUE_SIZE];
+  int fill_count;
+  mlc_fill_request_t fill[MLC_FILL_QUEUE_SIZE];
+} mlc_queues_t;
+
+extern unsigned char ooo_cpu[];
+extern unsigned char uncore[];
+
+mlc_line_t mlc_cache[MLC_CPUS][L2_SET_COUNT][L2_ASSOCIATIVITY];
+mlc_mshr_t mlc_mshr[MLC_CPUS][L2_MSHR_COUNT];
+
+// the number of cores the L2s are built for, checked by tools/multicore.c
+int mlc_cpus = MLC_CPUS;
+
+// the ip of the read each MSHR was taken for, which the replacement policy sees when the line is filled
+unsigned long long int mlc_mshr_ip[MLC_CPUS][L2_MSHR_COUNT];
+
+// the simulator's other caches
+void dcu_add_to_fill_queue(int cpu_num, unsigned long long int addr, int fill_level);
+int dcu_check_invalidate_write_back(int cpu_num, unsigned long long int addr);
+void dcu_invalidate(int cpu_num, unsigned long long int addr);
+void llc_add_to_read_queue(int cpu_num, unsigned long long int addr, int fill_level, int prefetch);
+void llc_add_to_write_queue(int cpu_num, unsigned long long int addr);
+
+// defined by tools/llc.c, if it is linked in
+void llc_set_read_ip(int cpu_num, unsigned long long int addr, unsigned long long int ip) __attribute__((weak));
+int llc_read_queue_full(int cpu_num) __attribute__((weak));
+
+mlc_queues_t *mlc_queues(int cpu_num)
+{
+  return (mlc_queues_t *)(ooo_cpu + cpu_num*OOO_CPU_SIZE + OOO_CPU_MLC_QUEUES_OFFSET);
+}
+
+long long int mlc_cycle(int cpu_num)
+{
+  return *(long long int *)(ooo_cpu + cpu_num*OOO_CPU_SIZE + OOO_CPU_CYCLE_OFFSET);
+}
+
+int mlc_dcu_fill_count(int cpu_num)
+{
+  return *(int *)(ooo_cpu + cpu_num*OOO_CPU_SIZE + OOO_CPU_DCU_FILL_COUNT_OFFSET);
+}
+
+// tools/llc.c shares the LLC's read queue out between the cores
+int mlc_llc_read_queue_full(int cpu_num)
+{
+  if(llc_read_queue_full)
+    {
+      return llc_read_queue_full(cpu_num);
+    }
+
+  return *(int *)(uncore + UNCORE_LLC_READ_COUNT_OFFSET) >= LLC_READ_QUEUE_SIZE;
+}
+
+/*
+  Replacement policies
+*/
+
+#define MLC_RRPV_MAX 3
+
+// DRRIP leader sets, out of every MLC_DUEL_PERIOD sets
+#define MLC_DUEL_PERIOD 16
+#define MLC_PSEL_MAX 1023
+#define MLC_BRRIP_PERIOD 32
+
+#define MLC_SHCT_SIZE 16384
+#define MLC_SHCT_MAX 7
+
+typedef struct mlc_replacement
+{
+  const char *name;
+  // picks the way to evict when every way of the set is valid
+  int (*victim)(int cpu_num, int set);
+  // a read hit the line
+  void (*hit)(int cpu_num, int set, int way, int prefetch);
+  // a line was filled, after mlc_fill()
+  void (*insert)(int cpu_num, int set, int way, int prefetch, unsigned long long int ip);
+  // a valid line is about to be replaced
+  void (*evict)(int cpu_num, int set, int way);
+} mlc_replacement_t;
+
+unsigned char mlc_rrpv[MLC_CPUS][L2_SET_COUNT][L2_ASSOCIATIVITY];
+unsigned short mlc_signature[MLC_CPUS][L2_SET_COUNT][L2_ASSOCIATIVITY];
+unsigned char mlc_reused[MLC_CPUS][L2_SET_COUNT][L2_ASSOCIATIVITY];
+unsigned char mlc_shct[MLC_CPUS][MLC_SHCT_SIZE];
+int mlc_psel[MLC_CPUS];
+int mlc_brrip_count[MLC_CPUS];
+
+// the RRPV of prefetched lines, -1 to insert them like demand lines
+int mlc_prefetch_rrpv = -1;
+
+int mlc_lru_victim(int cpu_num, int set)
+{
+  // the LRU cycle is compared as an int, like in lib/dpc2sim.a
+  int lru_way = 0;
+  int lru_cycle = mlc_cache[cpu_num][set][0].lru;
+  int way;
+  for(way=1; way<L2_ASSOCIATIVITY; way++)
+    {
+      if(mlc_cache[cpu_num][set][way].lru < lru_cycle)
+	{
+	  lru_cycle = mlc_cache[cpu_num][set][way].lru;
+	  lru_way = way;
+	}
+    }
+
+  return lru_way;
+}
+
+void mlc_lru_hit(int cpu_num, int set, int way, int prefetch)
+{
+  mlc_cache[cpu_num][set][way].lru = mlc_cycle(cpu_num);
+}
+
+void mlc_lru_insert(int cpu_num, int set, int way, int prefetch, unsigned long long int ip)
+{
+  if(prefetch && (mlc_prefetch_rrpv == MLC_RRPV_MAX))
+    {
+      mlc_cache[cpu_num][set][way].lru = 0;
+    }
+  else
+    {
+      mlc_cache[cpu_num][set][way].lru = mlc_cycle(cpu_num);
+    }
+}
+
+void mlc_no_evict(int cpu_num, int set, int way)
+{
+}
+
+int mlc_rrip_victim(int cpu_num, int set)
+{
+  while(1)
+    {
+      int way;
+      for(way=0; way<L2_ASSOCIATIVITY; way++)
+	{
+	  if(mlc_rrpv[cpu_num][set][way] == MLC_RRPV_MAX)
+	    {
+	      return way;
+	    }
+	}
+      for(way=0; way<L2_ASSOCIATIVITY; way++)
+	{
+	  mlc_rrpv[cpu_num][set][way]++;
+	}
+    }
+}
+
+void mlc_rrip_hit(int cpu_num, int set, int way, int prefetch)
+{
+  if(!prefetch)
+    {
+      mlc_rrpv[cpu_num][set][way] = 0;
+    }
+}
+
+void mlc_rrip_set_rrpv(int cpu_num, int set, int way, int prefetch, int rrpv)
+{
+  if(prefetch && (mlc_prefetch_rrpv != -1))
+    {
+      rrpv = mlc_prefetch_rrpv;
+    }
+  mlc_rrpv[cpu_num][set][way] = rrpv;
+}
+
+void mlc_srrip_insert(int cpu_num, int set, int way, int prefetch, unsigned long long int ip)
+{
+  mlc_rrip_set_rrpv(cpu_num, set, way, prefetch, MLC_RRPV_MAX-1);
+}
+
+int mlc_brrip_rrpv(int cpu_num)
+{
+  mlc_brrip_count[cpu_num] = (mlc_brrip_count[cpu_num] + 1) % MLC_BRRIP_PERIOD;
+  return (mlc_brrip_count[cpu_num] == 0) ? MLC_RRPV_MAX-1 : MLC_RRPV_MAX;
+}
+
+void mlc_drrip_insert(int cpu_num, int set, int way, int prefetch, unsigned long long int ip)
+{
+  // the first set of each period always uses SRRIP, the last one BRRIP, and their demand misses steer the others
+  int leader = set % MLC_DUEL_PERIOD;
+  int brrip;
+  if(leader == 0)
+    {
+      if(!prefetch && (mlc_psel[cpu_num] < MLC_PSEL_MAX))
+	{
+	  mlc_psel[cpu_num]++;
+	}
+      brrip = 0;
+    }
+  else if(leader == MLC_DUEL_PERIOD-1)
+    {
+      if(!prefetch && (mlc_psel[cpu_num] > 0))
+	{
+	  mlc_psel[cpu_num]--;
+	}
+      brrip = 1;
+    }
+  else
+    {
+      brrip = (mlc_psel[cpu_num] > MLC_PSEL_MAX/2);
+    }
+
+  mlc_rrip_set_rrpv(cpu_num, set, way, prefetch, brrip ? mlc_brrip_rrpv(cpu_num) : MLC_RRPV_MAX-1);
+}
+
+int mlc_ship_signature(unsigned long long int ip, int prefetch)
+{
+  unsigned long long int hash = ip ^ (ip>>14) ^ (ip>>28);
+  return ((hash<<1) | prefetch) % MLC_SHCT_SIZE;
+}
+
+void mlc_ship_hit(int cpu_num, int set, int way, int prefetch)
+{
+  if(prefetch)
+    {
+      return;
+    }
+
+  mlc_rrpv[cpu_num][set][way] = 0;
+  if(!mlc_reused[cpu_num][set][way])
+    {
+      int signature = mlc_signature[cpu_num][set][way];
+      if(mlc_shct[cpu_num][signature] < MLC_SHCT_MAX)
+	{
+	  mlc_shct[cpu_num][signature]++;
+	}
+      mlc_reused[cpu_num][set][way] = 1;
+    }
+}
+
+void mlc_ship_insert(int cpu_num, int set, int way, int prefetch, unsigned long long int ip)
+{
+  int signature = mlc_ship_signature(ip, prefetch);
+  mlc_signature[cpu_num][set][way] = signature;
+  mlc_reused[cpu_num][set][way] = 0;
+  mlc_rrip_set_rrpv(cpu_num, set, way, prefetch, (mlc_shct[cpu_num][signature] == 0) ? MLC_RRPV_MAX : MLC_RRPV_MAX-1);
+}
+
+void mlc_ship_evict(int cpu_num, int set, int way)
+{
+  int signature = mlc_signature[cpu_num][set][way];
+  if(!mlc_reused[cpu_num][set][way] && (mlc_shct[cpu_num][signature] > 0))
+    {
+      mlc_shct[cpu_num][signature]--;
+    }
+}
+
+mlc_replacement_t mlc_replacements[] =
+  {
+    { "lru", mlc_lru_victim, mlc_lru_hit, mlc_lru_insert, mlc_no_evict },
+    { "srrip", mlc_rrip_victim, mlc_rrip_hit, mlc_srrip_insert, mlc_no_evict },
+    { "drrip", mlc_rrip_victim, mlc_rrip_hit, mlc_drrip_insert, mlc_no_evict },
+    { "ship", mlc_rrip_victim, mlc_ship_hit, mlc_ship_insert, mlc_ship_evict },
+  };
+
+#define MLC_REPLACEMENT_COUNT (sizeof(mlc_replacements)/sizeof(mlc_replacement_t))
+
+mlc_replacement_t *mlc_replacement = &mlc_replacements[0];
+
+void mlc_replacement_initialize()
+{
+  const char *name = getenv("MLC_REPLACEMENT");
+  if(name != NULL)
+    {
+      unsigned int i;
+      for(i=0; i<MLC_REPLACEMENT_COUNT; i++)
+	{
+	  if(strcmp(name, mlc_replacements[i].name) == 0)
+	    {
+	      break;
+	    }
+	}
+      if(i == MLC_REPLACEMENT_COUNT)
+	{
+	  printf("Unknown L2 replacement policy %s, choose from lru, srrip, drrip and ship. Exiting.\n", name);
+	  exit(1);
+	}
+      mlc_replacement = &mlc_replacements[i];
+    }
+
+  const char *rrpv = getenv("MLC_PREFETCH_RRPV");
+  if(rrpv != NULL)
+    {
+      char *end;
+      mlc_prefetch_rrpv = strtol(rrpv, &end, 10);
+      if((*rrpv == '\0') || (*end != '\0') || (mlc_prefetch_rrpv < 0) || (mlc_prefetch_rrpv > MLC_RRPV_MAX))
+	{
+	  printf("MLC_PREFETCH_RRPV must be between 0 and %d. Exiting.\n", MLC_RRPV_MAX);
+	  exit(1);
+	}
+    }
+
+  if((mlc_replacement != &mlc_replacements[0]) || (mlc_prefetch_rrpv != -1))
+    {
+      printf("L2 replacement policy: %s", mlc_replacement->name);
+      if(mlc_prefetch_rrpv != -1)
+	{
+	  printf(", prefetches inserted at RRPV %d", mlc_prefetch_rrpv);
+	}
+      printf("\n");
+    }
+}
+
+void mlc_replacement_reset(int cpu_num)
+{
+  memset(mlc_rrpv[cpu_num], MLC_RRPV_MAX, sizeof(mlc_rrpv[cpu_num]));
+  memset(mlc_signature[cpu_num], 0, sizeof(mlc_signature[cpu_num]));
+  memset(mlc_reused[cpu_num], 0, sizeof(mlc_reused[cpu_num]));
+  memset(mlc_shct[cpu_num], 1, sizeof(mlc_shct[cpu_num]));
+  mlc_psel[cpu_num] = MLC_PSEL_MAX/2;
+  mlc_brrip_count[cpu_num] = 0;
+}
+
+// called by tools/checkpoint.c, if it is linked in
+void mlc_checkpoint(void (*region)(void *data, unsigned long long int size))
+{
+  region(mlc_mshr_ip, sizeof(mlc_mshr_ip));
+  region(mlc_rrpv, sizeof(mlc_rrpv));
+  region(mlc_signature, sizeof(mlc_signature));
+  region(mlc_reused, sizeof(mlc_reused));
+  region(mlc_shct, sizeof(mlc_shct));
+  region(mlc_psel, sizeof(mlc_psel));
+  region(mlc_brrip_count, sizeof(mlc_brrip_count));
+}
+
+/*
+  The cache
+*/
+
+void initialize_mlc(int cpu_num)
+{
+  mlc_queues_t *queues = mlc_queues(cpu_num);
+  int i, j;
+
+  queues->read_count = 0;
+  queues->write_count = 0;
+  queues->fill_count = 0;
+  for(i=0; i<MLC_READ_QUEUE_SIZE; i++)
+    {
+      queues->read[i].cpu_num = -1;
+      queues->read[i].addr = 0;
+      queues->read[i].ip = 0;
+      queues->read[i].prefetch = 0;
+      queues->read[i].cycle = 0;
+      queues->read[i].fill_level = -1;
+    }
+  for(i=0; i<MLC_WRITE_QUEUE_SIZE; i++)
+    {
+      queues->write[i].cpu_num = -1;
+      queues->write[i].addr = 0;
+      queues->write[i].cycle = 0;
+      queues->write[i].missed = 0;
+    }
+  for(i=0; i<MLC_FILL_QUEUE_SIZE; i++)
+    {
+      queues->fill[i].cpu_num = -1;
+      queues->fill[i].addr = 0;
+      queues->fill[i].cycle = 0;
+      queues->fill[i].fill_level = -1;
+    }
+
+  for(i=0; i<L2_SET_COUNT; i++)
+    {
+      for(j=0; j<L2_ASSOCIATIVITY; j++)
+	{
+	  mlc_cache[cpu_num][i][j].valid = 0;
+	  mlc_cache[cpu_num][i][j].tag = 0;
+	  mlc_cache[cpu_num][i][j].dirty = 0;
+	  mlc_cache[cpu_num][i][j].lru = 0;
+	}
+    }
+
+  for(i=0; i<L2_MSHR_COUNT; i++)
+    {
+      mlc_mshr[cpu_num][i].addr = 0;
+      mlc_mshr[cpu_num][i].prefetch = 0;
+      mlc_mshr_ip[cpu_num][i] = 0;
+    }
+
+  // the policy is the same for every core, lib/dpc2sim.a starts with the first
+  if(cpu_num == 0)
+    {
+      mlc_replacement_initialize();
+    }
+  mlc_replacement_reset(cpu_num);
+
+  l2_prefetcher_initialize(cpu_num);
+}
+
+void mlc_add_to_read_queue(int cpu_num, unsigned long long int addr, unsigned long long int ip, int fill_level, int prefetch)
+{
+  mlc_queues_t *queues = mlc_queues(cpu_num);
+  unsigned long long int cl_addr = (addr>>6)<<6;
+  int i;
+
+  // a read of a line already in the queue is merged into it
+  for(i=0; i<MLC_READ_QUEUE_SIZE; i++)
+    {
+      if(queues->read[i].addr == cl_addr)
+	{
+	  queues->read[i].fill_level |= fill_level;
+	  if(!prefetch)
+	    {
+	      queues->read[i].prefetch = 0;
+	      queues->read[i].ip = ip;
+	    }
+	  return;
+	}
+    }
+
+  for(i=0; i<MLC_READ_QUEUE_SIZE; i++)
+    {
+      if(queues->read[i].addr == 0)
+	{
+	  queues->read[i].cpu_num = cpu_num;
+	  queues->read[i].addr = addr;
+	  queues->read[i].ip = ip;
+	  queues->read[i].cycle = mlc_cycle(cpu_num);
+	  queues->read[i].prefetch = prefetch;
+	  queues->read[i].fill_level = fill_level;
+	  queues->read_count++;
+	  return;
+	}
+    }
+
+  printf("*** L2 MLC Read Queue full. Exiting.\n");
+  fflush(stdout);
+  exit(0);
+}
+
+void mlc_add_to_write_queue(int cpu_num, unsigned long long int addr)
+{
+  mlc_queues_t *queues = mlc_queues(cpu_num);
+  int i;
+
+  // a full queue drops the write
+  if(queues->write_count >= MLC_WRITE_QUEUE_SIZE)
+    {
+      return;
+    }
+
+  for(i=0; i<MLC_WRITE_QUEUE_SIZE; i++)
+    {
+      if(queues->write[i].addr == addr)
+	{
+	  return;
+	}
+    }
+
+  for(i=0; i<MLC_WRITE_QUEUE_SIZE; i++)
+    {
+      if(queues->write[i].addr == 0)
+	{
+	  queues->write[i].cpu_num = cpu_num;
+	  queues->write[i].addr = addr;
+	  queues->write[i].cycle = mlc_cycle(cpu_num);
+	  queues->write[i].missed = 0;
+	  queues->write_count++;
+	  return;
+	}
+    }
+
+  printf("*** MLC WRITE Queue full. Exiting.\n");
+  fflush(stdout);
+  exit(0);
+}
+
+void mlc_add_to_fill_queue(int cpu_num, unsigned long long int addr, int fill_level)
+{
+  mlc_queues_t *queues = mlc_queues(cpu_num);
+  int i;
+
+  for(i=0; i<MLC_FILL_QUEUE_SIZE; i++)
+    {
+      if(queues->fill[i].addr == 0)
+	{
+	  queues->fill[i].cpu_num = cpu_num;
+	  queues->fill[i].addr = addr;
+	  queues->fill[i].cycle = mlc_cycle(cpu_num);
+	  queues->fill[i].fill_level = fill_level;
+	  queues->fill_count++;
+	  return;
+	}
+    }
+
+  printf("*** L2 MLC Fill Queue full. Exiting.\n");
+  fflush(stdout);
+  exit(0);
+}
+
+int mlc_get_set(unsigned long long int addr)
+{
+  return (addr>>6)&(L2_SET_COUNT-1);
+}
+
+int l2_get_set(unsigned long long int addr)
+{
+  return mlc_get_set(addr);
+}
+
+int mlc_get_way(int cpu_num, unsigned long long int addr, int set)
+{
+  int way;
+  for(way=0; way<L2_ASSOCIATIVITY; way++)
+    {
+      if(mlc_cache[cpu_num][set][way].tag == addr)
+	{
+	  return way;
+	}
+    }
+
+  return -1;
+}
+
+int l2_get_way(int cpu_num, unsigned long long int addr, int set)
+{
+  return mlc_get_way(cpu_num, addr, set);
+}
+
+int mlc_check_hit(int cpu_num, unsigned long long int addr)
+{
+  int set = mlc_get_set(addr);
+  int way = mlc_get_way(cpu_num, addr, set);
+  if(way == -1)
+    {
+      return 0;
+    }
+
+  return mlc_cache[cpu_num][set][way].valid != 0;
+}
+
+// returns the address of the line that was in the way before
+unsigned long long int mlc_fill(int cpu_num, unsigned long long int addr, int set, int way)
+{
+  mlc_line_t *line = &mlc_cache[cpu_num][set][way];
+  unsigned long long int evicted_addr = line->tag;
+  if(line->valid)
+    {
+      mlc_replacement->evict(cpu_num, set, way);
+    }
+
+  line->valid = 1;
+  line->tag = addr;
+  line->dirty = 0;
+  line->lru = 0;
+
+  return evicted_addr;
+}
+
+// places a line just filled by mlc_fill() in the replacement order
+void mlc_insert(int cpu_num, int set, int way, int prefetch, unsigned long long int ip)
+{
+  mlc_replacement->insert(cpu_num, set, way, prefetch, ip);
+}
+
+void mlc_update_lru(int cpu_num, int set, int way)
+{
+  mlc_replacement->hit(cpu_num, set, way, 0);
+}
+
+void mlc_mark_dirty(int cpu_num, int set, int way)
+{
+  mlc_cache[cpu_num][set][way].dirty = 1;
+}
+
+int mlc_check_dirty(int cpu_num, int set, int way)
+{
+  return mlc_cache[cpu_num][set][way].dirty == 1;
+}
+
+int mlc_get_eviction_way(int cpu_num, int set)
+{
+  int way;
+  for(way=0; way<L2_ASSOCIATIVITY; way++)
+    {
+      if(!mlc_cache[cpu_num][set][way].valid)
+	{
+	  return way;
+	}
+    }
+
+  return mlc_replacement->victim(cpu_num, set);
+}
+
+// returns 1 if the line is dirty, for the LLC to write it back when it evicts the line
+int mlc_check_invalidate_write_back(int cpu_num, unsigned long long int addr)
+{
+  int set = mlc_get_set(addr);
+  int way = mlc_get_way(cpu_num, addr, set);
+  if(way == -1)
+    {
+      return 0;
+    }
+
+  return mlc_cache[cpu_num][set][way].dirty == 1;
+}
+
+void mlc_invalidate(int cpu_num, unsigned long long int addr)
+{
+  int set = mlc_get_set(addr);
+  int way = mlc_get_way(cpu_num, addr, set);
+  if(way != -1)
+    {
+      mlc_cache[cpu_num][set][way].valid = 0;
+    }
+}
+
+/*
+  MSHRs
+*/
+
+int get_l2_mshr_occupancy(int cpu_num)
+{
+  int occupancy = 0;
+  int i;
+  for(i=0; i<L2_MSHR_COUNT; i++)
+    {
+      if(mlc_mshr[cpu_num][i].addr != 0)
+	{
+	  occupancy++;
+	}
+    }
+
+  return occupancy;
+}
+
+int get_mlc_mshr_occupancy(int cpu_num)
+{
+  return get_l2_mshr_occupancy(cpu_num);
+}
+
+int mlc_mshr_pending(int cpu_num, unsigned long long int addr)
+{
+  int i;
+  for(i=0; i<L2_MSHR_COUNT; i++)
+    {
+      if(mlc_mshr[cpu_num][i].addr == addr)
+	{
+	  return 1;
+	}
+    }
+
+  return 0;
+}
+
+// a demand read of a line already being prefetched turns the MSHR into a demand one
+void mlc_allocate_mshr(int cpu_num, unsigned long long int addr, int prefetch, unsigned long long int ip)
+{
+  int i;
+  for(i=0; i<L2_MSHR_COUNT; i++)
+    {
+      if(mlc_mshr[cpu_num][i].addr == addr)
+	{
+	  if(!prefetch)
+	    {
+	      mlc_mshr[cpu_num][i].prefetch = 0;
+	      mlc_mshr_ip[cpu_num][i] = ip;
+	    }
+	  return;
+	}
+    }
+
+  for(i=0; i<L2_MSHR_COUNT; i++)
+    {
+      if(mlc_mshr[cpu_num][i].addr == 0)
+	{
+	  mlc_mshr[cpu_num][i].addr = addr;
+	  mlc_mshr[cpu_num][i].prefetch = prefetch;
+	  mlc_mshr_ip[cpu_num][i] = ip;
+	  return;
+	}
+    }
+}
+
+void add_mlc_mshr(int cpu_num, unsigned long long int addr, int prefetch)
+{
+  mlc_allocate_mshr(cpu_num, addr, prefetch, 0);
+}
+
+// tells the prefetcher about the fill, and frees the line's MSHR
+void remove_mlc_mshr(int cpu_num, unsigned long long int addr, unsigned long long int evicted_addr)
+{
+  int set = mlc_get_set(addr);
+  int i;
+  for(i=0; i<L2_MSHR_COUNT; i++)
+    {
+      if(mlc_mshr[cpu_num][i].addr == addr)
+	{
+	  l2_cache_fill(cpu_num, addr, set, mlc_get_way(cpu_num, addr, set), mlc_mshr[cpu_num][i].prefetch, evicted_addr);
+	  mlc_mshr[cpu_num][i].addr = 0;
+	  mlc_mshr[cpu_num][i].prefetch = 0;
+	}
+    }
+}
+
+/*
+  Each cycle
+*/
+
+// fills a line back from the LLC into the L2, and into the DCU if it asked for it
+void mlc_handle_fill(int cpu_num, int index)
+{
+  mlc_queues_t *queues = mlc_queues(cpu_num);
+  mlc_fill_request_t *fill = &queues->fill[index];
+  unsigned long long int addr = fill->addr;
+  int set = mlc_get_set(addr);
+  int way = mlc_get_eviction_way(cpu_num, set);
+  mlc_line_t *line = &mlc_cache[cpu_num][set][way];
+  int i;
+
+  // the L2 is inclusive of the DCU
+  if((line->tag != 0) && (line->valid == 1))
+    {
+      if(line->dirty == 1)
+	{
+	  llc_add_to_write_queue(cpu_num, line->tag);
+	}
+      if(dcu_check_invalidate_write_back(cpu_num, line->tag))
+	{
+	  llc_add_to_write_queue(cpu_num, line->tag);
+	}
+      dcu_invalidate(cpu_num, line->tag);
+    }
+
+  // the MSHR says whether a prefetch or a demand read brought the line in
+  int prefetch = 0;
+  unsigned long long int ip = 0;
+  for(i=0; i<L2_MSHR_COUNT; i++)
+    {
+      if(mlc_mshr[cpu_num][i].addr == addr)
+	{
+	  prefetch = mlc_mshr[cpu_num][i].prefetch;
+	  ip = mlc_mshr_ip[cpu_num][i];
+	  break;
+	}
+    }
+
+  unsigned long long int evicted_addr = mlc_fill(cpu_num, addr, set, way);
+  mlc_insert(cpu_num, set, way, prefetch, ip);
+  remove_mlc_mshr(cpu_num, addr, evicted_addr);
+
+  // writes that missed were waiting for this line
+  for(i=0; i<MLC_WRITE_QUEUE_SIZE; i++)
+    {
+      if((queues->write[i].addr != 0) && (queues->write[i].missed == 1) && (queues->write[i].addr == addr))
+	{
+	  queues->write[i].addr = 0;
+	  queues->write_count--;
+	  mlc_mark_dirty(cpu_num, set, way);
+	}
+    }
+
+  if(fill->fill_level & FILL_L1)
+    {
+      // the fill is done again next cycle, once the DCU can take it
+      if(mlc_dcu_fill_count(cpu_num) >= DCU_FILL_QUEUE_SIZE)
+	{
+	  return;
+	}
+      dcu_add_to_fill_queue(fill->cpu_num, addr, fill->fill_level);
+
+      // reads of the line that came in while it was missing are answered by this fill
+      for(i=0; i<MLC_READ_QUEUE_SIZE; i++)
+	{
+	  if(queues->read[i].addr == fill->addr)
+	    {
+	      queues->read[i].addr = 0;
+	      queues->read_count--;
+	    }
+	}
+    }
+
+  fill->addr = 0;
+  queues->fill_count--;
+}
+
+void mlc_handle_write(int cpu_num, int index)
+{
+  mlc_queues_t *queues = mlc_queues(cpu_num);
+  mlc_write_t *write = &queues->write[index];
+  unsigned long long int addr = write->addr;
+  int set = mlc_get_set(addr);
+  int way = mlc_get_way(cpu_num, addr, set);
+
+  if((way != -1) && mlc_cache[cpu_num][set][way].valid)
+    {
+      mlc_mark_dirty(cpu_num, set, way);
+      write->addr = 0;
+      queues->write_count--;
+      return;
+    }
+
+  // a write miss reads the line from the LLC, and waits for it in the queue
+  if((get_l2_mshr_occupancy(cpu_num) == L2_MSHR_COUNT) || mlc_llc_read_queue_full(cpu_num))
+    {
+      return;
+    }
+  llc_add_to_read_queue(cpu_num, addr, FILL_L2, 0);
+  mlc_allocate_mshr(cpu_num, addr, 0, 0);
+  write->missed = 1;
+}
+
+void mlc_handle_read(int cpu_num, int index)
+{
+  mlc_queues_t *queues = mlc_queues(cpu_num);
+  mlc_read_t *read = &queues->read[index];
+  unsigned long long int addr = read->addr;
+  unsigned long long int ip = read->ip;
+  int set = mlc_get_set(addr);
+  int way = mlc_get_way(cpu_num, addr, set);
+
+  if((way != -1) && mlc_cache[cpu_num][set][way].valid)
+    {
+      mlc_replacement->hit(cpu_num, set, way, read->prefetch);
+      if(mlc_dcu_fill_count(read->cpu_num) >= DCU_FILL_QUEUE_SIZE)
+	{
+	  return;
+	}
+      dcu_add_to_fill_queue(read->cpu_num, addr, read->fill_level);
+      read->addr = 0;
+      queues->read_count--;
+      if(!read->prefetch)
+	{
+	  l2_prefetcher_operate(cpu_num, addr, ip, 1);
+	}
+      return;
+    }
+
+  if((get_l2_mshr_occupancy(cpu_num) == L2_MSHR_COUNT) || mlc_llc_read_queue_full(cpu_num))
+    {
+      return;
+    }
+  llc_add_to_read_queue(cpu_num, addr, read->fill_level, read->prefetch);
+  // tools/llc.c predicts the line's reuse from the load's ip
+  if(llc_set_read_ip)
+    {
+      llc_set_read_ip(cpu_num, addr, ip);
+    }
+  // a prefetch only into the LLC does not take an MSHR
+  if(!read->prefetch || (read->fill_level & (FILL_L1 | FILL_L2)))
+    {
+      mlc_allocate_mshr(cpu_num, addr, read->prefetch, ip);
+    }
+  read->addr = 0;
+  queues->read_count--;
+  if(!read->prefetch)
+    {
+      l2_prefetcher_operate(cpu_num, addr, ip, 0);
+    }
+}
+
+void mlc_operate(int cpu_num)
+{
+  mlc_queues_t *queues = mlc_queues(cpu_num);
+  long long int cycle = mlc_cycle(cpu_num);
+  long long int oldest_cycle;
+  int oldest;
+  int i;
+
+  if(queues->fill_count > 0)
+    {
+      oldest = -1;
+      oldest_cycle = cycle;
+      for(i=0; i<MLC_FILL_QUEUE_SIZE; i++)
+	{
+	  if((queues->fill[i].addr != 0) && (queues->fill[i].cycle < oldest_cycle))
+	    {
+	      oldest_cycle = queues->fill[i].cycle;
+	      oldest = i;
+	    }
+	}
+      if(oldest != -1)
+	{
+	  mlc_handle_fill(cpu_num, oldest);
+	}
+    }
+
+  // writes waiting for their line are skipped
+  if(queues->write_count > 0)
+    {
+      oldest = -1;
+      oldest_cycle = cycle;
+      for(i=0; i<MLC_WRITE_QUEUE_SIZE; i++)
+	{
+	  if((queues->write[i].addr != 0) && (queues->write[i].missed != 1) &&
+	     (cycle - queues->write[i].cycle >= MLC_LATENCY) && (queues->write[i].cycle < oldest_cycle))
+	    {
+	      oldest_cycle = queues->write[i].cycle;
+	      oldest = i;
+	    }
+	}
+      if(oldest != -1)
+	{
+	  mlc_handle_write(cpu_num, oldest);
+	}
+    }
+
+  // reads of a line that is already missing wait for its fill
+  if(queues->read_count > 0)
+    {
+      oldest = -1;
+      oldest_cycle = cycle;
+      for(i=0; i<MLC_READ_QUEUE_SIZE; i++)
+	{
+	  if((queues->read[i].addr != 0) && !mlc_mshr_pending(cpu_num, queues->read[i].addr) &&
+	     (queues->read[i].cycle < oldest_cycle))
+	    {
+	      oldest_cycle = queues->read[i].cycle;
+	      oldest = i;
+	    }
+	}
+      if((oldest != -1) && (cycle - oldest_cycle >= MLC_LATENCY))
+	{
+	  mlc_handle_read(cpu_num, oldest);
+	}
+    }
+}
+
+/*
+  The prefetcher's interface
+*/
+
+int get_l2_read_queue_occupancy(int cpu_num)
+{
+  return mlc_queues(cpu_num)->read_count;
+}
+
+int get_mlc_read_queue_occupancy(int cpu_num)
+{
+  return get_l2_read_queue_occupancy(cpu_num);
+}
+
+// the L2's MSHR occupancy is not checked here, a prefetch that misses waits in the read queue for an MSHR
+int l2_prefetch_line(int cpu_num, unsigned long long int base_addr, unsigned long long int pf_addr, int fill_level)
+{
+  mlc_queues_t *queues = mlc_queues(cpu_num);
+  unsigned long long int pf_cl_addr = (pf_addr>>6)<<6;
+  int i;
+
+  if(queues->read_count >= MLC_READ_QUEUE_SIZE)
+    {
+      return 0;
+    }
+  if((base_addr>>12) != (pf_addr>>12))
+    {
+      return 0;
+    }
+
+  for(i=0; i<MLC_READ_QUEUE_SIZE; i++)
+    {
+      if(queues->read[i].addr == pf_cl_addr)
+	{
+	  queues->read[i].fill_level |= fill_level;
+	  return 1;
+	}
+    }
+
+  for(i=0; i<MLC_READ_QUEUE_SIZE; i++)
+    {
+      if(queues->read[i].addr == 0)
+	{
+	  queues->read[i].cpu_num = cpu_num;
+	  queues->read[i].addr = pf_addr;
+	  queues->read[i].ip = 0;
+	  queues->read[i].cycle = mlc_cycle(cpu_num);
+	  queues->read[i].prefetch = 1;
+	  queues->read[i].fill_level = fill_level;
+	  queues->read_count++;
+	  return 1;
+	}
+    }
+
+  printf("*** L2 MLC Read Queue full. Exiting.\n");
+  fflush(stdout);
+  exit(0);
+}
+
+int mlc_prefetch_line(int cpu_num, unsigned long long int base_addr, unsigned long long int pf_addr, int fill_level)
+{
+  return l2_prefetch_line(cpu_num, base_addr, pf_addr, fill_level);
+}
+
+void mlc_prefetcher_initialize(int cpu_num)
+{
+  l2_prefetcher_initialize(cpu_num);
+}
+
+void mlc_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned long long int ip, int cache_hit)
+{
+  l2_prefetcher_operate(cpu_num, addr, ip, cache_hit);
+}
+
+void mlc_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, int prefetch, unsigned long long int evicted_addr)
+{
+  l2_cache_fill(cpu_num, addr, set, way, prefetch, evicted_addr);
+}
@@ -0,0 +1,907 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  Simulates several cores that share the LLC and the memory controller,
+  each running its own trace with its own DCU, L2 and L2 prefetcher.  The
+  cores' pages are translated to different physical pages, so they share
+  no lines, even when they run the same trace.  It replaces the main() of
+  lib/dpc2sim.a, and is linked with tools/mlc.c and tools/llc.c built for
+  the same number of cores (see there for how the LLC is shared).
+
+  lib/dpc2sim.a already keeps a core's state in ooo_cpu and dcu_cache
+  indexed by cpu_num, but only makes room for one core.  Both are defined
+  here with room for NUM_CPUS cores, and the cores after the first are set
+  up like the first.
+
+  The cores advance in lockstep, unless -quantum says otherwise.  Each
+  cycle the memory controller and the LLC run once, then each core's L2,
+  DCU and pipeline, and then each core reads instructions from its trace
+  while its instruction window has room, as lib/dpc2sim.a does for its
+  one core.  Each core ends its warmup and
+  its measurement on its own, after the same numbers of instructions.  A
+  core that reaches the end of its trace starts it over, and a core that is
+  done keeps running, so that the others still share the LLC and DRAM with
+  it, until every core is done.  A core's IPC is taken when it is done.
+
+  Every core has its own copy of the prefetcher, which must be linked in
+  with its functions renamed to cpu<i>_l2_prefetcher_initialize,
+  cpu<i>_l2_prefetcher_operate and cpu<i>_l2_cache_fill for core i.  Its
+  calls into the simulator, which always pass cpu_num 0, must be renamed
+  the same way, so that they are answered for core i.  objcopy does both,
+  and hides each copy's globals from the others, so the cores can also run
+  different prefetchers.
+
+  How to compile:
+
+  gcc -Wall -O2 -c -o pf.o example_prefetchers/ampm_lite_prefetcher.c
+  for i in 0 1 2 3; do
+    objcopy $(for f in l2_prefetcher_initialize l2_prefetcher_operate l2_cache_fill; do echo -G cpu${i}_$f; done) \
+      $(for f in l2_prefetcher_initialize l2_prefetcher_operate l2_cache_fill l2_prefetch_line l2_get_way \
+          get_l2_mshr_occupancy get_l2_read_queue_occupancy get_current_cycle; do echo --redefine-sym $f=cpu${i}_$f; done) \
+      pf.o pf$i.o
+  done
+  gcc -Wall -O2 -pthread -DNUM_CPUS=4 -o dpc2sim_4core tools/multicore.c tools/mlc.c tools/llc.c pf0.o pf1.o pf2.o pf3.o lib/dpc2sim.a \
+    -Wl,--wrap=srand,--wrap=rand
+
+  The linker's --wrap option routes srand() and rand() through the
+  functions below, which keep a random number state per core, so that
+  with -scramble_loads, or a prefetcher that calls rand(), a core's
+  random numbers do not depend on when the other cores draw theirs.
+  Core 0 draws the numbers lib/dpc2sim.a would.
+
+  Without -DNUM_CPUS it simulates one core.  tools/memory_controller.c can
+  be linked in too, before lib/dpc2sim.a.  It cannot be linked with the
+  other files in tools/ that wrap the library's main().
+
+  How to run:
+
+  ./dpc2sim_4core -alone_ipc 1.17,0.31,0.52,0.88 traces/lbm_trace2.dpc.gz traces/mcf_trace2.dpc.gz \
+    traces/omnetpp_trace2.dpc.gz traces/libquantum_trace2.dpc.gz
+
+  Each trace after the options is run by one core.  Traces ending in .gz
+  are read through zcat.  With no trace, one core reads stdin, and the
+  output is the same as lib/dpc2sim.a's.
+
+  Besides each core's IPC, the end of the run reports, if -alone_ipc is
+  given:
+   - weighted speedup: the sum over the cores of their IPC divided by the
+     IPC they have alone
+   - fairness: the smallest of these speedups divided by the largest
+
+  Options:
+
+  The options of lib/dpc2sim.a: -warmup_instructions, -simulation_instructions,
+  -hide_heartbeat, -scramble_loads, -small_llc and -low_bandwidth.
+
+  -alone_ipc <ipc,ipc,...>
+  Each trace's IPC when it runs alone, with the same prefetcher and knobs.
+
+  -threads <number>
+  Simulate the cores' L2s, DCUs and pipelines on this many threads.  The
+  LLC and the memory controller stay on the main thread, and the results
+  are the same as with one thread.  The threads wait for each other twice
+  a cycle, spinning for a while before they give up the CPU, so they
+  should not outnumber the host's CPUs.  Default is 1.
+
+  -quantum <cycles>
+  Let the cores run this many cycles, up to 100, before the LLC and the
+  memory controller catch up with them, so the threads wait for each
+  other only twice per quantum.  The LLC still sees each request at the
+  cycle it was sent, but a core only sees the LLC's fills and
+  invalidations, and checks its heartbeat, warmup and end, at the end of
+  a quantum.  The results depend on the quantum, but not on the number
+  of threads.  Ignored with one core.  Default is 1, every cycle.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include "../inc/prefetcher.h"
+
+#ifndef NUM_CPUS
+#define NUM_CPUS 1
+#endif
+
+// the prefetcher copies that can be linked in, cpu0_ to cpu7_
+#define MULTICORE_PREFETCHER_COUNT 8
+
+// where a core keeps its counters, how many instructions it may still
+// take, and the head and tail of its instruction window
+#define OOO_CPU_SIZE 0x9c270
+#define OOO_CPU_CYCLE_OFFSET 8
+#define OOO_CPU_RETIRED_OFFSET 16
+#define OOO_CPU_FETCH_BUDGET_OFFSET 0x20
+#define OOO_CPU_WINDOW_HEAD_OFFSET 0x24
+#define OOO_CPU_WINDOW_TAIL_OFFSET 0x28
+#define DCU_CACHE_SIZE 0x2800
+
+// a core takes FETCH_WIDTH more instructions once its window has room for them
+#define INSTRUCTION_WINDOW_SIZE 256
+#define FETCH_WIDTH 6
+#define FETCH_WINDOW_LIMIT (INSTRUCTION_WINDOW_SIZE-FETCH_WIDTH-7)
+
+#define HEARTBEAT_INSTRUCTIONS 100000
+
+// how often a thread checks the barrier before it lets other threads run
+#define MULTICORE_BARRIER_SPINS 1000
+
+// size of each core's random number state, as used by glibc's rand()
+#define MULTICORE_RANDOM_STATE_SIZE 128
+
+#define TRACE_RECORD_SIZE 48
+#define TRACE_MEMORY_OPERANDS 4
+#define TRACE_REGISTERS 4
+
+// one instruction, as it is stored in a trace
+typedef struct trace_record
+{
+  unsigned long long int ip;
+  // register ids, one per byte, of which the simulator uses the first four
+  unsigned char registers[8];
+  // memory addresses, 0 if unused
+  unsigned long long int memory[TRACE_MEMORY_OPERANDS];
+} trace_record_t;
+
+// the fields of lib/dpc2sim.a's instruction that add_to_instruction_window() reads
+typedef struct multicore_instruction
+{
+  unsigned long long int reserved0;
+  unsigned long long int ip;
+  unsigned long long int reserved1[2];
+  unsigned long long int registers[TRACE_REGISTERS];
+  unsigned long long int reserved2[131];
+  // physical addresses
+  unsigned long long int memory[TRACE_MEMORY_OPERANDS];
+} multicore_instruction_t;
+
+typedef struct multicore_core
+{
+  const char *trace_name;
+  FILE *trace;
+  int trace_piped;
+  // 1 once the only core reaches the end of its trace, which ends the simulation
+  int trace_ended;
+
+  int warmup_complete;
+  int simulation_complete;
+  long long int start_instructions;
+  long long int start_cycle;
+  long long int instructions;
+  long long int cycles;
+  double alone_ipc;
+
+  long long int next_heartbeat;
+  long long int heartbeat_instructions;
+  long long int heartbeat_cycle;
+
+  void (*prefetcher_initialize)(int cpu_num);
+  void (*prefetcher_operate)(int cpu_num, unsigned long long int addr, unsigned long long int ip, int cache_hit);
+  void (*cache_fill)(int cpu_num, unsigned long long int addr, int set, int way, int prefetch, unsigned long long int evicted_addr);
+} multicore_core_t;
+
+// lib/dpc2sim.a's knobs and the state it keeps per core
+int knob_scramble_loads;
+int knob_small_llc;
+int knob_low_bandwidth;
+long long int warmup_instructions;
+long long int simulation_instructions;
+int show_heartbeat;
+int LLC_SETS;
+int DRAM_MTPS;
+int DRAM_DBUS_TRANSFER_TIME;
+unsigned char ooo_cpu[NUM_CPUS*OOO_CPU_SIZE] __attribute__((aligned(64)));
+unsigned char dcu_cache[NUM_CPUS*DCU_CACHE_SIZE] __attribute__((aligned(64)));
+
+// the rest of lib/dpc2sim.a
+void initialize_cpus();
+void initialize_dcu(int cpu_num);
+void initialize_mlc(int cpu_num);
+void add_to_instruction_window(void *instruction, int cpu_num);
+void uncore_operate();
+void core_memory_operate(int cpu_num);
+void core_operate(int cpu_num);
+
+// tools/mlc.c and tools/llc.c
+extern int mlc_cpus;
+extern int llc_max_cpus;
+extern int llc_cpus;
+extern int llc_max_quantum;
+extern int llc_quantum;
+void llc_publish_requests(int cpu_num);
+void llc_commit_requests(long long int cycle);
+
+multicore_core_t multicore_cores[NUM_CPUS];
+int multicore_core_count;
+
+// the heartbeat for more than one core
+int multicore_show_heartbeat;
+
+int multicore_thread_count = 1;
+int multicore_quantum = 1;
+int multicore_done;
+
+// a sense reversing barrier for the threads: the last to arrive flips the sense the others wait for
+int multicore_barrier_waiting;
+int multicore_barrier_sense;
+
+// rand() and srand() use the state of the core the calling thread is simulating
+struct random_data multicore_random[NUM_CPUS];
+char multicore_random_state[NUM_CPUS][MULTICORE_RANDOM_STATE_SIZE];
+__thread int multicore_random_cpu;
+
+// the calls of core i's prefetcher into the simulator, answered for core i
+#define MULTICORE_PREFETCHER(i)						\
+  void cpu##i##_l2_prefetcher_initialize(int cpu_num) __attribute__((weak)); \
+  void cpu##i##_l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned long long int ip, int cache_hit) __attribute__((weak)); \
+  void cpu##i##_l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, int prefetch, unsigned long long int evicted_addr) __attribute__((weak)); \
+  int cpu##i##_l2_prefetch_line(int cpu_num, unsigned long long int base_addr, unsigned long long int pf_addr, int fill_level) \
+  {									\
+    return l2_prefetch_line(i, base_addr, pf_addr, fill_level);		\
+  }									\
+  int cpu##i##_l2_get_way(int cpu_num, unsigned long long int addr, int set) \
+  {									\
+    return l2_get_way(i, addr, set);					\
+  }									\
+  int cpu##i##_get_l2_mshr_occupancy(int cpu_num)			\
+  {									\
+    return get_l2_mshr_occupancy(i);					\
+  }									\
+  int cpu##i##_get_l2_read_queue_occupancy(int cpu_num)			\
+  {									\
+    return get_l2_read_queue_occupancy(i);				\
+  }									\
+  unsigned long long int cpu##i##_get_current_cycle(int cpu_num)	\
+  {									\
+    return get_current_cycle(i);					\
+  }
+
+MULTICORE_PREFETCHER(0)
+MULTICORE_PREFETCHER(1)
+MULTICORE_PREFETCHER(2)
+MULTICORE_PREFETCHER(3)
+MULTICORE_PREFETCHER(4)
+MULTICORE_PREFETCHER(5)
+MULTICORE_PREFETCHER(6)
+MULTICORE_PREFETCHER(7)
+
+#define MULTICORE_PREFETCHER_ENTRY(i) \
+  { cpu##i##_l2_prefetcher_initialize, cpu##i##_l2_prefetcher_operate, cpu##i##_l2_cache_fill }
+
+struct
+{
+  void (*initialize)(int cpu_num);
+  void (*operate)(int cpu_num, unsigned long long int addr, unsigned long long int ip, int cache_hit);
+  void (*cache_fill)(int cpu_num, unsigned long long int addr, int set, int way, int prefetch, unsigned long long int evicted_addr);
+} multicore_prefetchers[MULTICORE_PREFETCHER_COUNT] =
+  {
+    MULTICORE_PREFETCHER_ENTRY(0), MULTICORE_PREFETCHER_ENTRY(1), MULTICORE_PREFETCHER_ENTRY(2), MULTICORE_PREFETCHER_ENTRY(3),
+    MULTICORE_PREFETCHER_ENTRY(4), MULTICORE_PREFETCHER_ENTRY(5), MULTICORE_PREFETCHER_ENTRY(6), MULTICORE_PREFETCHER_ENTRY(7),
+  };
+
+// the simulator's calls into the prefetcher, passed to the core's copy
+void l2_prefetcher_initialize(int cpu_num)
+{
+  multicore_random_cpu = cpu_num;
+  multicore_cores[cpu_num].prefetcher_initialize(0);
+}
+
+void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned long long int ip, int cache_hit)
+{
+  multicore_cores[cpu_num].prefetcher_operate(0, addr, ip, cache_hit);
+}
+
+void l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, int prefetch, unsigned long long int evicted_addr)
+{
+  multicore_cores[cpu_num].cache_fill(0, addr, set, way, prefetch, evicted_addr);
+}
+
+// the simulator's virtual to physical address translation, with the core's number in the virtual
+// address bits from 47 up, which user space leaves clear.  The translation is one to one on the page
+// numbers, so the same address in two cores' traces never maps to the same line, and core 0
+// translates like lib/dpc2sim.a.  Address 0, an unused operand, stays 0.
+unsigned long long int multicore_va_to_pa(int cpu_num, unsigned long long int va)
+{
+  if(va == 0)
+    {
+      return 0;
+    }
+  va ^= (unsigned long long int)cpu_num << 47;
+
+  unsigned long long int hash = (va>>12) ^ (va>>25);
+  hash = (va>>20) ^ hash ^ (hash<<2);
+  hash = (va>>30) ^ hash ^ (hash<<5);
+
+  return ((hash ^ (hash<<3))<<12) | (va & 0xfff);
+}
+
+// seeds every core, each with its own seed, core 0's being the one lib/dpc2sim.a passes
+void __wrap_srand(unsigned int seed)
+{
+  int cpu_num;
+  for(cpu_num=0; cpu_num<NUM_CPUS; cpu_num++)
+    {
+      initstate_r(seed ^ (cpu_num<<16), multicore_random_state[cpu_num], MULTICORE_RANDOM_STATE_SIZE, &multicore_random[cpu_num]);
+    }
+}
+
+int __wrap_rand()
+{
+  int32_t result;
+  random_r(&multicore_random[multicore_random_cpu], &result);
+
+  return result;
+}
+
+unsigned char *multicore_state(int cpu_num)
+{
+  return ooo_cpu + cpu_num*OOO_CPU_SIZE;
+}
+
+long long int *multicore_counter(int cpu_num, int offset)
+{
+  return (long long int *)(multicore_state(cpu_num) + offset);
+}
+
+int *multicore_window(int cpu_num, int offset)
+{
+  return (int *)(multicore_state(cpu_num) + offset);
+}
+
+void multicore_fail(const char *message, const char *name)
+{
+  printf(message, name);
+  printf(" Exiting.\n");
+  exit(1);
+}
+
+void multicore_open_trace(multicore_core_t *core)
+{
+  int length = strlen(core->trace_name);
+  if((length > 3) && !strcmp(core->trace_name + length - 3, ".gz"))
+    {
+      char *command = malloc(length + 16);
+      sprintf(command, "zcat '%s'", core->trace_name);
+      core->trace = popen(command, "r");
+      core->trace_piped = 1;
+      free(command);
+    }
+  else
+    {
+      core->trace = fopen(core->trace_name, "rb");
+      core->trace_piped = 0;
+    }
+
+  if(core->trace == NULL)
+    {
+      multicore_fail("Couldn't open trace file %s.", core->trace_name);
+    }
+}
+
+// reads the core's next instruction, from the start of its trace again after the end if there are other cores
+int multicore_read(multicore_core_t *core, trace_record_t *record)
+{
+  if(fread(record, TRACE_RECORD_SIZE, 1, core->trace) == 1)
+    {
+      return 1;
+    }
+  if(multicore_core_count == 1)
+    {
+      return 0;
+    }
+
+  if(core->trace_piped)
+    {
+      pclose(core->trace);
+      multicore_open_trace(core);
+    }
+  else
+    {
+      rewind(core->trace);
+    }
+  if(fread(record, TRACE_RECORD_SIZE, 1, core->trace) != 1)
+    {
+      multicore_fail("Trace file %s is empty.", core->trace_name);
+    }
+
+  return 1;
+}
+
+// gives the core instructions while it may take more, like lib/dpc2sim.a's main()
+void multicore_fetch(int cpu_num)
+{
+  multicore_core_t *core = &multicore_cores[cpu_num];
+  int *budget = multicore_window(cpu_num, OOO_CPU_FETCH_BUDGET_OFFSET);
+  trace_record_t record;
+  multicore_instruction_t instruction;
+  int i;
+
+  memset(&instruction, 0, sizeof(instruction));
+  while(*budget > 0)
+    {
+      if(!multicore_read(core, &record))
+	{
+	  core->trace_ended = 1;
+	  return;
+	}
+
+      instruction.ip = record.ip;
+      for(i=0; i<TRACE_REGISTERS; i++)
+	{
+	  instruction.registers[i] = record.registers[i];
+	}
+      for(i=0; i<TRACE_MEMORY_OPERANDS; i++)
+	{
+	  instruction.memory[i] = multicore_va_to_pa(cpu_num, record.memory[i]);
+	}
+      add_to_instruction_window(&instruction, cpu_num);
+    }
+}
+
+// one cycle of the core's own caches and pipeline, after which it takes more instructions if its window has room
+void multicore_step(int cpu_num)
+{
+  multicore_random_cpu = cpu_num;
+  core_memory_operate(cpu_num);
+  llc_publish_requests(cpu_num);
+  core_operate(cpu_num);
+
+  int head = *multicore_window(cpu_num, OOO_CPU_WINDOW_HEAD_OFFSET);
+  int tail = *multicore_window(cpu_num, OOO_CPU_WINDOW_TAIL_OFFSET);
+  int occupancy = (head > tail) ? INSTRUCTION_WINDOW_SIZE - head + tail : tail - head;
+  if(occupancy <= FETCH_WINDOW_LIMIT)
+    {
+      *multicore_window(cpu_num, OOO_CPU_FETCH_BUDGET_OFFSET) = FETCH_WIDTH;
+    }
+
+  multicore_fetch(cpu_num);
+}
+
+// sense is the thread's own, flipped at each barrier
+void multicore_barrier_wait(int *sense)
+{
+  *sense = !*sense;
+  if(__atomic_add_fetch(&multicore_barrier_waiting, 1, __ATOMIC_ACQ_REL) == multicore_thread_count)
+    {
+      __atomic_store_n(&multicore_barrier_waiting, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&multicore_barrier_sense, *sense, __ATOMIC_RELEASE);
+      return;
+    }
+
+  int spins = 0;
+  while(__atomic_load_n(&multicore_barrier_sense, __ATOMIC_ACQUIRE) != *sense)
+    {
+      if(spins < MULTICORE_BARRIER_SPINS)
+	{
+	  spins++;
+	}
+      else
+	{
+	  sched_yield();
+	}
+    }
+}
+
+// one quantum of every thread_count-th core, from the thread's on
+void multicore_run(int thread, int thread_count)
+{
+  int cpu_num, cycle;
+  for(cpu_num=thread; cpu_num<multicore_core_count; cpu_num+=thread_count)
+    {
+      for(cycle=0; cycle<multicore_quantum; cycle++)
+	{
+	  multicore_step(cpu_num);
+	}
+    }
+}
+
+void *multicore_worker(void *argument)
+{
+  int thread = (int)(long)argument;
+  int sense = 0;
+  while(1)
+    {
+      multicore_barrier_wait(&sense);
+      if(multicore_done)
+	{
+	  return NULL;
+	}
+
+      multicore_run(thread, multicore_thread_count);
+      multicore_barrier_wait(&sense);
+    }
+}
+
+// the core's name in the output, none if it is the only one
+void multicore_print_core(int cpu_num)
+{
+  if(multicore_core_count > 1)
+    {
+      printf("Core %d ", cpu_num);
+    }
+}
+
+// checks the core's progress after a cycle, returns 1 once it is done
+int multicore_check(int cpu_num)
+{
+  multicore_core_t *core = &multicore_cores[cpu_num];
+  long long int retired = *multicore_counter(cpu_num, OOO_CPU_RETIRED_OFFSET);
+  long long int cycle = *multicore_counter(cpu_num, OOO_CPU_CYCLE_OFFSET);
+
+  if(core->simulation_complete)
+    {
+      return 1;
+    }
+
+  // with one core lib/dpc2sim.a prints the heartbeat itself
+  if(multicore_show_heartbeat && (retired >= core->next_heartbeat))
+    {
+      printf("Core %d Instructions Retired: %lld Cycle: %lld Heartbeat IPC: %f Cumulative IPC: %f\n", cpu_num, retired, cycle,
+	     (double)(retired - core->heartbeat_instructions)/(cycle - core->heartbeat_cycle), (double)retired/cycle);
+      fflush(stdout);
+      core->heartbeat_instructions = retired;
+      core->heartbeat_cycle = cycle;
+      core->next_heartbeat += HEARTBEAT_INSTRUCTIONS;
+    }
+
+  if(!core->warmup_complete && (retired > warmup_instructions))
+    {
+      printf("\n");
+      multicore_print_core(cpu_num);
+      printf("Warmup complete. Instructions retired: %lld Cycles elapsed: %lld IPC: %f\n",
+	     retired, cycle, (double)retired/cycle);
+      core->warmup_complete = 1;
+      core->start_instructions = retired;
+      core->start_cycle = cycle;
+    }
+
+  if(core->trace_ended || (core->warmup_complete && (retired > core->start_instructions + simulation_instructions)))
+    {
+      core->simulation_complete = 1;
+      core->instructions = retired - core->start_instructions;
+      core->cycles = cycle - core->start_cycle;
+      printf("\n");
+      multicore_print_core(cpu_num);
+      printf("Simulation complete. Instructions retired: %lld Cycles elapsed: %lld IPC: %f\n\n",
+	     core->instructions, core->cycles, ((double)retired - (double)core->start_instructions)/core->cycles);
+      return 1;
+    }
+
+  return 0;
+}
+
+void multicore_report()
+{
+  int cpu_num;
+  if(multicore_cores[0].alone_ipc == 0)
+    {
+      return;
+    }
+
+  double weighted_speedup = 0;
+  double min_speedup = 0;
+  double max_speedup = 0;
+  for(cpu_num=0; cpu_num<multicore_core_count; cpu_num++)
+    {
+      multicore_core_t *core = &multicore_cores[cpu_num];
+      double speedup = ((double)core->instructions/core->cycles)/core->alone_ipc;
+      weighted_speedup += speedup;
+      if((cpu_num == 0) || (speedup < min_speedup))
+	{
+	  min_speedup = speedup;
+	}
+      if((cpu_num == 0) || (speedup > max_speedup))
+	{
+	  max_speedup = speedup;
+	}
+    }
+
+  printf("Weighted speedup: %f Fairness: %f\n", weighted_speedup, min_speedup/max_speedup);
+}
+
+void multicore_parse_alone_ipc(const char *list)
+{
+  int cpu_num = 0;
+  const char *next = list;
+  while(*next != '\0')
+    {
+      char *end;
+      double ipc = strtod(next, &end);
+      if((end == next) || (ipc <= 0) || ((*end != ',') && (*end != '\0')) || (cpu_num == NUM_CPUS))
+	{
+	  multicore_fail("-alone_ipc %s must be a comma separated list of IPCs, one per trace.", list);
+	}
+      multicore_cores[cpu_num++].alone_ipc = ipc;
+      next = (*end == ',') ? end + 1 : end;
+    }
+}
+
+int main(int argc, char** argv)
+{
+  // a stray "-alone_ipc", "-threads" or "-quantum" is still an option of the library's getopt_long_only() table
+  static struct option long_options[] =
+    {
+      {"warmup_instructions", required_argument, 0, 'w'},
+      {"simulation_instructions", required_argument, 0, 'i'},
+      {"hide_heartbeat", no_argument, 0, 'h'},
+      {"scramble_loads", no_argument, 0, 's'},
+      {"small_llc", no_argument, 0, 'l'},
+      {"low_bandwidth", no_argument, 0, 'b'},
+      {"alone_ipc", required_argument, 0, 'a'},
+      {"threads", required_argument, 0, 't'},
+      {"quantum", required_argument, 0, 'q'},
+      {0, 0, 0, 0}
+    };
+  int cpu_num;
+
+  printf("\n*** Data Prefetching Championship 2 Simulator ***\n\n");
+
+  knob_scramble_loads = 0;
+  knob_small_llc = 0;
+  knob_low_bandwidth = 0;
+  warmup_instructions = 10000000;
+  simulation_instructions = 100000000;
+  show_heartbeat = 1;
+
+  while(1)
+    {
+      int option_index = 0;
+      int c = getopt_long_only(argc, argv, "wihslbatq", long_options, &option_index);
+      if(c == -1)
+	{
+	  break;
+	}
+
+      switch(c)
+	{
+	case 'w':
+	  warmup_instructions = atoi(optarg);
+	  break;
+	case 'i':
+	  simulation_instructions = atoi(optarg);
+	  break;
+	case 'h':
+	  show_heartbeat = 0;
+	  break;
+	case 's':
+	  knob_scramble_loads = 1;
+	  break;
+	case 'l':
+	  knob_small_llc = 1;
+	  break;
+	case 'b':
+	  knob_low_bandwidth = 1;
+	  break;
+	case 'a':
+	  multicore_parse_alone_ipc(optarg);
+	  break;
+	case 't':
+	  multicore_thread_count = atoi(optarg);
+	  break;
+	case 'q':
+	  multicore_quantum = atoi(optarg);
+	  break;
+	default:
+	  exit(1);
+	}
+    }
+
+  // the traces, one per core
+  multicore_core_count = argc - optind;
+  if(multicore_core_count == 0)
+    {
+      multicore_core_count = 1;
+      multicore_cores[0].trace_name = "stdin";
+      multicore_cores[0].trace = freopen(NULL, "rb", stdin);
+      if(multicore_cores[0].trace == NULL)
+	{
+	  printf("Couldn't open input trace file. Exiting.\n");
+	  exit(1);
+	}
+    }
+  else if((multicore_core_count > NUM_CPUS) || (multicore_core_count > mlc_cpus) || (multicore_core_count > llc_max_cpus))
+    {
+      printf("Built for %d cores, L2s for %d and the LLC for %d, but given %d traces. Exiting.\n",
+	     NUM_CPUS, mlc_cpus, llc_max_cpus, multicore_core_count);
+      exit(1);
+    }
+  else
+    {
+      for(cpu_num=0; cpu_num<multicore_core_count; cpu_num++)
+	{
+	  multicore_cores[cpu_num].trace_name = argv[optind + cpu_num];
+	  multicore_open_trace(&multicore_cores[cpu_num]);
+	}
+    }
+
+  for(cpu_num=0; cpu_num<multicore_core_count; cpu_num++)
+    {
+      multicore_core_t *core = &multicore_cores[cpu_num];
+      if((cpu_num >= MULTICORE_PREFETCHER_COUNT) || (multicore_prefetchers[cpu_num].initialize == NULL) ||
+	 (multicore_prefetchers[cpu_num].operate == NULL) || (multicore_prefetchers[cpu_num].cache_fill == NULL))
+	{
+	  printf("No prefetcher for core %d, link one in with its functions renamed to cpu%d_. Exiting.\n", cpu_num, cpu_num);
+	  exit(1);
+	}
+      core->prefetcher_initialize = multicore_prefetchers[cpu_num].initialize;
+      core->prefetcher_operate = multicore_prefetchers[cpu_num].operate;
+      core->cache_fill = multicore_prefetchers[cpu_num].cache_fill;
+      core->next_heartbeat = HEARTBEAT_INSTRUCTIONS;
+      if((core->alone_ipc == 0) != (multicore_cores[0].alone_ipc == 0))
+	{
+	  multicore_fail("-alone_ipc needs one IPC per trace.%s", "");
+	}
+    }
+  if((multicore_core_count < NUM_CPUS) && (multicore_cores[multicore_core_count].alone_ipc != 0))
+    {
+      multicore_fail("-alone_ipc needs one IPC per trace.%s", "");
+    }
+  if((multicore_thread_count < 1) || (multicore_thread_count > multicore_core_count))
+    {
+      multicore_thread_count = (multicore_thread_count < 1) ? 1 : multicore_core_count;
+    }
+  if((multicore_quantum < 1) || (multicore_quantum > llc_max_quantum))
+    {
+      printf("-quantum must be 1 to %d cycles. Exiting.\n", llc_max_quantum);
+      exit(1);
+    }
+  if(multicore_core_count == 1)
+    {
+      multicore_quantum = 1;
+    }
+
+  printf("Warmup Instructions: %lld\n", warmup_instructions);
+  printf("Simulation Instructions: %lld\n", simulation_instructions);
+  printf(knob_scramble_loads ? "Scramble loads ON\n" : "Scramble loads OFF\n");
+  if(knob_small_llc)
+    {
+      printf("Using 256KB Last Level Cache\n");
+      LLC_SETS = 256;
+    }
+  else
+    {
+      printf("Using 1MB Last Level Cache\n");
+      LLC_SETS = 1024;
+    }
+  if(knob_low_bandwidth)
+    {
+      printf("Using 3.2 GB/s DRAM bandwidth\n");
+      DRAM_MTPS = 400;
+    }
+  else
+    {
+      printf("Using 12.8 GB/s DRAM bandwidth\n");
+      DRAM_MTPS = 1600;
+    }
+  DRAM_DBUS_TRANSFER_TIME = 25600/DRAM_MTPS;
+  if(multicore_core_count > 1)
+    {
+      printf("Cores: %d, sharing the LLC and DRAM\n", multicore_core_count);
+      for(cpu_num=0; cpu_num<multicore_core_count; cpu_num++)
+	{
+	  printf("Core %d trace: %s\n", cpu_num, multicore_cores[cpu_num].trace_name);
+	}
+      if(multicore_quantum > 1)
+	{
+	  printf("Cores run %d cycles ahead of the LLC\n", multicore_quantum);
+	}
+      // lib/dpc2sim.a's heartbeat only knows the first core
+      multicore_show_heartbeat = show_heartbeat;
+      show_heartbeat = 0;
+    }
+
+  // lib/dpc2sim.a sets up the first core, the LLC and the memory controller, and the other cores start as copies of the first
+  llc_cpus = multicore_core_count;
+  llc_quantum = multicore_quantum;
+  // like glibc, rand() without srand() behaves as if seeded with 1
+  __wrap_srand(1);
+  initialize_cpus();
+  for(cpu_num=1; (cpu_num<multicore_core_count) && (cpu_num<NUM_CPUS); cpu_num++)
+    {
+      memcpy(multicore_state(cpu_num), multicore_state(0), OOO_CPU_SIZE);
+      initialize_dcu(cpu_num);
+      initialize_mlc(cpu_num);
+    }
+
+  for(cpu_num=0; cpu_num<multicore_core_count; cpu_num++)
+    {
+      multicore_fetch(cpu_num);
+    }
+
+  pthread_t threads[NUM_CPUS];
+  int threads_started = 0;
+  int sense = 0;
+  while(1)
+    {
+      // the cores all run the same cycles
+      long long int cycle = *multicore_counter(0, OOO_CPU_CYCLE_OFFSET);
+      if(multicore_quantum == 1)
+	{
+	  uncore_operate();
+	}
+
+      if(threads_started)
+	{
+	  multicore_barrier_wait(&sense);
+	  multicore_run(0, multicore_thread_count);
+	  multicore_barrier_wait(&sense);
+	}
+      else
+	{
+	  multicore_run(0, 1);
+	}
+
+      // the LLC and the memory controller catch up with the cores
+      if(multicore_quantum == 1)
+	{
+	  llc_commit_requests(cycle + 1);
+	}
+      else
+	{
+	  int i;
+	  for(i=0; i<multicore_quantum; i++)
+	    {
+	      uncore_operate();
+	      llc_commit_requests(cycle + i + 1);
+	    }
+	}
+
+      int done = 1;
+      for(cpu_num=0; cpu_num<multicore_core_count; cpu_num++)
+	{
+	  if(!multicore_check(cpu_num))
+	    {
+	      done = 0;
+	    }
+	}
+      if(done)
+	{
+	  break;
+	}
+
+      // the first cycle sets up lib/dpc2sim.a's heartbeat, which is not safe to do on several threads at once
+      if(!threads_started && (multicore_thread_count > 1))
+	{
+	  int thread;
+	  for(thread=1; thread<multicore_thread_count; thread++)
+	    {
+	      pthread_create(&threads[thread], NULL, multicore_worker, (void *)(long)thread);
+	    }
+	  threads_started = 1;
+	}
+    }
+
+  if(threads_started)
+    {
+      int thread;
+      multicore_done = 1;
+      multicore_barrier_wait(&sense);
+      for(thread=1; thread<multicore_thread_count; thread++)
+	{
+	  pthread_join(threads[thread], NULL);
+	}
+    }
+
+  multicore_report();
+
+  for(cpu_num=0; cpu_num<multicore_core_count; cpu_num++)
+    {
+      if(multicore_cores[cpu_num].trace_piped)
+	{
+	  pclose(multicore_cores[cpu_num].trace);
+	}
+      else
+	{
+	  fclose(multicore_cores[cpu_num].trace);
+	}
+    }
+
+  return 0;
+}
@@ -0,0 +1,454 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  Picks the representative intervals of a trace for sampled simulation, in
+  the way SimPoint does.
+
+  The trace is cut into intervals of the same number of instructions.  Each
+  interval gets a basic block vector: how many of its instructions each
+  basic block executed.  A basic block starts wherever the IP does not just
+  move on to the next instruction, and is named by its first IP.  The
+  vectors are reduced to a few dimensions by a random projection and
+  clustered with k-means, for every cluster count up to -max_k, and the
+  smallest count that scores within 90% of the best Bayesian information
+  criterion is kept.  From each cluster, the interval closest to its centre
+  is simulated, and weighted by the share of intervals in the cluster.
+
+  How to compile:
+
+  gcc -Wall -O2 -o simpoint tools/simpoint.c -lm
+
+  How to run:
+
+  zcat traces/lbm_trace2.dpc.gz | ./simpoint -interval 1000000 > traces/lbm_trace2.1000000.simpoints
+
+  The output has one line per chosen interval, with its index and weight,
+  after a comment line with the interval length.  A trailing interval
+  shorter than the rest is left out.  run.py --sample makes and reads these
+  files.
+
+  Options:
+
+  -interval <number>
+  Instructions per interval.  Default is 1000000.
+
+  -max_k <number>
+  Most clusters to try.  Default is 10.
+
+  -seed <number>
+  Seed for the projection and the k-means starting points.  Default is 1.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// dimensions the basic block vectors are projected down to
+#define SIMPOINT_DIMENSIONS 15
+
+// an IP further than this from the previous one starts a new basic block
+#define SIMPOINT_MAX_INSTRUCTION_SIZE 15
+
+// k-means runs from different random starting points, for each cluster count
+#define SIMPOINT_KMEANS_SEEDS 5
+#define SIMPOINT_KMEANS_ITERATIONS 100
+
+// share of the range of scores the chosen cluster count must reach
+#define SIMPOINT_BIC_THRESHOLD 0.9
+
+#define SIMPOINT_RECORD_SIZE 48
+#define SIMPOINT_READ_RECORDS 4096
+
+typedef struct simpoint_vector
+{
+  double value[SIMPOINT_DIMENSIONS];
+} simpoint_vector_t;
+
+typedef struct simpoint_clustering
+{
+  int k;
+  int *assignment;
+  simpoint_vector_t *centres;
+  double score;
+} simpoint_clustering_t;
+
+unsigned long long int simpoint_seed = 1;
+
+unsigned long long int simpoint_hash(unsigned long long int value)
+{
+  value ^= value >> 33;
+  value *= 0xff51afd7ed558ccdULL;
+  value ^= value >> 33;
+  value *= 0xc4ceb3f99e3b97f9ULL;
+  value ^= value >> 33;
+
+  return value;
+}
+
+// a pseudo-random number in [0, limit)
+int simpoint_random(int limit)
+{
+  simpoint_seed = simpoint_seed*6364136223846793005ULL + 1442695040888963407ULL;
+
+  return (int)((simpoint_seed >> 33) % limit);
+}
+
+// adds count instructions of the basic block starting at ip to vector, through a fixed random projection
+void simpoint_add_block(simpoint_vector_t *vector, unsigned long long int ip, unsigned long long int count, unsigned long long int seed)
+{
+  int d;
+  for(d=0; d<SIMPOINT_DIMENSIONS; d++)
+    {
+      unsigned long long int hash = simpoint_hash((ip ^ seed)*SIMPOINT_DIMENSIONS + d);
+      // uniform in [-1, 1]
+      double weight = (double)(hash >> 11)/(double)(1ULL << 52) - 1.0;
+      vector->value[d] += weight*count;
+    }
+}
+
+double simpoint_distance(const simpoint_vector_t *a, const simpoint_vector_t *b)
+{
+  double distance = 0.0;
+  int d;
+  for(d=0; d<SIMPOINT_DIMENSIONS; d++)
+    {
+      double difference = a->value[d] - b->value[d];
+      distance += difference*difference;
+    }
+
+  return distance;
+}
+
+// one k-means run from random starting points, returns the sum of squared distances
+double simpoint_kmeans(simpoint_vector_t *vectors, int count, int k, int *assignment, simpoint_vector_t *centres)
+{
+  int *sizes = malloc(k*sizeof(int));
+
+  // random intervals start as the centres
+  int i, c;
+  for(c=0; c<k; c++)
+    {
+      centres[c] = vectors[simpoint_random(count)];
+    }
+
+  for(i=0; i<count; i++)
+    {
+      assignment[i] = -1;
+    }
+
+  int iteration;
+  for(iteration=0; iteration<SIMPOINT_KMEANS_ITERATIONS; iteration++)
+    {
+      int changed = 0;
+      for(i=0; i<count; i++)
+	{
+	  int best = 0;
+	  double best_distance = simpoint_distance(&vectors[i], &centres[0]);
+	  for(c=1; c<k; c++)
+	    {
+	      double distance = simpoint_distance(&vectors[i], &centres[c]);
+	      if(distance < best_distance)
+		{
+		  best = c;
+		  best_distance = distance;
+		}
+	    }
+	  if(assignment[i] != best)
+	    {
+	      assignment[i] = best;
+	      changed = 1;
+	    }
+	}
+
+      if(!changed)
+	{
+	  break;
+	}
+
+      // an emptied cluster keeps its old centre
+      memset(sizes, 0, k*sizeof(int));
+      simpoint_vector_t *sums = calloc(k, sizeof(simpoint_vector_t));
+      for(i=0; i<count; i++)
+	{
+	  sizes[assignment[i]]++;
+	  int d;
+	  for(d=0; d<SIMPOINT_DIMENSIONS; d++)
+	    {
+	      sums[assignment[i]].value[d] += vectors[i].value[d];
+	    }
+	}
+      for(c=0; c<k; c++)
+	{
+	  if(sizes[c] > 0)
+	    {
+	      int d;
+	      for(d=0; d<SIMPOINT_DIMENSIONS; d++)
+		{
+		  centres[c].value[d] = sums[c].value[d]/sizes[c];
+		}
+	    }
+	}
+      free(sums);
+    }
+
+  double error = 0.0;
+  for(i=0; i<count; i++)
+    {
+      error += simpoint_distance(&vectors[i], &centres[assignment[i]]);
+    }
+
+  free(sizes);
+
+  return error;
+}
+
+// Bayesian information criterion of a clustering, as in Pelleg and Moore's X-means, higher is better
+double simpoint_bic(int count, int k, const int *assignment, double error)
+{
+  if(count <= k)
+    {
+      return -INFINITY;
+    }
+
+  // a floor keeps identical intervals from scoring infinitely well
+  double variance = error/((double)SIMPOINT_DIMENSIONS*(count - k));
+  if(variance < 1e-12)
+    {
+      variance = 1e-12;
+    }
+
+  int *sizes = calloc(k, sizeof(int));
+  int i, c;
+  for(i=0; i<count; i++)
+    {
+      sizes[assignment[i]]++;
+    }
+
+  double likelihood = 0.0;
+  for(c=0; c<k; c++)
+    {
+      if(sizes[c] > 0)
+	{
+	  double size = sizes[c];
+	  likelihood += size*log(size) - size*log(count)
+	    - size*SIMPOINT_DIMENSIONS/2.0*log(2.0*M_PI*variance)
+	    - (size - 1)*SIMPOINT_DIMENSIONS/2.0;
+	}
+    }
+  free(sizes);
+
+  double parameters = (k - 1) + (double)SIMPOINT_DIMENSIONS*k + 1;
+
+  return likelihood - parameters/2.0*log(count);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long long int interval = 1000000;
+  int max_k = 10;
+
+  int arg = 1;
+  while(arg < argc)
+    {
+      if(!strcmp(argv[arg], "-interval") && (arg+1 < argc))
+	{
+	  interval = strtoull(argv[arg+1], NULL, 10);
+	  arg += 2;
+	}
+      else if(!strcmp(argv[arg], "-max_k") && (arg+1 < argc))
+	{
+	  max_k = atoi(argv[arg+1]);
+	  arg += 2;
+	}
+      else if(!strcmp(argv[arg], "-seed") && (arg+1 < argc))
+	{
+	  simpoint_seed = strtoull(argv[arg+1], NULL, 10);
+	  arg += 2;
+	}
+      else
+	{
+	  fprintf(stderr, "Usage: %s [-interval <number>] [-max_k <number>] [-seed <number>] < trace.dpc\n", argv[0]);
+	  return 1;
+	}
+    }
+
+  if((interval == 0) || (max_k < 1))
+    {
+      fprintf(stderr, "-interval and -max_k must be positive\n");
+      return 1;
+    }
+
+  unsigned long long int projection_seed = simpoint_hash(simpoint_seed);
+
+  // the projected basic block vector of every whole interval
+  simpoint_vector_t *vectors = NULL;
+  int count = 0;
+  int capacity = 0;
+
+  simpoint_vector_t current;
+  memset(&current, 0, sizeof(current));
+  unsigned long long int in_interval = 0;
+
+  unsigned long long int block_ip = 0;
+  unsigned long long int block_count = 0;
+  unsigned long long int last_ip = 0;
+
+  static unsigned char records[SIMPOINT_READ_RECORDS*SIMPOINT_RECORD_SIZE];
+  size_t read_count;
+  while((read_count = fread(records, SIMPOINT_RECORD_SIZE, SIMPOINT_READ_RECORDS, stdin)) > 0)
+    {
+      size_t r;
+      for(r=0; r<read_count; r++)
+	{
+	  unsigned long long int ip;
+	  memcpy(&ip, &records[r*SIMPOINT_RECORD_SIZE], sizeof(ip));
+
+	  if((block_count == 0) || (ip <= last_ip) || (ip > last_ip + SIMPOINT_MAX_INSTRUCTION_SIZE))
+	    {
+	      if(block_count > 0)
+		{
+		  simpoint_add_block(&current, block_ip, block_count, projection_seed);
+		}
+	      block_ip = ip;
+	      block_count = 0;
+	    }
+	  block_count++;
+	  last_ip = ip;
+	  in_interval++;
+
+	  if(in_interval == interval)
+	    {
+	      // a block that runs on into the next interval is split between the two
+	      simpoint_add_block(&current, block_ip, block_count, projection_seed);
+	      block_count = 0;
+
+	      if(count == capacity)
+		{
+		  capacity = capacity ? 2*capacity : 1024;
+		  vectors = realloc(vectors, capacity*sizeof(simpoint_vector_t));
+		  if(vectors == NULL)
+		    {
+		      fprintf(stderr, "Out of memory\n");
+		      return 1;
+		    }
+		}
+
+	      int d;
+	      for(d=0; d<SIMPOINT_DIMENSIONS; d++)
+		{
+		  vectors[count].value[d] = current.value[d]/interval;
+		}
+	      count++;
+
+	      memset(&current, 0, sizeof(current));
+	      in_interval = 0;
+	    }
+	}
+    }
+
+  if(count == 0)
+    {
+      fprintf(stderr, "The trace is shorter than one interval\n");
+      return 1;
+    }
+  if(max_k > count)
+    {
+      max_k = count;
+    }
+
+  simpoint_clustering_t *clusterings = calloc(max_k+1, sizeof(simpoint_clustering_t));
+  int *assignment = malloc(count*sizeof(int));
+  simpoint_vector_t *centres = malloc(max_k*sizeof(simpoint_vector_t));
+  double best_score = -INFINITY;
+  double worst_score = INFINITY;
+
+  int k;
+  for(k=1; k<=max_k; k++)
+    {
+      clusterings[k].k = k;
+      clusterings[k].assignment = malloc(count*sizeof(int));
+      clusterings[k].centres = malloc(k*sizeof(simpoint_vector_t));
+
+      double best_error = INFINITY;
+      int seed;
+      for(seed=0; seed<SIMPOINT_KMEANS_SEEDS; seed++)
+	{
+	  double error = simpoint_kmeans(vectors, count, k, assignment, centres);
+	  if(error < best_error)
+	    {
+	      best_error = error;
+	      memcpy(clusterings[k].assignment, assignment, count*sizeof(int));
+	      memcpy(clusterings[k].centres, centres, k*sizeof(simpoint_vector_t));
+	    }
+	}
+
+      clusterings[k].score = simpoint_bic(count, k, clusterings[k].assignment, best_error);
+      if(clusterings[k].score > best_score)
+	{
+	  best_score = clusterings[k].score;
+	}
+      if(clusterings[k].score < worst_score)
+	{
+	  worst_score = clusterings[k].score;
+	}
+    }
+
+  // the fewest clusters that score close enough to the best
+  simpoint_clustering_t *chosen = &clusterings[max_k];
+  for(k=1; k<=max_k; k++)
+    {
+      if(isfinite(clusterings[k].score) &&
+	 (clusterings[k].score >= worst_score + SIMPOINT_BIC_THRESHOLD*(best_score - worst_score)))
+	{
+	  chosen = &clusterings[k];
+	  break;
+	}
+    }
+
+  // the interval closest to each centre, and the share of intervals in its cluster
+  int *representative = malloc(chosen->k*sizeof(int));
+  double *representative_distance = malloc(chosen->k*sizeof(double));
+  int *sizes = calloc(chosen->k, sizeof(int));
+  int c, i;
+  for(c=0; c<chosen->k; c++)
+    {
+      representative[c] = -1;
+    }
+  for(i=0; i<count; i++)
+    {
+      c = chosen->assignment[i];
+      double distance = simpoint_distance(&vectors[i], &chosen->centres[c]);
+      if((representative[c] == -1) || (distance < representative_distance[c]))
+	{
+	  representative[c] = i;
+	  representative_distance[c] = distance;
+	}
+      sizes[c]++;
+    }
+
+  // a cluster that k-means emptied has no interval to simulate
+  int used = 0;
+  for(c=0; c<chosen->k; c++)
+    {
+      used += (sizes[c] > 0);
+    }
+
+  printf("# interval %llu intervals %d clusters %d\n", interval, count, used);
+  for(i=0; i<count; i++)
+    {
+      for(c=0; c<chosen->k; c++)
+	{
+	  if(representative[c] == i)
+	    {
+	      printf("%d %.6f\n", i, (double)sizes[c]/count);
+	    }
+	}
+    }
+
+  return 0;
+}
@@ -0,0 +1,520 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  Adds a -stats_out <file> option to the simulator, which writes the
+  simulator's counters to a JSON lines or CSV file, so that results do not
+  have to be scraped from the heartbeat text.
+
+  One row is written every -stats_interval retired instructions, with the
+  counters of that interval, then one row for the whole warmup and one for
+  the whole simulation after it:
+   - instructions, cycles and IPC
+   - L1D reads and misses, L2 demand hits and misses, LLC demand and
+     prefetch reads and misses
+   - a histogram of the cycles spent at each L2 MSHR occupancy (0 to 16)
+     and each L2 read queue occupancy (0 to 32)
+   - DRAM row buffer hits, conflicts and accesses to a closed bank, per
+     bank as numbered by dram_get_bank()
+   - L2 prefetches issued and dropped by l2_prefetch_line(), useful ones
+     (hit by a demand access before being evicted) and late ones (a demand
+     access missed while the prefetch was still on its way to the L2)
+
+  A file name ending in .csv selects CSV, anything else JSON lines, where
+  the histograms are arrays.
+
+  This file wraps a prefetcher .c file like tools/l2_record.c, to count the
+  L2 accesses, fills and prefetches.  The linker's --wrap option routes the
+  rest of the simulator's calls it counts through the functions below:
+   - memory_controller_operate(), called once per cycle, samples the
+     occupancies and the DRAM row buffers
+   - dcu_add_to_read_queue(), mlc_add_to_read_queue(),
+     llc_add_to_read_queue() and mc_add_to_read_queue(), which the caches
+     call for each read they send down
+
+  How to compile:
+
+  gcc -Wall -o dpc2sim_stats -DPREFETCHER='"../example_prefetchers/stream_prefetcher.c"' tools/stats.c lib/dpc2sim.a -Wl,--wrap=memory_controller_operate,--wrap=dcu_add_to_read_queue,--wrap=mlc_add_to_read_queue,--wrap=llc_add_to_read_queue,--wrap=mc_add_to_read_queue
+
+  It can be linked together with tools/trace_mmap.c, tools/checkpoint.c and
+  tools/functional_warmup.c.
+
+  How to run:
+
+  zcat traces/lbm_trace2.dpc.gz | ./dpc2sim_stats -stats_out lbm.jsonl
+
+  Options:
+
+  -stats_out <file>
+  Write the counters to this file.  Without it nothing is written.
+
+  -stats_interval <number>
+  Retired instructions per interval row.  Default is 1000000.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "../inc/prefetcher.h"
+
+#ifndef PREFETCHER
+#error "Define PREFETCHER as the path of the prefetcher .c file to count with"
+#endif
+
+// the wrapped prefetcher's callbacks and its prefetch calls get renamed, so the ones below can count them
+#define l2_prefetcher_operate counted_l2_prefetcher_operate
+#define l2_cache_fill counted_l2_cache_fill
+#define l2_prefetch_line counted_l2_prefetch_line
+#include PREFETCHER
+#undef l2_prefetcher_operate
+#undef l2_cache_fill
+#undef l2_prefetch_line
+
+// where the core keeps its cycle and retired instruction counts
+#define OOO_CPU_CYCLE_OFFSET 8
+#define OOO_CPU_RETIRED_OFFSET 16
+
+#define STATS_L2_SETS 256
+#define STATS_L2_WAYS 8
+#define STATS_MSHR_ENTRIES 16
+#define STATS_READ_QUEUE_ENTRIES 32
+#define STATS_DRAM_BANKS 8
+#define STATS_PENDING_PREFETCHES 1024
+
+// the DRAM channel, as laid out in lib/dpc2sim.a
+typedef struct stats_dram_channel
+{
+  unsigned long long int bus_cycle;
+  int write_mode;
+  unsigned long long int bank_cycle[STATS_DRAM_BANKS];
+  int open_row[STATS_DRAM_BANKS];
+} stats_dram_channel_t;
+
+extern unsigned char ooo_cpu[];
+extern stats_dram_channel_t dram_channel[];
+extern long long int warmup_instructions;
+
+void __real_memory_controller_operate();
+int __real_dcu_add_to_read_queue(int cpu_num, unsigned long long int addr, unsigned long long int arg2, int arg3);
+int __real_mlc_add_to_read_queue(int cpu_num, unsigned long long int addr, unsigned long long int arg2, int arg3, int arg4);
+int __real_llc_add_to_read_queue(int cpu_num, unsigned long long int addr, int arg2, int prefetch);
+int __real_mc_add_to_read_queue(int cpu_num, unsigned long long int addr, int arg2, int prefetch);
+
+// every counter is an unsigned long long int, so that rows can be subtracted as arrays
+typedef struct stats_counters
+{
+  unsigned long long int instructions;
+  unsigned long long int cycles;
+  unsigned long long int l1d_reads;
+  unsigned long long int l1d_misses;
+  unsigned long long int l2_hits;
+  unsigned long long int l2_misses;
+  unsigned long long int llc_reads;
+  unsigned long long int llc_misses;
+  unsigned long long int llc_prefetch_reads;
+  unsigned long long int llc_prefetch_misses;
+  unsigned long long int prefetches_issued;
+  unsigned long long int prefetches_dropped;
+  unsigned long long int prefetches_useful;
+  unsigned long long int prefetches_late;
+  unsigned long long int l2_mshr_occupancy[STATS_MSHR_ENTRIES+1];
+  unsigned long long int l2_read_queue_occupancy[STATS_READ_QUEUE_ENTRIES+1];
+  unsigned long long int dram_row_hits[STATS_DRAM_BANKS];
+  unsigned long long int dram_row_conflicts[STATS_DRAM_BANKS];
+  unsigned long long int dram_row_closed[STATS_DRAM_BANKS];
+} stats_counters_t;
+
+#define STATS_COUNTER_COUNT (sizeof(stats_counters_t)/sizeof(unsigned long long int))
+
+typedef struct stats_field
+{
+  const char *name;
+  size_t offset;
+  int count;
+} stats_field_t;
+
+#define STATS_FIELD(name) { #name, offsetof(stats_counters_t, name), sizeof(((stats_counters_t *)0)->name)/sizeof(unsigned long long int) }
+
+stats_field_t stats_fields[] =
+  {
+    STATS_FIELD(instructions),
+    STATS_FIELD(cycles),
+    STATS_FIELD(l1d_reads),
+    STATS_FIELD(l1d_misses),
+    STATS_FIELD(l2_hits),
+    STATS_FIELD(l2_misses),
+    STATS_FIELD(llc_reads),
+    STATS_FIELD(llc_misses),
+    STATS_FIELD(llc_prefetch_reads),
+    STATS_FIELD(llc_prefetch_misses),
+    STATS_FIELD(prefetches_issued),
+    STATS_FIELD(prefetches_dropped),
+    STATS_FIELD(prefetches_useful),
+    STATS_FIELD(prefetches_late),
+    STATS_FIELD(l2_mshr_occupancy),
+    STATS_FIELD(l2_read_queue_occupancy),
+    STATS_FIELD(dram_row_hits),
+    STATS_FIELD(dram_row_conflicts),
+    STATS_FIELD(dram_row_closed),
+  };
+
+#define STATS_FIELD_COUNT (sizeof(stats_fields)/sizeof(stats_field_t))
+
+// counts since the start, and where the current interval and the simulation after the warmup started
+stats_counters_t stats_total;
+stats_counters_t stats_interval_start;
+stats_counters_t stats_warmup_end;
+int stats_warmup_complete;
+
+// 1 for each L2 line filled by a prefetch and not yet hit by a demand access
+unsigned char stats_prefetched[STATS_L2_SETS][STATS_L2_WAYS];
+
+// L2 prefetches issued and not yet filled, as line number plus one, indexed by the low bits of the line number
+unsigned long long int stats_pending[STATS_PENDING_PREFETCHES];
+
+FILE *stats_file;
+int stats_csv;
+unsigned long long int stats_interval = 1000000;
+
+void stats_write_row(const char *kind, stats_counters_t *end, stats_counters_t *start)
+{
+  unsigned long long int *end_values = (unsigned long long int *)end;
+  unsigned long long int *start_values = (unsigned long long int *)start;
+  stats_counters_t row;
+  unsigned long long int *values = (unsigned long long int *)&row;
+  unsigned int i;
+  for(i=0; i<STATS_COUNTER_COUNT; i++)
+    {
+      values[i] = end_values[i] - start_values[i];
+    }
+  double ipc = (row.cycles > 0) ? (double)row.instructions/row.cycles : 0.0;
+
+  if(stats_csv)
+    {
+      fprintf(stats_file, "%s,%llu,%llu,%f", kind, row.instructions, row.cycles, ipc);
+    }
+  else
+    {
+      fprintf(stats_file, "{\"kind\": \"%s\", \"instructions\": %llu, \"cycles\": %llu, \"ipc\": %f",
+	      kind, row.instructions, row.cycles, ipc);
+    }
+
+  // instructions and cycles are already out
+  for(i=2; i<STATS_FIELD_COUNT; i++)
+    {
+      unsigned long long int *field = (unsigned long long int *)((char *)&row + stats_fields[i].offset);
+      int j;
+      if(stats_csv)
+	{
+	  for(j=0; j<stats_fields[i].count; j++)
+	    {
+	      fprintf(stats_file, ",%llu", field[j]);
+	    }
+	}
+      else if(stats_fields[i].count == 1)
+	{
+	  fprintf(stats_file, ", \"%s\": %llu", stats_fields[i].name, field[0]);
+	}
+      else
+	{
+	  fprintf(stats_file, ", \"%s\": [", stats_fields[i].name);
+	  for(j=0; j<stats_fields[i].count; j++)
+	    {
+	      fprintf(stats_file, "%s%llu", (j > 0) ? ", " : "", field[j]);
+	    }
+	  fprintf(stats_file, "]");
+	}
+    }
+
+  fprintf(stats_file, stats_csv ? "\n" : "}\n");
+}
+
+void stats_write_csv_header()
+{
+  fprintf(stats_file, "kind,instructions,cycles,ipc");
+  unsigned int i;
+  for(i=2; i<STATS_FIELD_COUNT; i++)
+    {
+      int j;
+      if(stats_fields[i].count == 1)
+	{
+	  fprintf(stats_file, ",%s", stats_fields[i].name);
+	}
+      else
+	{
+	  for(j=0; j<stats_fields[i].count; j++)
+	    {
+	      fprintf(stats_file, ",%s_%d", stats_fields[i].name, j);
+	    }
+	}
+    }
+  fprintf(stats_file, "\n");
+}
+
+void stats_close()
+{
+  if(stats_file == NULL)
+    {
+      return;
+    }
+
+  // the last, partial interval
+  if(stats_total.instructions > stats_interval_start.instructions)
+    {
+      stats_write_row("interval", &stats_total, &stats_interval_start);
+    }
+
+  stats_counters_t zero;
+  memset(&zero, 0, sizeof(zero));
+  if(stats_warmup_complete)
+    {
+      stats_write_row("warmup", &stats_warmup_end, &zero);
+      stats_write_row("simulation", &stats_total, &stats_warmup_end);
+    }
+  else
+    {
+      stats_write_row("warmup", &stats_total, &zero);
+    }
+
+  fclose(stats_file);
+  stats_file = NULL;
+}
+
+void stats_open(const char *filename)
+{
+  stats_file = fopen(filename, "w");
+  if(stats_file == NULL)
+    {
+      printf("Couldn't create stats file %s. Exiting.\n", filename);
+      exit(1);
+    }
+
+  size_t length = strlen(filename);
+  stats_csv = (length >= 4) && !strcmp(filename + length - 4, ".csv");
+  if(stats_csv)
+    {
+      stats_write_csv_header();
+    }
+
+  // the simulator exits without telling the prefetcher, so write the last rows on exit
+  atexit(stats_close);
+}
+
+// glibc passes the program arguments to constructors
+__attribute__((constructor)) void stats_initialize(int argc, char **argv)
+{
+  // the options are taken out of argv, and the freed slots at its end left
+  // empty, which the simulator's getopt_long_only() skips as non-options
+  int i = 1;
+  int kept = 1;
+  while(i < argc)
+    {
+      const char *option = argv[i];
+      if(option[0] == '-' && option[1] == '-')
+	{
+	  option++;
+	}
+
+      if((i+1 < argc) && !strcmp(option, "-stats_out"))
+	{
+	  stats_open(argv[i+1]);
+	  i += 2;
+	}
+      else if((i+1 < argc) && !strcmp(option, "-stats_interval"))
+	{
+	  stats_interval = strtoull(argv[i+1], NULL, 10);
+	  if(stats_interval == 0)
+	    {
+	      printf("-stats_interval must be positive. Exiting.\n");
+	      exit(1);
+	    }
+	  i += 2;
+	}
+      else
+	{
+	  argv[kept++] = argv[i++];
+	}
+    }
+
+  for(; kept<argc; kept++)
+    {
+      argv[kept] = "";
+    }
+}
+
+void __wrap_memory_controller_operate()
+{
+  int occupancy = get_l2_mshr_occupancy(0);
+  if(occupancy > STATS_MSHR_ENTRIES)
+    {
+      occupancy = STATS_MSHR_ENTRIES;
+    }
+  stats_total.l2_mshr_occupancy[occupancy]++;
+
+  occupancy = get_l2_read_queue_occupancy(0);
+  if(occupancy > STATS_READ_QUEUE_ENTRIES)
+    {
+      occupancy = STATS_READ_QUEUE_ENTRIES;
+    }
+  stats_total.l2_read_queue_occupancy[occupancy]++;
+
+  // a bank that becomes busy has just been sent a read or a write, and the row it had open tells a hit from a conflict
+  stats_dram_channel_t before = dram_channel[0];
+  __real_memory_controller_operate();
+
+  int bank;
+  for(bank=0; bank<STATS_DRAM_BANKS; bank++)
+    {
+      if(dram_channel[0].bank_cycle[bank] != before.bank_cycle[bank])
+	{
+	  if(before.open_row[bank] == -1)
+	    {
+	      stats_total.dram_row_closed[bank]++;
+	    }
+	  else if(before.open_row[bank] == dram_channel[0].open_row[bank])
+	    {
+	      stats_total.dram_row_hits[bank]++;
+	    }
+	  else
+	    {
+	      stats_total.dram_row_conflicts[bank]++;
+	    }
+	}
+    }
+
+  long long int retired;
+  unsigned long long int cycle;
+  memcpy(&retired, ooo_cpu + OOO_CPU_RETIRED_OFFSET, sizeof(retired));
+  memcpy(&cycle, ooo_cpu + OOO_CPU_CYCLE_OFFSET, sizeof(cycle));
+  stats_total.instructions = retired;
+  stats_total.cycles = cycle;
+
+  // main() ends the warmup at the same point
+  if(!stats_warmup_complete && (retired > warmup_instructions))
+    {
+      stats_warmup_end = stats_total;
+      stats_warmup_complete = 1;
+    }
+
+  if((stats_file != NULL) && (stats_total.instructions - stats_interval_start.instructions >= stats_interval))
+    {
+      stats_write_row("interval", &stats_total, &stats_interval_start);
+      stats_interval_start = stats_total;
+    }
+}
+
+int __wrap_dcu_add_to_read_queue(int cpu_num, unsigned long long int addr, unsigned long long int arg2, int arg3)
+{
+  stats_total.l1d_reads++;
+  return __real_dcu_add_to_read_queue(cpu_num, addr, arg2, arg3);
+}
+
+// the DCU sends its read misses to the L2
+int __wrap_mlc_add_to_read_queue(int cpu_num, unsigned long long int addr, unsigned long long int arg2, int arg3, int arg4)
+{
+  stats_total.l1d_misses++;
+  return __real_mlc_add_to_read_queue(cpu_num, addr, arg2, arg3, arg4);
+}
+
+int __wrap_llc_add_to_read_queue(int cpu_num, unsigned long long int addr, int arg2, int prefetch)
+{
+  if(prefetch)
+    {
+      stats_total.llc_prefetch_reads++;
+    }
+  else
+    {
+      stats_total.llc_reads++;
+    }
+  return __real_llc_add_to_read_queue(cpu_num, addr, arg2, prefetch);
+}
+
+// the LLC sends its read misses to the memory controller
+int __wrap_mc_add_to_read_queue(int cpu_num, unsigned long long int addr, int arg2, int prefetch)
+{
+  if(prefetch)
+    {
+      stats_total.llc_prefetch_misses++;
+    }
+  else
+    {
+      stats_total.llc_misses++;
+    }
+  return __real_mc_add_to_read_queue(cpu_num, addr, arg2, prefetch);
+}
+
+int counted_l2_prefetch_line(int cpu_num, unsigned long long int base_addr, unsigned long long int pf_addr, int fill_level)
+{
+  int issued = l2_prefetch_line(cpu_num, base_addr, pf_addr, fill_level);
+  if(issued)
+    {
+      stats_total.prefetches_issued++;
+      if(fill_level == FILL_L2)
+	{
+	  stats_pending[(pf_addr>>6)%STATS_PENDING_PREFETCHES] = (pf_addr>>6)+1;
+	}
+    }
+  else
+    {
+      stats_total.prefetches_dropped++;
+    }
+
+  return issued;
+}
+
+// the pending entry of a line, if it has one
+unsigned long long int *stats_pending_entry(unsigned long long int addr)
+{
+  unsigned long long int *entry = &stats_pending[(addr>>6)%STATS_PENDING_PREFETCHES];
+  return (*entry == (addr>>6)+1) ? entry : NULL;
+}
+
+void l2_prefetcher_operate(int cpu_num, unsigned long long int addr, unsigned long long int ip, int cache_hit)
+{
+  // a demand miss takes over the MSHR of a prefetch to the same line, whose fill then counts as a demand fill
+  unsigned long long int *pending = stats_pending_entry(addr);
+  if(pending != NULL)
+    {
+      if(!cache_hit)
+	{
+	  stats_total.prefetches_late++;
+	}
+      *pending = 0;
+    }
+
+  if(cache_hit)
+    {
+      stats_total.l2_hits++;
+
+      int set = l2_get_set(addr);
+      int way = l2_get_way(cpu_num, addr, set);
+      if((way >= 0) && stats_prefetched[set][way])
+	{
+	  stats_total.prefetches_useful++;
+	  stats_prefetched[set][way] = 0;
+	}
+    }
+  else
+    {
+      stats_total.l2_misses++;
+    }
+
+  counted_l2_prefetcher_operate(cpu_num, addr, ip, cache_hit);
+}
+
+void l2_cache_fill(int cpu_num, unsigned long long int addr, int set, int way, int prefetch, unsigned long long int evicted_addr)
+{
+  stats_prefetched[set][way] = prefetch;
+
+  unsigned long long int *pending = stats_pending_entry(addr);
+  if(pending != NULL)
+    {
+      *pending = 0;
+    }
+
+  counted_l2_cache_fill(cpu_num, addr, set, way, prefetch, evicted_addr);
+}
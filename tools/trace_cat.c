@@ -0,0 +1,140 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  Streams a columnar .dpcc trace (see tools/trace_columns.h) back out as the
+  48-byte records the simulator reads from stdin.
+
+  How to compile:
+
+  gcc -Wall -O2 -o trace_cat tools/trace_cat.c -lz
+
+  How to run:
+
+  ./trace_cat traces/lbm_trace2.dpcc | ./dpc2sim
+
+  Options (before the trace file):
+
+  -skip <number>
+  Start at this instruction.  Only the block holding it is decoded, the
+  blocks before it are skipped through the block index.  Default is 0.
+
+  -count <number>
+  Stop after this many instructions.  Default is the rest of the trace.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace_columns.h"
+
+int main(int argc, char **argv)
+{
+  unsigned long long int skip = 0;
+  unsigned long long int count = 0;
+
+  int arg = 1;
+  while((arg < argc) && (argv[arg][0] == '-'))
+    {
+      if(!strcmp(argv[arg], "-skip") && (arg+1 < argc))
+	{
+	  skip = strtoull(argv[arg+1], NULL, 10);
+	  arg += 2;
+	}
+      else if(!strcmp(argv[arg], "-count") && (arg+1 < argc))
+	{
+	  count = strtoull(argv[arg+1], NULL, 10);
+	  arg += 2;
+	}
+      else
+	{
+	  fprintf(stderr, "Unknown option %s\n", argv[arg]);
+	  return 1;
+	}
+    }
+
+  if(argc - arg != 1)
+    {
+      fprintf(stderr, "Usage: %s [-skip <number>] [-count <number>] <trace.dpcc>\n", argv[0]);
+      return 1;
+    }
+
+  FILE *in = fopen(argv[arg], "rb");
+  if(in == NULL)
+    {
+      fprintf(stderr, "Could not open %s\n", argv[arg]);
+      return 1;
+    }
+
+  trace_file_header_t header;
+  if((fread(&header, sizeof(header), 1, in) != 1) ||
+     memcmp(header.magic, TRACE_COLUMNS_MAGIC, TRACE_COLUMNS_MAGIC_SIZE) ||
+     (header.block_records != TRACE_BLOCK_RECORDS))
+    {
+      fprintf(stderr, "%s is not a columnar trace\n", argv[arg]);
+      return 1;
+    }
+
+  trace_index_entry_t *index = malloc((header.block_count+1)*sizeof(trace_index_entry_t));
+  if((index == NULL) || fseek(in, header.index_offset, SEEK_SET) ||
+     (fread(index, sizeof(trace_index_entry_t), header.block_count, in) != header.block_count))
+    {
+      fprintf(stderr, "Could not read the block index of %s\n", argv[arg]);
+      return 1;
+    }
+
+  if((count == 0) || (count > header.record_count - skip))
+    {
+      count = (skip < header.record_count) ? header.record_count - skip : 0;
+    }
+
+  trace_record_t *records = malloc(TRACE_BLOCK_RECORDS*sizeof(trace_record_t));
+  trace_buffer_t block;
+  memset(&block, 0, sizeof(block));
+  if(records == NULL)
+    {
+      fprintf(stderr, "Out of memory\n");
+      return 1;
+    }
+
+  unsigned int block_index = skip / TRACE_BLOCK_RECORDS;
+  unsigned int first = skip % TRACE_BLOCK_RECORDS;
+  while(count > 0)
+    {
+      trace_index_entry_t *entry = &index[block_index];
+      trace_buffer_reserve(&block, entry->size);
+      if(fseek(in, entry->offset, SEEK_SET) || (fread(block.data, 1, entry->size, in) != entry->size))
+	{
+	  fprintf(stderr, "Could not read block %u of %s\n", block_index, argv[arg]);
+	  return 1;
+	}
+
+      int decoded = trace_block_decode(block.data, entry->size, records);
+      if(decoded <= (int)first)
+	{
+	  fprintf(stderr, "Block %u of %s is corrupt\n", block_index, argv[arg]);
+	  return 1;
+	}
+
+      unsigned long long int available = decoded - first;
+      if(available > count)
+	{
+	  available = count;
+	}
+
+      // the simulator closes stdin when it is done, which ends this process
+      if(fwrite(&records[first], sizeof(trace_record_t), available, stdout) != available)
+	{
+	  return 1;
+	}
+
+      count -= available;
+      first = 0;
+      block_index++;
+    }
+
+  return 0;
+}
@@ -0,0 +1,334 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+  Columnar trace files (.dpcc), written by tools/trace_convert.c and read by
+  tools/trace_cat.c.
+
+  A .dpc trace is a sequence of 48-byte records, one per instruction (see
+  trace_record_t).  A .dpcc file holds the same records, split into blocks of
+  TRACE_BLOCK_RECORDS instructions.  Within a block, each field of the record
+  is stored as its own column, so that similar values sit next to each other:
+   - the IP, as a zigzag delta from the previous IP
+   - the register ids, as is
+   - each memory address, 0 if unused, otherwise as a zigzag delta from the
+     last address the same IP used in the same column, plus one
+  Every value is written as an unsigned LEB128 varint, and each column is then
+  compressed on its own with zlib.
+
+  The file layout is:
+   - trace_file_header_t
+   - the blocks, each a trace_block_header_t followed by its columns, each a
+     trace_column_header_t followed by the compressed bytes
+   - the block index, one trace_index_entry_t per block
+  Blocks only depend on themselves, so a reader can seek to the block that
+  holds any instruction through the index, without decoding what comes before.
+
+  Link with -lz.  Everything is defined here, so each tool still builds as a
+  single file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define TRACE_COLUMNS_MAGIC "DPC2COL1"
+#define TRACE_COLUMNS_MAGIC_SIZE 8
+
+// instructions per block, a trade-off between compression and seek granularity
+#define TRACE_BLOCK_RECORDS 65536
+
+#define TRACE_MEMORY_OPERANDS 4
+// ip, registers, and the memory operands
+#define TRACE_COLUMN_COUNT (2+TRACE_MEMORY_OPERANDS)
+
+// per-IP last addresses for memory deltas, must be a power of two
+#define TRACE_IP_TABLE_COUNT 4096
+
+// one instruction, exactly as the simulator reads it from stdin
+typedef struct trace_record
+{
+  unsigned long long int ip;
+
+  // register ids, one per byte
+  unsigned long long int registers;
+
+  // memory addresses, 0 if unused
+  unsigned long long int memory[TRACE_MEMORY_OPERANDS];
+} trace_record_t;
+
+typedef struct trace_file_header
+{
+  char magic[TRACE_COLUMNS_MAGIC_SIZE];
+  unsigned long long int record_count;
+  unsigned long long int index_offset;
+  unsigned int block_records;
+  unsigned int block_count;
+} trace_file_header_t;
+
+typedef struct trace_block_header
+{
+  unsigned int record_count;
+  unsigned int column_count;
+} trace_block_header_t;
+
+typedef struct trace_column_header
+{
+  unsigned int raw_size;
+  unsigned int compressed_size;
+} trace_column_header_t;
+
+typedef struct trace_index_entry
+{
+  unsigned long long int offset;
+  unsigned long long int size;
+} trace_index_entry_t;
+
+// last address used by each IP, per memory column
+typedef struct trace_ip_entry
+{
+  unsigned long long int ip;
+  unsigned long long int last[TRACE_MEMORY_OPERANDS];
+} trace_ip_entry_t;
+
+typedef struct trace_buffer
+{
+  unsigned char *data;
+  size_t size;
+  size_t capacity;
+} trace_buffer_t;
+
+void trace_buffer_reserve(trace_buffer_t *buffer, size_t size)
+{
+  if(size > buffer->capacity)
+    {
+      buffer->capacity = (size > 2*buffer->capacity) ? size : 2*buffer->capacity;
+      buffer->data = realloc(buffer->data, buffer->capacity);
+      if(buffer->data == NULL)
+	{
+	  fprintf(stderr, "Out of memory\n");
+	  exit(1);
+	}
+    }
+}
+
+void trace_put_varint(trace_buffer_t *buffer, unsigned long long int value)
+{
+  trace_buffer_reserve(buffer, buffer->size + 10);
+  while(value >= 0x80)
+    {
+      buffer->data[buffer->size++] = (value & 0x7f) | 0x80;
+      value >>= 7;
+    }
+  buffer->data[buffer->size++] = value;
+}
+
+// the caller checks that the column has enough values, so this does not bounds check
+unsigned long long int trace_get_varint(const unsigned char **cursor)
+{
+  unsigned long long int value = 0;
+  int shift = 0;
+  while(**cursor & 0x80)
+    {
+      value |= (unsigned long long int)(**cursor & 0x7f) << shift;
+      shift += 7;
+      (*cursor)++;
+    }
+  value |= (unsigned long long int)**cursor << shift;
+  (*cursor)++;
+
+  return value;
+}
+
+unsigned long long int trace_zigzag(unsigned long long int delta)
+{
+  return (delta << 1) ^ (unsigned long long int)((long long int)delta >> 63);
+}
+
+unsigned long long int trace_unzigzag(unsigned long long int value)
+{
+  return (value >> 1) ^ (0 - (value & 1));
+}
+
+trace_ip_entry_t *trace_ip_lookup(trace_ip_entry_t *table, unsigned long long int ip)
+{
+  trace_ip_entry_t *entry = &table[(ip ^ (ip>>12)) & (TRACE_IP_TABLE_COUNT-1)];
+  if(entry->ip != ip)
+    {
+      memset(entry, 0, sizeof(trace_ip_entry_t));
+      entry->ip = ip;
+    }
+
+  return entry;
+}
+
+// encodes count records into out as one block
+void trace_block_encode(trace_record_t *records, unsigned int count, trace_buffer_t *out, int level)
+{
+  static trace_buffer_t columns[TRACE_COLUMN_COUNT];
+  static trace_ip_entry_t ip_table[TRACE_IP_TABLE_COUNT];
+
+  int c;
+  for(c=0; c<TRACE_COLUMN_COUNT; c++)
+    {
+      columns[c].size = 0;
+    }
+  memset(ip_table, 0, sizeof(ip_table));
+
+  unsigned long long int last_ip = 0;
+  unsigned int i;
+  for(i=0; i<count; i++)
+    {
+      trace_put_varint(&columns[0], trace_zigzag(records[i].ip - last_ip));
+      last_ip = records[i].ip;
+
+      trace_put_varint(&columns[1], records[i].registers);
+
+      trace_ip_entry_t *entry = trace_ip_lookup(ip_table, records[i].ip);
+      int m;
+      for(m=0; m<TRACE_MEMORY_OPERANDS; m++)
+	{
+	  unsigned long long int addr = records[i].memory[m];
+	  if(addr == 0)
+	    {
+	      trace_put_varint(&columns[2+m], 0);
+	    }
+	  else
+	    {
+	      trace_put_varint(&columns[2+m], trace_zigzag(addr - entry->last[m]) + 1);
+	      entry->last[m] = addr;
+	    }
+	}
+    }
+
+  trace_block_header_t block_header;
+  block_header.record_count = count;
+  block_header.column_count = TRACE_COLUMN_COUNT;
+
+  out->size = 0;
+  trace_buffer_reserve(out, sizeof(block_header));
+  memcpy(out->data, &block_header, sizeof(block_header));
+  out->size = sizeof(block_header);
+
+  for(c=0; c<TRACE_COLUMN_COUNT; c++)
+    {
+      uLongf compressed_size = compressBound(columns[c].size);
+      trace_buffer_reserve(out, out->size + sizeof(trace_column_header_t) + compressed_size);
+
+      if(compress2(out->data + out->size + sizeof(trace_column_header_t), &compressed_size,
+		   columns[c].data, columns[c].size, level) != Z_OK)
+	{
+	  fprintf(stderr, "zlib compression failed\n");
+	  exit(1);
+	}
+
+      trace_column_header_t column_header;
+      column_header.raw_size = columns[c].size;
+      column_header.compressed_size = compressed_size;
+      memcpy(out->data + out->size, &column_header, sizeof(column_header));
+      out->size += sizeof(column_header) + compressed_size;
+    }
+}
+
+// decodes one block into records, returns the record count, or -1 if the block is corrupt
+int trace_block_decode(const unsigned char *block, size_t size, trace_record_t *records)
+{
+  static trace_buffer_t columns[TRACE_COLUMN_COUNT];
+  static trace_ip_entry_t ip_table[TRACE_IP_TABLE_COUNT];
+
+  trace_block_header_t block_header;
+  if(size < sizeof(block_header))
+    {
+      return -1;
+    }
+  memcpy(&block_header, block, sizeof(block_header));
+  if((block_header.column_count != TRACE_COLUMN_COUNT) || (block_header.record_count > TRACE_BLOCK_RECORDS))
+    {
+      return -1;
+    }
+
+  size_t offset = sizeof(block_header);
+  int c;
+  for(c=0; c<TRACE_COLUMN_COUNT; c++)
+    {
+      trace_column_header_t column_header;
+      if(offset + sizeof(column_header) > size)
+	{
+	  return -1;
+	}
+      memcpy(&column_header, block + offset, sizeof(column_header));
+      offset += sizeof(column_header);
+
+      // every value takes 1 to 10 bytes
+      if((offset + column_header.compressed_size > size) ||
+	 (column_header.raw_size < block_header.record_count) ||
+	 (column_header.raw_size > 10ULL*block_header.record_count))
+	{
+	  return -1;
+	}
+
+      trace_buffer_reserve(&columns[c], column_header.raw_size);
+      uLongf raw_size = column_header.raw_size;
+      if((uncompress(columns[c].data, &raw_size, block + offset, column_header.compressed_size) != Z_OK) ||
+	 (raw_size != column_header.raw_size))
+	{
+	  return -1;
+	}
+      columns[c].size = raw_size;
+      offset += column_header.compressed_size;
+    }
+
+  // a corrupt column could still run past its end, so stop at the last varint
+  for(c=0; c<TRACE_COLUMN_COUNT; c++)
+    {
+      if((columns[c].size > 0) && (columns[c].data[columns[c].size-1] & 0x80))
+	{
+	  return -1;
+	}
+    }
+
+  const unsigned char *cursor[TRACE_COLUMN_COUNT];
+  for(c=0; c<TRACE_COLUMN_COUNT; c++)
+    {
+      cursor[c] = columns[c].data;
+    }
+  memset(ip_table, 0, sizeof(ip_table));
+
+  unsigned long long int last_ip = 0;
+  unsigned int i;
+  for(i=0; i<block_header.record_count; i++)
+    {
+      for(c=0; c<TRACE_COLUMN_COUNT; c++)
+	{
+	  if(cursor[c] >= columns[c].data + columns[c].size)
+	    {
+	      return -1;
+	    }
+	}
+
+      last_ip += trace_unzigzag(trace_get_varint(&cursor[0]));
+      records[i].ip = last_ip;
+
+      records[i].registers = trace_get_varint(&cursor[1]);
+
+      trace_ip_entry_t *entry = trace_ip_lookup(ip_table, last_ip);
+      int m;
+      for(m=0; m<TRACE_MEMORY_OPERANDS; m++)
+	{
+	  unsigned long long int value = trace_get_varint(&cursor[2+m]);
+	  if(value == 0)
+	    {
+	      records[i].memory[m] = 0;
+	    }
+	  else
+	    {
+	      entry->last[m] += trace_unzigzag(value - 1);
+	      records[i].memory[m] = entry->last[m];
+	    }
+	}
+    }
+
+  return block_header.record_count;
+}
@@ -0,0 +1,138 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  Converts a trace into the columnar .dpcc format (see tools/trace_columns.h),
+  which compresses better than gzip and can be read from any instruction on.
+
+  How to compile:
+
+  gcc -Wall -O2 -o trace_convert tools/trace_convert.c -lz
+
+  How to run:
+
+  zcat traces/lbm_trace2.dpc.gz | ./trace_convert traces/lbm_trace2.dpcc
+
+  Options (before the output file):
+
+  -level <number>
+  zlib compression level, from 1 (fastest) to 9 (smallest).  Decompression
+  speed hardly depends on it.  Default is 6.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace_columns.h"
+
+int main(int argc, char **argv)
+{
+  int level = 6;
+
+  int arg = 1;
+  while((arg < argc) && (argv[arg][0] == '-'))
+    {
+      if(!strcmp(argv[arg], "-level") && (arg+1 < argc))
+	{
+	  level = atoi(argv[arg+1]);
+	  arg += 2;
+	}
+      else
+	{
+	  fprintf(stderr, "Unknown option %s\n", argv[arg]);
+	  return 1;
+	}
+    }
+
+  if((argc - arg != 1) || (level < 1) || (level > 9))
+    {
+      fprintf(stderr, "Usage: %s [-level <1-9>] <output.dpcc> < trace.dpc\n", argv[0]);
+      return 1;
+    }
+
+  FILE *out = fopen(argv[arg], "wb");
+  if(out == NULL)
+    {
+      fprintf(stderr, "Could not create %s\n", argv[arg]);
+      return 1;
+    }
+
+  // the header is rewritten once the counts and index offset are known
+  trace_file_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TRACE_COLUMNS_MAGIC, TRACE_COLUMNS_MAGIC_SIZE);
+  header.block_records = TRACE_BLOCK_RECORDS;
+  fwrite(&header, sizeof(header), 1, out);
+
+  trace_record_t *records = malloc(TRACE_BLOCK_RECORDS*sizeof(trace_record_t));
+  trace_index_entry_t *index = NULL;
+  trace_buffer_t block;
+  memset(&block, 0, sizeof(block));
+  if(records == NULL)
+    {
+      fprintf(stderr, "Out of memory\n");
+      return 1;
+    }
+
+  unsigned long long int offset = sizeof(header);
+  while(1)
+    {
+      size_t bytes = fread(records, 1, TRACE_BLOCK_RECORDS*sizeof(trace_record_t), stdin);
+      if(bytes % sizeof(trace_record_t) != 0)
+	{
+	  fprintf(stderr, "Input ends in the middle of a record, it is not a trace\n");
+	  return 1;
+	}
+
+      unsigned int count = bytes/sizeof(trace_record_t);
+      if(count == 0)
+	{
+	  break;
+	}
+
+      trace_block_encode(records, count, &block, level);
+      if(fwrite(block.data, 1, block.size, out) != block.size)
+	{
+	  fprintf(stderr, "Could not write %s\n", argv[arg]);
+	  return 1;
+	}
+
+      index = realloc(index, (header.block_count+1)*sizeof(trace_index_entry_t));
+      if(index == NULL)
+	{
+	  fprintf(stderr, "Out of memory\n");
+	  return 1;
+	}
+      index[header.block_count].offset = offset;
+      index[header.block_count].size = block.size;
+      header.block_count++;
+      header.record_count += count;
+      offset += block.size;
+
+      if(count < TRACE_BLOCK_RECORDS)
+	{
+	  break;
+	}
+    }
+
+  header.index_offset = offset;
+  fwrite(index, sizeof(trace_index_entry_t), header.block_count, out);
+  fseek(out, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, out);
+
+  if(fclose(out) != 0)
+    {
+      fprintf(stderr, "Could not write %s\n", argv[arg]);
+      return 1;
+    }
+
+  unsigned long long int file_size = offset + header.block_count*sizeof(trace_index_entry_t);
+  printf("%llu instructions in %u blocks, %llu bytes, %.2f bytes per instruction\n",
+	 header.record_count, header.block_count, file_size,
+	 header.record_count ? (double)file_size/header.record_count : 0.0);
+
+  return 0;
+}
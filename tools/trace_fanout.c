@@ -0,0 +1,345 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  Feeds one trace to several simulator instances at once, so a trace is
+  decompressed once per run rather than once per prefetcher.
+
+  How to compile:
+
+  gcc -Wall -O2 -o trace_fanout tools/trace_fanout.c -lpthread
+
+  How to run:
+
+  zcat trace.dpc.gz | ./trace_fanout "./dpc2sim_ampm > ampm_out" "./dpc2sim_ip > ip_out"
+
+  Each argument is a shell command that reads the trace from its stdin.  The
+  trace is read from stdin into a ring buffer in shared memory.  Every command
+  gets a feeder process that copies from the ring into a pipe on the command's
+  stdin, at its own pace.  The reader only overwrites ring space that every
+  feeder has already copied out, so the slowest simulator sets the pace and the
+  others wait on it instead of buffering the whole trace.
+
+  A simulator that exits before the end of the trace (for example after
+  -simulation_instructions) detaches from the ring and no longer holds the
+  others back.
+
+  Options:
+
+  -ring_mb <number>
+  Size of the shared ring buffer in MB.  Default is 64.
+
+  The exit status is 0 only if every command exited with status 0.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define MAX_CONSUMERS 64
+
+// bytes moved per read() or write(), a whole number of 48-byte trace records
+#define CHUNK_SIZE (48*1024)
+
+typedef struct ring
+{
+  pthread_mutex_t lock;
+  // signalled when the reader adds data or reaches the end of the trace
+  pthread_cond_t data_ready;
+  // signalled when a feeder frees space or detaches
+  pthread_cond_t space_ready;
+
+  unsigned long long int size;
+
+  // total bytes written by the reader, and copied out by each feeder
+  unsigned long long int write_pos;
+  unsigned long long int read_pos[MAX_CONSUMERS];
+  int active[MAX_CONSUMERS];
+  int consumer_count;
+
+  int eof;
+
+  // the ring data follows the header
+  unsigned char data[];
+} ring_t;
+
+ring_t *ring;
+
+// returns how far the slowest attached feeder is behind the reader
+unsigned long long int ring_backlog()
+{
+  unsigned long long int backlog = 0;
+
+  int i;
+  for(i=0; i<ring->consumer_count; i++)
+    {
+      if(ring->active[i] && (ring->write_pos - ring->read_pos[i] > backlog))
+	{
+	  backlog = ring->write_pos - ring->read_pos[i];
+	}
+    }
+
+  return backlog;
+}
+
+// writes all of buf to fd, returns 0 if the other end went away
+int write_all(int fd, unsigned char *buf, unsigned long long int count)
+{
+  while(count > 0)
+    {
+      ssize_t written = write(fd, buf, count);
+      if(written < 0)
+	{
+	  if(errno == EINTR)
+	    {
+	      continue;
+	    }
+	  return 0;
+	}
+      buf += written;
+      count -= written;
+    }
+
+  return 1;
+}
+
+// copies the ring into fd for consumer id, until the trace ends or fd is closed
+void feed(int id, int fd)
+{
+  while(1)
+    {
+      pthread_mutex_lock(&ring->lock);
+      while((ring->read_pos[id] == ring->write_pos) && !ring->eof)
+	{
+	  pthread_cond_wait(&ring->data_ready, &ring->lock);
+	}
+      unsigned long long int read_pos = ring->read_pos[id];
+      unsigned long long int available = ring->write_pos - read_pos;
+      pthread_mutex_unlock(&ring->lock);
+
+      if(available == 0)
+	{
+	  // the trace is over
+	  break;
+	}
+
+      // copy up to the end of the ring, the rest is picked up next time around
+      unsigned long long int offset = read_pos % ring->size;
+      if(available > ring->size - offset)
+	{
+	  available = ring->size - offset;
+	}
+      if(available > CHUNK_SIZE)
+	{
+	  available = CHUNK_SIZE;
+	}
+
+      int ok = write_all(fd, &ring->data[offset], available);
+
+      pthread_mutex_lock(&ring->lock);
+      if(ok)
+	{
+	  ring->read_pos[id] = read_pos + available;
+	}
+      else
+	{
+	  // the simulator stopped reading, stop holding back the others
+	  ring->active[id] = 0;
+	}
+      pthread_cond_broadcast(&ring->space_ready);
+      pthread_mutex_unlock(&ring->lock);
+
+      if(!ok)
+	{
+	  break;
+	}
+    }
+
+  close(fd);
+}
+
+// starts the command with a pipe on its stdin and a feeder process copying into it
+pid_t start_consumer(int id, char *command)
+{
+  int fds[2];
+  if(pipe(fds) != 0)
+    {
+      perror("pipe");
+      exit(1);
+    }
+
+  pid_t feeder = fork();
+  if(feeder < 0)
+    {
+      perror("fork");
+      exit(1);
+    }
+  if(feeder > 0)
+    {
+      close(fds[0]);
+      close(fds[1]);
+      return feeder;
+    }
+
+  pid_t sim = fork();
+  if(sim < 0)
+    {
+      perror("fork");
+      exit(1);
+    }
+  if(sim == 0)
+    {
+      dup2(fds[0], 0);
+      close(fds[0]);
+      close(fds[1]);
+      execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+      perror("execl");
+      _exit(127);
+    }
+
+  close(fds[0]);
+  feed(id, fds[1]);
+
+  int status;
+  waitpid(sim, &status, 0);
+  _exit(WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long long int ring_mb = 64;
+
+  int first_command = 1;
+  while((first_command < argc) && (argv[first_command][0] == '-'))
+    {
+      if(!strcmp(argv[first_command], "-ring_mb") && (first_command+1 < argc))
+	{
+	  ring_mb = strtoull(argv[first_command+1], NULL, 10);
+	  first_command += 2;
+	}
+      else
+	{
+	  fprintf(stderr, "Unknown option %s\n", argv[first_command]);
+	  return 1;
+	}
+    }
+
+  int consumer_count = argc - first_command;
+  if((consumer_count < 1) || (consumer_count > MAX_CONSUMERS) || (ring_mb == 0))
+    {
+      fprintf(stderr, "Usage: %s [-ring_mb <number>] <command> [<command> ...]\n", argv[0]);
+      fprintf(stderr, "Between 1 and %d commands are allowed.\n", MAX_CONSUMERS);
+      return 1;
+    }
+
+  // a write to a simulator that has exited must fail with EPIPE, not kill the feeder
+  signal(SIGPIPE, SIG_IGN);
+
+  unsigned long long int ring_size = ring_mb*1024*1024;
+  ring = mmap(NULL, sizeof(ring_t) + ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if(ring == MAP_FAILED)
+    {
+      perror("mmap");
+      return 1;
+    }
+
+  pthread_mutexattr_t mutex_attr;
+  pthread_mutexattr_init(&mutex_attr);
+  pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutex_init(&ring->lock, &mutex_attr);
+
+  pthread_condattr_t cond_attr;
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+  pthread_cond_init(&ring->data_ready, &cond_attr);
+  pthread_cond_init(&ring->space_ready, &cond_attr);
+
+  ring->size = ring_size;
+  ring->write_pos = 0;
+  ring->eof = 0;
+  ring->consumer_count = consumer_count;
+
+  pid_t feeders[MAX_CONSUMERS];
+  int i;
+  for(i=0; i<consumer_count; i++)
+    {
+      ring->read_pos[i] = 0;
+      ring->active[i] = 1;
+    }
+  for(i=0; i<consumer_count; i++)
+    {
+      feeders[i] = start_consumer(i, argv[first_command+i]);
+    }
+
+  // read the trace into the ring
+  while(1)
+    {
+      pthread_mutex_lock(&ring->lock);
+      while(ring_backlog() + CHUNK_SIZE > ring->size)
+	{
+	  pthread_cond_wait(&ring->space_ready, &ring->lock);
+	}
+      unsigned long long int offset = ring->write_pos % ring->size;
+      int attached = 0;
+      for(i=0; i<consumer_count; i++)
+	{
+	  attached |= ring->active[i];
+	}
+      pthread_mutex_unlock(&ring->lock);
+
+      if(!attached)
+	{
+	  // every simulator has finished, the rest of the trace is not needed
+	  break;
+	}
+
+      unsigned long long int count = CHUNK_SIZE;
+      if(count > ring->size - offset)
+	{
+	  count = ring->size - offset;
+	}
+
+      ssize_t bytes = read(0, &ring->data[offset], count);
+      if((bytes < 0) && (errno == EINTR))
+	{
+	  continue;
+	}
+      if(bytes <= 0)
+	{
+	  break;
+	}
+
+      pthread_mutex_lock(&ring->lock);
+      ring->write_pos += bytes;
+      pthread_cond_broadcast(&ring->data_ready);
+      pthread_mutex_unlock(&ring->lock);
+    }
+
+  pthread_mutex_lock(&ring->lock);
+  ring->eof = 1;
+  pthread_cond_broadcast(&ring->data_ready);
+  pthread_mutex_unlock(&ring->lock);
+
+  int failed = 0;
+  for(i=0; i<consumer_count; i++)
+    {
+      int status;
+      waitpid(feeders[i], &status, 0);
+      if(!WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+	{
+	  fprintf(stderr, "Command failed: %s\n", argv[first_command+i]);
+	  failed = 1;
+	}
+    }
+
+  return failed;
+}
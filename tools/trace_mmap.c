@@ -0,0 +1,159 @@
+//
+// Data Prefetching Championship Simulator 2
+//
+
+/*
+
+  Adds a -trace <file> option to the simulator, which reads an uncompressed
+  trace straight from a memory mapping of the file instead of from stdin.
+
+  There is no pipe, no zcat and no read() copy into a stdio buffer, and every
+  simulator running on the same trace shares the one copy of it in the page
+  cache.  Without -trace the simulator reads stdin as before, so compressed
+  traces still work through zcat.
+
+  lib/dpc2sim.a reopens stdin with freopen(), reads each instruction from it
+  with fread(), and parses its options with getopt_long_only().  This file is
+  linked in next to the prefetcher, and the linker's --wrap option routes those
+  three calls through the functions below.  The trace is mapped before main()
+  runs, because the simulator reopens stdin before it parses its options.
+
+  How to compile:
+
+  gcc -Wall -o dpc2sim example_prefetchers/stream_prefetcher.c tools/trace_mmap.c lib/dpc2sim.a -Wl,--wrap=freopen,--wrap=fread,--wrap=getopt_long_only
+
+  How to run:
+
+  zcat traces/lbm_trace2.dpc.gz > /local/lbm_trace2.dpc
+  ./dpc2sim -trace /local/lbm_trace2.dpc
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// returned by getopt_long_only() for -trace, outside the range of the simulator's own options
+#define TRACE_OPTION 0x1000
+
+// the mapped trace, and how far the simulator has read into it
+const unsigned char *trace_map;
+size_t trace_size;
+size_t trace_offset;
+
+FILE *__real_freopen(const char *path, const char *mode, FILE *stream);
+size_t __real_fread(void *ptr, size_t size, size_t nmemb, FILE *stream);
+int __real_getopt_long_only(int argc, char * const argv[], const char *optstring, const struct option *longopts, int *longindex);
+
+void trace_mmap_open(const char *filename)
+{
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+  if((fd < 0) || (fstat(fd, &st) != 0))
+    {
+      printf("Couldn't open input trace file %s. Exiting.\n", filename);
+      exit(1);
+    }
+
+  trace_size = st.st_size;
+  trace_offset = 0;
+  if(trace_size > 0)
+    {
+      trace_map = mmap(NULL, trace_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(trace_map == MAP_FAILED)
+	{
+	  printf("Couldn't map input trace file %s. Exiting.\n", filename);
+	  exit(1);
+	}
+
+      // the trace is read once from front to back; advice values are not flags, so each takes its own call
+      madvise((void *)trace_map, trace_size, MADV_SEQUENTIAL);
+      madvise((void *)trace_map, trace_size, MADV_WILLNEED);
+    }
+  else
+    {
+      // an empty trace ends the simulation at once, like an empty stdin
+      trace_map = (const unsigned char *)"";
+    }
+
+  close(fd);
+}
+
+// glibc passes the program arguments to constructors
+__attribute__((constructor)) void trace_mmap_initialize(int argc, char **argv)
+{
+  int i;
+  for(i=1; i<argc-1; i++)
+    {
+      if(!strcmp(argv[i], "-trace") || !strcmp(argv[i], "--trace"))
+	{
+	  trace_mmap_open(argv[i+1]);
+	}
+    }
+}
+
+FILE *__wrap_freopen(const char *path, const char *mode, FILE *stream)
+{
+  // stdin is not read at all, so it does not have to be open
+  if((trace_map != NULL) && (stream == stdin))
+    {
+      return stdin;
+    }
+
+  return __real_freopen(path, mode, stream);
+}
+
+size_t __wrap_fread(void *ptr, size_t size, size_t nmemb, FILE *stream)
+{
+  if((trace_map == NULL) || (stream != stdin) || (size == 0))
+    {
+      return __real_fread(ptr, size, nmemb, stream);
+    }
+
+  // like fread(), only whole items are returned
+  size_t items = (trace_size - trace_offset)/size;
+  if(items > nmemb)
+    {
+      items = nmemb;
+    }
+
+  memcpy(ptr, trace_map + trace_offset, items*size);
+  trace_offset += items*size;
+
+  return items;
+}
+
+int __wrap_getopt_long_only(int argc, char * const argv[], const char *optstring, const struct option *longopts, int *longindex)
+{
+  // the simulator's options, followed by -trace, which was handled before main()
+  static struct option *options = NULL;
+  if(options == NULL)
+    {
+      int count = 0;
+      while(longopts[count].name != NULL)
+	{
+	  count++;
+	}
+
+      options = calloc(count+2, sizeof(struct option));
+      memcpy(options, longopts, count*sizeof(struct option));
+      options[count].name = "trace";
+      options[count].has_arg = required_argument;
+      options[count].flag = NULL;
+      options[count].val = TRACE_OPTION;
+    }
+
+  int result;
+  do
+    {
+      result = __real_getopt_long_only(argc, argv, optstring, options, longindex);
+    }
+  while(result == TRACE_OPTION);
+
+  return result;
+}